@@ -0,0 +1,32 @@
+# Runs the simulator on TRACE and compares its TRC lines with GOLDEN.
+# -DUPDATE=1 writes GOLDEN from the current output instead, review the diff before committing it.
+
+execute_process(
+	COMMAND ${SIM} ${TRACE} ${REPEAT}
+	OUTPUT_VARIABLE output
+	RESULT_VARIABLE result)
+
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${SIM} ${TRACE} failed: ${result}")
+endif()
+
+# The TRC fields are separated by semicolons, keep them out of the CMake list handling
+string(REPLACE ";" "<sc>" output "${output}")
+string(REGEX MATCHALL "TRC<sc>[^\r\n]*" lines "${output}")
+list(JOIN lines "\n" trace)
+string(REPLACE "<sc>" ";" trace "${trace}")
+
+file(WRITE ${OUTPUT} "${trace}\n")
+
+if(UPDATE)
+	file(WRITE ${GOLDEN} "${trace}\n")
+	return()
+endif()
+
+execute_process(
+	COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${GOLDEN}
+	RESULT_VARIABLE different)
+
+if(different)
+	message(FATAL_ERROR "Transitions differ from the golden trace: diff ${GOLDEN} ${OUTPUT}")
+endif()
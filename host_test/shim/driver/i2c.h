@@ -0,0 +1,19 @@
+/*
+ * i2c.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_DRIVER_I2C_H_
+#define HOST_TEST_SHIM_DRIVER_I2C_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Types only, for struct i2c_dev_s in system.h.
+typedef int i2c_port_t;
+
+typedef struct {
+	int unused;
+} i2c_config_t;
+
+#endif /* HOST_TEST_SHIM_DRIVER_I2C_H_ */
@@ -0,0 +1,15 @@
+/*
+ * adc_cali.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ADC_CALI_H_
+#define HOST_TEST_SHIM_ADC_CALI_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Types only, for struct adc_dev_s in system.h.
+typedef void *adc_cali_handle_t;
+
+#endif /* HOST_TEST_SHIM_ADC_CALI_H_ */
@@ -0,0 +1,16 @@
+/*
+ * adc_continuous.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ADC_CONTINUOUS_H_
+#define HOST_TEST_SHIM_ADC_CONTINUOUS_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Types only, for struct adc_dev_s in system.h.
+typedef int adc_channel_t;
+typedef void *adc_continuous_handle_t;
+
+#endif /* HOST_TEST_SHIM_ADC_CONTINUOUS_H_ */
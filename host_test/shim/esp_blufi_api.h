@@ -0,0 +1,20 @@
+/*
+ * esp_blufi_api.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_BLUFI_API_H_
+#define HOST_TEST_SHIM_ESP_BLUFI_API_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+	int unused;
+} esp_blufi_callbacks_t;
+
+typedef struct {
+	int unused;
+} esp_blufi_extra_info_t;
+
+#endif /* HOST_TEST_SHIM_ESP_BLUFI_API_H_ */
@@ -0,0 +1,14 @@
+/*
+ * esp_cpu.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_CPU_H_
+#define HOST_TEST_SHIM_ESP_CPU_H_
+
+#include <stdint.h>
+
+uint32_t esp_cpu_get_cycle_count(void);
+
+#endif /* HOST_TEST_SHIM_ESP_CPU_H_ */
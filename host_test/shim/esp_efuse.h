@@ -0,0 +1,21 @@
+/*
+ * esp_efuse.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_EFUSE_H_
+#define HOST_TEST_SHIM_ESP_EFUSE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+	EFUSE_BLK3 = 3,
+	EFUSE_BLK4 = 4,
+	EFUSE_BLK5 = 5,
+} esp_efuse_block_t;
+
+/// Blank efuses: every bit reads 0.
+esp_err_t esp_efuse_read_block(esp_efuse_block_t block, void *dst, size_t offset_in_bits, size_t size_bits);
+
+#endif /* HOST_TEST_SHIM_ESP_EFUSE_H_ */
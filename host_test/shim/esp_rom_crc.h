@@ -0,0 +1,14 @@
+/*
+ * esp_rom_crc.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_ROM_CRC_H_
+#define HOST_TEST_SHIM_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#endif /* HOST_TEST_SHIM_ESP_ROM_CRC_H_ */
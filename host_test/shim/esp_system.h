@@ -0,0 +1,16 @@
+/*
+ * esp_system.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_SYSTEM_H_
+#define HOST_TEST_SHIM_ESP_SYSTEM_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+#endif /* HOST_TEST_SHIM_ESP_SYSTEM_H_ */
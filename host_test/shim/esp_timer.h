@@ -0,0 +1,15 @@
+/*
+ * esp_timer.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_TIMER_H_
+#define HOST_TEST_SHIM_ESP_TIMER_H_
+
+#include <stdint.h>
+
+/// Virtual time since the start of the simulation (us), advances by whole ticks.
+int64_t esp_timer_get_time(void);
+
+#endif /* HOST_TEST_SHIM_ESP_TIMER_H_ */
@@ -0,0 +1,21 @@
+/*
+ * esp_wifi.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_WIFI_H_
+#define HOST_TEST_SHIM_ESP_WIFI_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Types only, for the prototypes of blufi.h.
+typedef struct {
+	int unused;
+} wifi_sta_list_t;
+
+typedef struct {
+	int unused;
+} wifi_config_t;
+
+#endif /* HOST_TEST_SHIM_ESP_WIFI_H_ */
@@ -0,0 +1,16 @@
+/*
+ * esp_wps.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_ESP_WPS_H_
+#define HOST_TEST_SHIM_ESP_WPS_H_
+
+#include "esp_wifi.h"
+
+typedef struct {
+	int unused;
+} esp_wps_config_t;
+
+#endif /* HOST_TEST_SHIM_ESP_WPS_H_ */
@@ -0,0 +1,71 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_FREERTOS_H_
+#define HOST_TEST_SHIM_FREERTOS_H_
+
+/// Host shim of the FreeRTOS kernel, the tasks run as coroutines on the virtual clock of sim_freertos.c.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct sim_task_s *TaskHandle_t;
+typedef struct sim_queue_s *QueueHandle_t;
+typedef struct sim_queue_s *SemaphoreHandle_t;
+typedef struct sim_timer_s *TimerHandle_t;
+
+#define configTICK_RATE_HZ				(100u)		// CONFIG_FREERTOS_HZ
+#define configMINIMAL_STACK_SIZE		(768u)
+
+#define portTICK_PERIOD_MS				(1000u / configTICK_RATE_HZ)
+#define portMAX_DELAY					((TickType_t) 0xffffffffu)
+
+#define pdMS_TO_TICKS(ms)				((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000u))
+#define pdTICKS_TO_MS(ticks)			((TickType_t) (((uint64_t) (ticks) * 1000u) / configTICK_RATE_HZ))
+
+#define pdFALSE							(0)
+#define pdTRUE							(1)
+#define pdFAIL							(pdFALSE)
+#define pdPASS							(pdTRUE)
+
+#define BIT(n)							(1ul << (n))
+
+// One task runs at a time and only yields when it blocks: the critical sections have nothing to exclude
+typedef struct {
+	int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED	{ 0 }
+#define taskENTER_CRITICAL(mux)			((void) (mux))
+#define taskEXIT_CRITICAL(mux)			((void) (mux))
+#define portENTER_CRITICAL(mux)			((void) (mux))
+#define portEXIT_CRITICAL(mux)			((void) (mux))
+
+#define IRAM_ATTR
+
+typedef int esp_err_t;
+
+#define ESP_OK							(0)
+#define ESP_FAIL						(-1)
+#define ESP_ERR_INVALID_ARG				(0x102)
+#define ESP_ERR_INVALID_SIZE			(0x104)
+#define ESP_ERR_TIMEOUT					(0x107)
+#define ESP_ERR_NVS_NOT_FOUND			(0x1102)
+#define ESP_ERR_NVS_INVALID_LENGTH		(0x110c)
+#define ESP_ERR_NVS_NO_FREE_PAGES		(0x110d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND	(0x1110)
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif /* HOST_TEST_SHIM_FREERTOS_H_ */
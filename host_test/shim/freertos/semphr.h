@@ -0,0 +1,20 @@
+/*
+ * semphr.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_SEMPHR_H_
+#define HOST_TEST_SHIM_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Semaphores are queues of empty items, as in the kernel.
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore);
+
+#endif /* HOST_TEST_SHIM_SEMPHR_H_ */
@@ -0,0 +1,45 @@
+/*
+ * nvs_flash.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SHIM_NVS_FLASH_H_
+#define HOST_TEST_SHIM_NVS_FLASH_H_
+
+#include "freertos/FreeRTOS.h"
+
+/// Erased flash: every read misses, writes succeed and are dropped, the device boots on the defaults.
+typedef uint32_t nvs_handle_t;
+
+#define NVS_READWRITE	(1)
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_open(const char *name, int open_mode, nvs_handle_t *handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value);
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *value);
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *value);
+esp_err_t nvs_get_i16(nvs_handle_t handle, const char *key, int16_t *value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *value);
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *value);
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *value);
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *value);
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *length);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length);
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value);
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value);
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value);
+esp_err_t nvs_set_i16(nvs_handle_t handle, const char *key, int16_t value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value);
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value);
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+
+#endif /* HOST_TEST_SHIM_NVS_FLASH_H_ */
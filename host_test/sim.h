@@ -0,0 +1,23 @@
+/*
+ * sim.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef HOST_TEST_SIM_H_
+#define HOST_TEST_SIM_H_
+
+#include <stdint.h>
+
+#define SIM_FOREVER		UINT64_MAX
+
+/// Applies the inputs due at tick, returns the tick of the next one or SIM_FOREVER.
+typedef uint64_t (*sim_feed_t)(uint64_t tick);
+
+/// Runs the created tasks and timers on the virtual clock until end_tick.
+void sim_run(uint64_t end_tick, sim_feed_t feed);
+
+uint64_t sim_get_tick(void);
+void sim_report(void);
+
+#endif /* HOST_TEST_SIM_H_ */
@@ -0,0 +1,491 @@
+/*
+ * sim_freertos.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+/// FreeRTOS on a virtual clock. The tasks are ucontext coroutines: one runs at a time, until it blocks,
+/// the highest priority ready task first, then the first created. The timer callbacks run between the
+/// tasks, as the timer service task would. When nothing is ready the clock jumps to the next timeout,
+/// timer expiry or scripted input, so hours of idle periods cost nothing and every run is identical.
+
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+#include "esp_timer.h"
+
+#include "sim.h"
+
+#define SIM_TASK_MAX			(8u)
+#define SIM_TIMER_MAX			(8u)
+#define SIM_TASK_STACK_SIZE		(256u * 1024u)		// Host stack, the firmware stack depth is ignored
+
+enum sim_task_state_e {
+	SIM_TASK_READY = 0,
+	SIM_TASK_BLOCKED,
+	SIM_TASK_DELETED,
+};
+
+struct sim_task_s {
+	ucontext_t			context;
+	TaskFunction_t		function;
+	void				*parameters;
+	const char			*name;
+	UBaseType_t			priority;
+	uint8_t				state;
+	const void			*wait_object;		///< Queue, semaphore or notification the task is blocked on
+	uint64_t			wake_tick;			///< Timeout, SIM_FOREVER without
+	bool				timed_out;
+	uint32_t			notification;
+	void				*stack;
+};
+
+/// Semaphores have no storage, count is the semaphore value.
+struct sim_queue_s {
+	uint8_t				*storage;
+	UBaseType_t			length;
+	UBaseType_t			item_size;
+	UBaseType_t			count;
+	UBaseType_t			head;				///< Oldest item
+};
+
+struct sim_timer_s {
+	const char				*name;
+	TickType_t				period;
+	bool					auto_reload;
+	void					*id;
+	TimerCallbackFunction_t	callback;
+	bool					active;
+	uint64_t				expiry_tick;
+};
+
+static struct {
+	uint64_t			tick;
+	ucontext_t			scheduler;
+	struct sim_task_s	task[SIM_TASK_MAX];
+	size_t				task_count;
+	struct sim_task_s	*current;			///< NULL in the scheduler and the timer callbacks
+	struct sim_timer_s	timer[SIM_TIMER_MAX];
+	size_t				timer_count;
+	uint64_t			switches;
+	uint64_t			expiries;
+} sim;
+
+static uint64_t sim_deadline(TickType_t ticks) {
+	return ticks == portMAX_DELAY ? SIM_FOREVER : sim.tick + ticks;
+}
+
+/// Suspends the calling task until sim_wake() on object, false when deadline came first.
+static bool sim_block_until(const void *object, uint64_t deadline) {
+	struct sim_task_s *task = sim.current;
+
+	if (deadline <= sim.tick) {
+		return false;
+	}
+
+	if (task == NULL) {
+		fprintf(stderr, "sim - blocking call outside a task\n");
+		abort();
+	}
+
+	task->state = SIM_TASK_BLOCKED;
+	task->wait_object = object;
+	task->wake_tick = deadline;
+	task->timed_out = false;
+
+	swapcontext(&task->context, &sim.scheduler);
+
+	return !task->timed_out;
+}
+
+/// Every task blocked on object checks its condition again.
+static void sim_wake(const void *object) {
+	for (size_t i = 0u; i < sim.task_count; i++) {
+		struct sim_task_s *task = &sim.task[i];
+
+		if ((task->state == SIM_TASK_BLOCKED) && (task->wait_object == object)) {
+			task->state = SIM_TASK_READY;
+			task->wait_object = NULL;
+		}
+	}
+}
+
+static void sim_task_entry(void) {
+	sim.current->function(sim.current->parameters);
+
+	// Returning from a task is a fault on target, here it only ends the coroutine
+	sim.current->state = SIM_TASK_DELETED;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *handle) {
+	struct sim_task_s *task;
+
+	(void) stack_depth;
+
+	if (sim.task_count >= SIM_TASK_MAX) {
+		return pdFAIL;
+	}
+
+	task = &sim.task[sim.task_count];
+	task->stack = malloc(SIM_TASK_STACK_SIZE);
+	if (task->stack == NULL) {
+		return pdFAIL;
+	}
+
+	task->function = function;
+	task->parameters = parameters;
+	task->name = name;
+	task->priority = priority;
+	task->state = SIM_TASK_READY;
+
+	getcontext(&task->context);
+	task->context.uc_stack.ss_sp = task->stack;
+	task->context.uc_stack.ss_size = SIM_TASK_STACK_SIZE;
+	task->context.uc_link = &sim.scheduler;
+	makecontext(&task->context, sim_task_entry, 0);
+
+	sim.task_count++;
+
+	if (handle != NULL) {
+		*handle = task;
+	}
+
+	return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+	uint64_t deadline = sim.tick + ticks;
+
+	while (sim_block_until(sim.current, deadline)) {
+	}
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t period) {
+	TickType_t wake = *previous_wake + period;
+	TickType_t ahead = wake - (TickType_t) sim.tick;
+
+	*previous_wake = wake;
+
+	// Already late: FreeRTOS returns at once
+	if ((ahead == 0u) || (ahead > (portMAX_DELAY >> 1))) {
+		return;
+	}
+
+	vTaskDelay(ahead);
+}
+
+TickType_t xTaskGetTickCount(void) {
+	return (TickType_t) sim.tick;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+	task->notification++;
+	sim_wake(&task->notification);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+	struct sim_task_s *task = sim.current;
+	uint64_t deadline = sim_deadline(ticks_to_wait);
+	uint32_t value;
+
+	while (task->notification == 0u) {
+		if (!sim_block_until(&task->notification, deadline)) {
+			break;
+		}
+	}
+
+	value = task->notification;
+	if (value != 0u) {
+		task->notification = clear_on_exit ? 0u : value - 1u;
+	}
+
+	return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+	struct sim_queue_s *queue = calloc(1u, sizeof(*queue));
+
+	if (queue == NULL) {
+		return NULL;
+	}
+
+	queue->storage = calloc(length, item_size);
+	if (queue->storage == NULL) {
+		free(queue);
+		return NULL;
+	}
+
+	queue->length = length;
+	queue->item_size = item_size;
+
+	return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+	uint64_t deadline = sim_deadline(ticks_to_wait);
+
+	while (queue->count >= queue->length) {
+		if (!sim_block_until(queue, deadline)) {
+			return pdFAIL;
+		}
+	}
+
+	memcpy(&queue->storage[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+	queue->count++;
+	sim_wake(queue);
+
+	return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+	uint64_t deadline = sim_deadline(ticks_to_wait);
+
+	while (queue->count == 0u) {
+		if (!sim_block_until(queue, deadline)) {
+			return pdFAIL;
+		}
+	}
+
+	memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+	queue->head = (queue->head + 1u) % queue->length;
+	queue->count--;
+	sim_wake(queue);
+
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+	return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+	struct sim_queue_s *semaphore = calloc(1u, sizeof(*semaphore));
+
+	if (semaphore == NULL) {
+		return NULL;
+	}
+
+	semaphore->length = max_count;
+	semaphore->count = initial_count;
+
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+	return xSemaphoreCreateCounting(1u, 0u);
+}
+
+/// No priority inheritance: a task never blocks while it holds a mutex here.
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+	return xSemaphoreCreateCounting(1u, 1u);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+	uint64_t deadline = sim_deadline(ticks_to_wait);
+
+	while (semaphore->count == 0u) {
+		if (!sim_block_until(semaphore, deadline)) {
+			return pdFAIL;
+		}
+	}
+
+	semaphore->count--;
+
+	return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	if (semaphore->count >= semaphore->length) {
+		return pdFAIL;
+	}
+
+	semaphore->count++;
+	sim_wake(semaphore);
+
+	return pdPASS;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+	return semaphore->count;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id, TimerCallbackFunction_t callback) {
+	struct sim_timer_s *timer;
+
+	if ((sim.timer_count >= SIM_TIMER_MAX) || (period == 0u)) {
+		return NULL;
+	}
+
+	timer = &sim.timer[sim.timer_count++];
+	timer->name = name;
+	timer->period = period;
+	timer->auto_reload = auto_reload != pdFALSE;
+	timer->id = id;
+	timer->callback = callback;
+
+	return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait) {
+	(void) ticks_to_wait;
+
+	timer->active = true;
+	timer->expiry_tick = sim.tick + timer->period;
+
+	return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
+	(void) ticks_to_wait;
+
+	timer->active = false;
+
+	return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait) {
+	return xTimerStart(timer, ticks_to_wait);
+}
+
+/// As in FreeRTOS, a dormant timer starts with the new period.
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait) {
+	if (period == 0u) {
+		return pdFAIL;
+	}
+
+	timer->period = period;
+
+	return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer) {
+	return timer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) {
+	return timer->id;
+}
+
+int64_t esp_timer_get_time(void) {
+	return (int64_t) sim.tick * (1000000 / configTICK_RATE_HZ);
+}
+
+/// Earliest due timer first, creation order between equal expiries.
+static void sim_timers_fire(void) {
+	for (;;) {
+		struct sim_timer_s *due = NULL;
+
+		for (size_t i = 0u; i < sim.timer_count; i++) {
+			struct sim_timer_s *timer = &sim.timer[i];
+
+			if (timer->active && (timer->expiry_tick <= sim.tick) && ((due == NULL) || (timer->expiry_tick < due->expiry_tick))) {
+				due = timer;
+			}
+		}
+
+		if (due == NULL) {
+			return;
+		}
+
+		if (due->auto_reload) {
+			due->expiry_tick += due->period;
+		} else {
+			due->active = false;
+		}
+
+		sim.expiries++;
+		due->callback(due);
+	}
+}
+
+static struct sim_task_s *sim_task_next(void) {
+	struct sim_task_s *next = NULL;
+
+	for (size_t i = 0u; i < sim.task_count; i++) {
+		struct sim_task_s *task = &sim.task[i];
+
+		if ((task->state == SIM_TASK_READY) && ((next == NULL) || (task->priority > next->priority))) {
+			next = task;
+		}
+	}
+
+	return next;
+}
+
+static void sim_tasks_run(void) {
+	struct sim_task_s *task;
+
+	while ((task = sim_task_next()) != NULL) {
+		sim.current = task;
+		sim.switches++;
+		swapcontext(&sim.scheduler, &task->context);
+		sim.current = NULL;
+	}
+}
+
+/// Next tick something is due, timeouts and timers only.
+static uint64_t sim_next_event(void) {
+	uint64_t next = SIM_FOREVER;
+
+	for (size_t i = 0u; i < sim.task_count; i++) {
+		if ((sim.task[i].state == SIM_TASK_BLOCKED) && (sim.task[i].wake_tick < next)) {
+			next = sim.task[i].wake_tick;
+		}
+	}
+
+	for (size_t i = 0u; i < sim.timer_count; i++) {
+		if (sim.timer[i].active && (sim.timer[i].expiry_tick < next)) {
+			next = sim.timer[i].expiry_tick;
+		}
+	}
+
+	return next;
+}
+
+void sim_run(uint64_t end_tick, sim_feed_t feed) {
+	for (;;) {
+		uint64_t next_input = feed(sim.tick);
+		uint64_t next;
+
+		sim_timers_fire();
+		sim_tasks_run();
+
+		next = sim_next_event();
+		if (next_input < next) {
+			next = next_input;
+		}
+
+		if (next > end_tick) {
+			sim.tick = end_tick;
+			return;
+		}
+
+		sim.tick = next;
+
+		for (size_t i = 0u; i < sim.task_count; i++) {
+			struct sim_task_s *task = &sim.task[i];
+
+			if ((task->state == SIM_TASK_BLOCKED) && (task->wake_tick <= sim.tick)) {
+				task->state = SIM_TASK_READY;
+				task->wait_object = NULL;
+				task->timed_out = true;
+			}
+		}
+	}
+}
+
+uint64_t sim_get_tick(void) {
+	return sim.tick;
+}
+
+void sim_report(void) {
+	fprintf(stderr, "sim - %llu ticks - %llu task switches - %llu timer expiries\n",
+			(unsigned long long) sim.tick, (unsigned long long) sim.switches, (unsigned long long) sim.expiries);
+}
@@ -0,0 +1,213 @@
+/*
+ * sim_main.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+/// Replays a scripted sensor and settings trace through storage, statistic and controller on the virtual
+/// clock. One input per line, "<seconds> <input> <value>" in storage units, '#' starts a comment, and the
+/// last line "<seconds> end" gives the trace length. The trace is replayed repeat times back to back.
+///
+/// usage: controller_sim <trace> [repeat]
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "storage.h"
+#include "controller.h"
+
+#include "sim.h"
+
+#define SIM_LINE_SIZE		(128u)
+
+#define SIM_INPUT(input, ctype) \
+	static int sim_set_##input(int32_t value) { \
+		return set_##input((ctype) value); \
+	}
+
+SIM_INPUT(temperature, int16_t)
+SIM_INPUT(relative_humidity, uint16_t)
+SIM_INPUT(voc, uint16_t)
+SIM_INPUT(lux, uint32_t)
+SIM_INPUT(luminosity_state, uint8_t)
+SIM_INPUT(internal_temperature, int16_t)
+SIM_INPUT(external_temperature, int16_t)
+SIM_INPUT(external_absolute_humidity, uint16_t)
+SIM_INPUT(mode_set, uint8_t)
+SIM_INPUT(speed_set, uint8_t)
+SIM_INPUT(relative_humidity_set, uint8_t)
+SIM_INPUT(voc_set, uint8_t)
+SIM_INPUT(lux_set, uint8_t)
+SIM_INPUT(relative_humidity_slope_threshold, uint16_t)
+
+struct sim_input_s {
+	const char	*name;
+	int			(*set)(int32_t value);
+};
+
+/// Sensor values as the sensor task stores them, settings through the schema setters.
+static const struct sim_input_s sim_input[] = {
+	{ "temperature",						sim_set_temperature },
+	{ "relative_humidity",					sim_set_relative_humidity },
+	{ "voc",								sim_set_voc },
+	{ "lux",								sim_set_lux },
+	{ "luminosity_state",					sim_set_luminosity_state },
+	{ "internal_temperature",				sim_set_internal_temperature },
+	{ "external_temperature",				sim_set_external_temperature },
+	{ "external_absolute_humidity",			sim_set_external_absolute_humidity },
+	{ "mode_set",							sim_set_mode_set },
+	{ "speed_set",							sim_set_speed_set },
+	{ "relative_humidity_set",				sim_set_relative_humidity_set },
+	{ "voc_set",							sim_set_voc_set },
+	{ "lux_set",							sim_set_lux_set },
+	{ "relative_humidity_slope_threshold",	sim_set_relative_humidity_slope_threshold },
+};
+
+struct sim_event_s {
+	uint32_t					second;
+	const struct sim_input_s	*input;
+	int32_t						value;
+};
+
+static struct {
+	struct sim_event_s	*event;
+	size_t				count;
+	uint32_t			length;			///< Seconds, from the end line
+	uint32_t			repeat;
+	uint32_t			pass;			///< Current replay
+	size_t				next;			///< Next event of the current replay
+} sim_trace;
+
+static const struct sim_input_s *sim_input_find(const char *name) {
+	for (size_t i = 0u; i < sizeof(sim_input) / sizeof(sim_input[0]); i++) {
+		if (!strcmp(sim_input[i].name, name)) {
+			return &sim_input[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int sim_trace_load(const char *path) {
+	char line[SIM_LINE_SIZE];
+	char name[48];
+	unsigned long second;
+	long value;
+	unsigned line_number = 0u;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		fprintf(stderr, "sim - can not open %s\n", path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *comment = strchr(line, '#');
+		int fields;
+
+		line_number++;
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+
+		fields = sscanf(line, "%lu %47s %ld", &second, name, &value);
+		if (fields <= 0) {
+			continue;
+		}
+
+		if (sim_trace.length || ((sim_trace.count != 0u) && (second < sim_trace.event[sim_trace.count - 1u].second))) {
+			fprintf(stderr, "sim - %s:%u: inputs must be in time order, before the end line\n", path, line_number);
+			break;
+		}
+
+		if ((fields == 2) && !strcmp(name, "end")) {
+			sim_trace.length = (uint32_t) second;
+			continue;
+		}
+
+		if (fields != 3) {
+			fprintf(stderr, "sim - %s:%u: expected <seconds> <input> <value>\n", path, line_number);
+			break;
+		}
+
+		struct sim_event_s *event = realloc(sim_trace.event, (sim_trace.count + 1u) * sizeof(*event));
+
+		if (event == NULL) {
+			break;
+		}
+		sim_trace.event = event;
+
+		event = &sim_trace.event[sim_trace.count];
+		event->second = (uint32_t) second;
+		event->value = (int32_t) value;
+		event->input = sim_input_find(name);
+		if (event->input == NULL) {
+			fprintf(stderr, "sim - %s:%u: unknown input %s\n", path, line_number, name);
+			break;
+		}
+		sim_trace.count++;
+	}
+
+	fclose(file);
+
+	if (!sim_trace.length || (sim_trace.event[sim_trace.count - 1u].second >= sim_trace.length)) {
+		fprintf(stderr, "sim - %s: missing or early end line\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static uint64_t sim_feed(uint64_t tick) {
+	while (sim_trace.pass < sim_trace.repeat) {
+		const struct sim_event_s *event;
+		uint64_t due;
+
+		if (sim_trace.next == sim_trace.count) {
+			sim_trace.next = 0u;
+			sim_trace.pass++;
+			continue;
+		}
+
+		event = &sim_trace.event[sim_trace.next];
+		due = ((uint64_t) sim_trace.pass * sim_trace.length + event->second) * configTICK_RATE_HZ;
+		if (due > tick) {
+			return due;
+		}
+
+		if (event->input->set(event->value)) {
+			fprintf(stderr, "sim - %s %ld refused at %lu s\n", event->input->name, (long) event->value, (unsigned long) (tick / configTICK_RATE_HZ));
+		}
+		sim_trace.next++;
+	}
+
+	return SIM_FOREVER;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <trace> [repeat]\n", argv[0]);
+		return 2;
+	}
+
+	sim_trace.repeat = (argc > 2) ? (uint32_t) strtoul(argv[2], NULL, 10) : 1u;
+	if ((sim_trace.repeat == 0u) || sim_trace_load(argv[1])) {
+		return 2;
+	}
+
+	// A year of transitions, do not flush every line
+	setvbuf(stdout, NULL, _IOFBF, 1u << 16);
+
+	storage_init();
+	controller_init();
+
+	sim_run((uint64_t) sim_trace.length * sim_trace.repeat * configTICK_RATE_HZ, sim_feed);
+
+	fflush(stdout);
+	sim_report();
+
+	return 0;
+}
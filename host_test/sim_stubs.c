@@ -0,0 +1,149 @@
+/*
+ * sim_stubs.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+/// Hardware and radio modules the controller calls, reduced to what the simulation needs.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_cpu.h"
+#include "esp_efuse.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "nvs_flash.h"
+
+#include "blufi.h"
+#include "fan.h"
+#include "rgb_led.h"
+#include "test.h"
+#include "user_experience.h"
+
+const char *esp_err_to_name(esp_err_t code) {
+	switch (code) {
+	case ESP_OK:
+		return "ESP_OK";
+	case ESP_ERR_NVS_NOT_FOUND:
+		return "ESP_ERR_NVS_NOT_FOUND";
+	default:
+		return "ESP_FAIL";
+	}
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+	return 0u;
+}
+
+esp_err_t esp_efuse_read_block(esp_efuse_block_t block, void *dst, size_t offset_in_bits, size_t size_bits) {
+	(void) block;
+	(void) offset_in_bits;
+
+	memset(dst, 0, size_bits / 8u);
+
+	return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (uint8_t bit = 0u; bit < 8u; bit++) {
+			crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+		}
+	}
+
+	return ~crc;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+	(void) handler;
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+	return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, int open_mode, nvs_handle_t *handle) {
+	(void) name;
+	(void) open_mode;
+
+	*handle = 1u;
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+	return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+	return ESP_ERR_NVS_NOT_FOUND;
+}
+
+#define SIM_NVS_SCALAR(suffix, ctype) \
+	esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key, ctype *value) { \
+		return ESP_ERR_NVS_NOT_FOUND; \
+	} \
+	\
+	esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key, ctype value) { \
+		return ESP_OK; \
+	}
+
+SIM_NVS_SCALAR(u8, uint8_t)
+SIM_NVS_SCALAR(i8, int8_t)
+SIM_NVS_SCALAR(u16, uint16_t)
+SIM_NVS_SCALAR(i16, int16_t)
+SIM_NVS_SCALAR(u32, uint32_t)
+SIM_NVS_SCALAR(i32, int32_t)
+SIM_NVS_SCALAR(u64, uint64_t)
+SIM_NVS_SCALAR(i64, int64_t)
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *length) {
+	return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length) {
+	return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+	return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+	return ESP_OK;
+}
+
+/// The TRC line already carries the direction and the speed the controller asked for.
+int fan_set(uint8_t direction, uint8_t speed) {
+	return 0;
+}
+
+int fan_set_percentage(uint8_t direction, uint8_t speed_percent) {
+	return 0;
+}
+
+int rgb_led_mode(uint8_t color, uint32_t mode, bool end) {
+	return 0;
+}
+
+int test_in_progress() {
+	return false;
+}
+
+bool user_experience_in_operative() {
+	return true;
+}
+
+int blufi_wifi_send_voluntary(uint8_t funct, uint16_t obj_id, uint16_t index) {
+	return 0;
+}
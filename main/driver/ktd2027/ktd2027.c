@@ -12,22 +12,15 @@
 
 #include "math.h"
 
+#include "i2c_bus.h"
+
 struct ktd2027_config ktd2027_config;
 
 static int write_register(uint8_t reg, uint8_t val) {
     uint8_t data[2] = {reg, val};
 
-    if (xSemaphoreTake(ktd2027_config.i2c_dev->lock, ktd2027_config.i2c_dev->i2c_timeout) != pdTRUE) {
-        return -1;
-    }
-
-    if (i2c_master_write_to_device(ktd2027_config.i2c_dev->i2c_num, ktd2027_config.i2c_dev_address, data, sizeof(data), ktd2027_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ktd2027_config.i2c_dev->lock);
-        return -1;
-    }
-
-    xSemaphoreGive(ktd2027_config.i2c_dev->lock);
-    return 0;
+    // Queued, the LED never waits for a sensor transaction
+    return i2c_bus_write(I2C_BUS_DEVICE_KTD2027, ktd2027_config.i2c_dev_address, data, sizeof(data));
 }
 
 #define MOD_WRITE
@@ -56,27 +49,19 @@ static int write_all_register(uint8_t Period, uint8_t Tslot, uint8_t PWM1, uint8
 			PWM1, PWM2
     };
 
-    if (xSemaphoreTake(ktd2027_config.i2c_dev->lock, ktd2027_config.i2c_dev->i2c_timeout) != pdTRUE) {
-        return -1;
-    }
-
-    if (i2c_master_write_to_device(ktd2027_config.i2c_dev->i2c_num, ktd2027_config.i2c_dev_address, data, sizeof(data), ktd2027_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ktd2027_config.i2c_dev->lock);
+    // Queued in order, a full queue drops the update
+    if (i2c_bus_write(I2C_BUS_DEVICE_KTD2027, ktd2027_config.i2c_dev_address, data, sizeof(data))) {
         return -1;
     }
 
-    if (i2c_master_write_to_device(ktd2027_config.i2c_dev->i2c_num, ktd2027_config.i2c_dev_address, data_enable, sizeof(data_enable), ktd2027_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ktd2027_config.i2c_dev->lock);
+    if (i2c_bus_write(I2C_BUS_DEVICE_KTD2027, ktd2027_config.i2c_dev_address, data_enable, sizeof(data_enable))) {
         return -1;
     }
 
-    if (i2c_master_write_to_device(ktd2027_config.i2c_dev->i2c_num, ktd2027_config.i2c_dev_address, data_pwm, sizeof(data_pwm), ktd2027_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ktd2027_config.i2c_dev->lock);
+    if (i2c_bus_write(I2C_BUS_DEVICE_KTD2027, ktd2027_config.i2c_dev_address, data_pwm, sizeof(data_pwm))) {
         return -1;
     }
 
-    xSemaphoreGive(ktd2027_config.i2c_dev->lock);
-
     return 0;
 }
 
@@ -9,86 +9,77 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
-#include "driver/i2c.h"
+#include "i2c_bus.h"
+
+#include <string.h>
 
 struct ltr303_config ltr303_config;
+struct ltr303_data ltr303_data;
+
+/// Auto-ranging steps, by increasing sensitivity (gain * integration time).
+static const struct ltr303_range_s ltr303_range[LTR303_RANGE_COUNT] = {
+	{ LTR303_GAIN_1X,	LTR303_INTEGRATION_TIME_50MS },
+	{ LTR303_GAIN_1X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_2X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_4X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_8X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_48X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_96X,	LTR303_INTEGRATION_TIME_100MS },
+	{ LTR303_GAIN_96X,	LTR303_INTEGRATION_TIME_400MS },
+};
 
-static const float ltr303_gain[] = {
-	1.0f,
-	2.0f,
-	4.0f,
-	8.0f,
-	0.0f,
-	0.0f,
-	48.0f,
-	96.0f,
+static const uint8_t ltr303_gain[] = {
+	1u,
+	2u,
+	4u,
+	8u,
+	0u,
+	0u,
+	48u,
+	96u,
 };
-static float ltr303_integration_time[] = {
-	1.0f,
-	0.5f,
-	2.0f,
-	4.0f,
-	1.5f,
-	2.5f,
-	3.0f,
-	3.5f,
+
+/// Integration time (ms) indexed by the ALS_INT register field.
+static const uint16_t ltr303_integration_time_ms[] = {
+	100u,
+	50u,
+	200u,
+	400u,
+	150u,
+	250u,
+	300u,
+	350u,
 };
 
 static int write_register(uint8_t reg, uint8_t val) {
     uint8_t data[2] = {reg, val};
 
-    if (xSemaphoreTake(ltr303_config.i2c_dev->lock, ltr303_config.i2c_dev->i2c_timeout) != pdTRUE) {
-        return -1;
-    }
-
-    if (i2c_master_write_to_device(ltr303_config.i2c_dev->i2c_num, ltr303_config.i2c_dev_address, data, sizeof(data), ltr303_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ltr303_config.i2c_dev->lock);
-        return -1;
-    }
-
-    xSemaphoreGive(ltr303_config.i2c_dev->lock);
-    return 0;
+    return i2c_bus_transfer(I2C_BUS_DEVICE_LTR303, ltr303_config.i2c_dev_address, data, sizeof(data), NULL, 0);
 }
 
 static int read_register(uint8_t reg, uint8_t *val) {
-    if (xSemaphoreTake(ltr303_config.i2c_dev->lock, ltr303_config.i2c_dev->i2c_timeout) != pdTRUE) {
-        return -1;
-    }
-
-    if (i2c_master_write_to_device(ltr303_config.i2c_dev->i2c_num, ltr303_config.i2c_dev_address, &reg, sizeof(reg), ltr303_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ltr303_config.i2c_dev->lock);
-        return -1;
-    }
-
-    if (i2c_master_read_from_device(ltr303_config.i2c_dev->i2c_num, ltr303_config.i2c_dev_address, val, sizeof(uint8_t), ltr303_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ltr303_config.i2c_dev->lock);
-        return -1;
-    }
+    // Repeated start instead of a separate write and read
+    return i2c_bus_transfer(I2C_BUS_DEVICE_LTR303, ltr303_config.i2c_dev_address, &reg, sizeof(reg), val, sizeof(uint8_t));
+}
 
-    xSemaphoreGive(ltr303_config.i2c_dev->lock);
-    return 0;
+static int read_registers(uint8_t reg, uint8_t *val, size_t size) {
+    // Repeated start, the register address auto-increments
+    return i2c_bus_transfer(I2C_BUS_DEVICE_LTR303, ltr303_config.i2c_dev_address, &reg, sizeof(reg), val, size);
 }
 
-static int read_register_16(uint8_t reg, uint16_t *val) {
-    uint8_t rx_data[2];
+static int ltr303_set_range(uint8_t range);
 
-    if (xSemaphoreTake(ltr303_config.i2c_dev->lock, ltr303_config.i2c_dev->i2c_timeout) != pdTRUE) {
-        return -1;
-    }
+static int write_registers(uint8_t reg, const uint8_t *val, size_t size) {
+    uint8_t data[5];
 
-    if (i2c_master_write_to_device(ltr303_config.i2c_dev->i2c_num, ltr303_config.i2c_dev_address, &reg, sizeof(reg), ltr303_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ltr303_config.i2c_dev->lock);
+    if (size > sizeof(data) - 1u) {
         return -1;
     }
 
-    if (i2c_master_read_from_device(ltr303_config.i2c_dev->i2c_num, ltr303_config.i2c_dev_address, rx_data, sizeof(rx_data), ltr303_config.i2c_dev->i2c_timeout)) {
-        xSemaphoreGive(ltr303_config.i2c_dev->lock);
-        return -1;
-    }
+    data[0] = reg;
+    memcpy(&data[1], val, size);
 
-    xSemaphoreGive(ltr303_config.i2c_dev->lock);
-    *val = (rx_data[1] << 8) | rx_data[0];
-    return 0;
+    return i2c_bus_transfer(I2C_BUS_DEVICE_LTR303, ltr303_config.i2c_dev_address, data, size + 1u, NULL, 0);
 }
 
 int ltr303_init(struct i2c_dev_s *i2c_dev) {
@@ -96,17 +87,28 @@ int ltr303_init(struct i2c_dev_s *i2c_dev) {
 	ltr303_config.i2c_dev_address = LTR303_I2C_ADDR;
     int err = 0;
 
-    // Set control register: Gain and Active Mode
-    err = write_register(LTR303_CONTR, (LTR303_GAIN << 2) | LTR303_ACTIVE);
+    ltr303_data.window_lower = LTR303_WINDOW_NONE_LOW;
+    ltr303_data.window_upper = LTR303_WINDOW_NONE_HIGH;
+    ltr303_data.num_ref = 0u;
+    ltr303_data.ch0_ref = 0u;
+
+    // Control register (gain, active mode) and measurement rate register (integration time, rate)
+    err = ltr303_set_range(LTR303_RANGE_DEFAULT);
     if (err != 0) {
-        printf("Failed to set control register.\n");
+        printf("Failed to set control and measurement rate registers.\n");
         return -1;
     }
 
-    // Set measurement rate register: Integration time and Measurement Rate
-    err = write_register(LTR303_MEAS_RATE, (LTR303_INTEGRATION_TIME << 3) | LTR303_MEASUREMENT_RATE);
+    // Threshold interrupt, window opened until the first ltr303_set_window()
+    err = ltr303_set_window(LTR303_WINDOW_NONE_LOW, LTR303_WINDOW_NONE_HIGH);
+    if (err == 0) {
+        err = write_register(LTR303_INTR_PERS, LTR303_PERSIST);
+    }
+    if (err == 0) {
+        err = write_register(LTR303_INTERRUPT, LTR303_INTERRUPT_MODE_ALS);
+    }
     if (err != 0) {
-        printf("Failed to set measurement rate register.\n");
+        printf("Failed to set interrupt registers.\n");
         return -1;
     }
 
@@ -127,50 +129,195 @@ int ltr303_init(struct i2c_dev_s *i2c_dev) {
     }
 }
 
-int ltr303_measure_lux(float *lux) {
-	if (lux == NULL) {
-		printf("Invalid lux pointer.\n");
-		return -1;
+/// Datasheet lux equation numerator, LTR303_COEFF_SCALE coefficients, 0 above the last ratio range.
+static uint32_t ltr303_lux_numerator(uint16_t ch0, uint16_t ch1) {
+	uint32_t sum = (uint32_t) ch0 + ch1;
+
+	if (sum == 0u) {
+		return 0u;
 	}
 
-	*lux = TEMP_F_INVALID;
+	// ratio = ch1 / (ch0 + ch1), compared without division
+	if ((uint32_t) ch1 * 100u < 45u * sum) {
+		return 17743u * ch0 + 11059u * ch1;
+	} else if ((uint32_t) ch1 * 100u < 64u * sum) {
+		return 42785u * ch0 - 19548u * ch1;		// Positive: ch1 < 1.78 * ch0 in this range
+	} else if ((uint32_t) ch1 * 100u < 85u * sum) {
+		return 5926u * ch0 + 1185u * ch1;
+	}
 
-	uint16_t CH0_data_raw = 0;
-	uint16_t CH1_data_raw = 0;
+	return 0u;
+}
 
-	int err = read_register_16(LTR303_DATA_CH0_0, &CH0_data_raw);
-	if (err != 0) {
-		printf("Failed to read CH0 data.\n");
+/// Lux equation denominator: COEFF_SCALE * gain * (integration_time / 100 ms).
+static uint32_t ltr303_lux_denominator(uint8_t range) {
+	return (LTR303_COEFF_SCALE / 100u) * ltr303_gain[ltr303_range[range].gain] * ltr303_integration_time_ms[ltr303_range[range].integration_time];
+}
+
+/// CH0 counts reading lux (LUX_SCALE) with the CH1/CH0 ratio of the last reading, no CH1 before the first one.
+static uint16_t ltr303_lux_to_counts(uint32_t lux, uint8_t range) {
+	uint64_t counts;
+	uint32_t num_ref = 17743u;
+	uint32_t ch0_ref = 1u;
+
+	if (lux == LTR303_WINDOW_NONE_HIGH) {
+		return UINT16_MAX;
+	}
+
+	if (ltr303_data.num_ref && ltr303_data.ch0_ref) {
+		num_ref = ltr303_data.num_ref;
+		ch0_ref = ltr303_data.ch0_ref;
+	}
+
+	counts = ((uint64_t) lux * ltr303_lux_denominator(range) * ch0_ref) / ((uint64_t) num_ref * LUX_SCALE);
+
+	return counts > UINT16_MAX ? UINT16_MAX : (uint16_t) counts;
+}
+
+static int ltr303_write_window(void) {
+	uint16_t lower = ltr303_lux_to_counts(ltr303_data.window_lower, ltr303_data.range);
+	uint16_t upper = ltr303_lux_to_counts(ltr303_data.window_upper, ltr303_data.range);
+	// THRES_UP_0, THRES_UP_1, THRES_LOW_0, THRES_LOW_1 are contiguous
+	uint8_t data[4] = { upper & 0xff, upper >> 8, lower & 0xff, lower >> 8 };
+
+	return write_registers(LTR303_THRES_UP_0, data, sizeof(data));
+}
+
+static int ltr303_set_range(uint8_t range) {
+	// CONTR and MEAS_RATE are not contiguous
+	if (write_register(LTR303_CONTR, (ltr303_range[range].gain << 2) | LTR303_ACTIVE)) {
 		return -1;
 	}
 
-	err = read_register_16(LTR303_DATA_CH0_1, &CH1_data_raw);
-	if (err != 0) {
-		printf("Failed to read CH1 data.\n");
+	if (write_register(LTR303_MEAS_RATE, (ltr303_range[range].integration_time << 3) | LTR303_MEASUREMENT_RATE)) {
 		return -1;
 	}
 
-	float ratio = (float) CH1_data_raw
-			/ ((float) CH0_data_raw + (float) CH1_data_raw);
+	ltr303_data.range = range;
+	ltr303_data.range_tick = xTaskGetTickCount();
+
+	// The window is held in lux, its counts follow the range
+	return ltr303_write_window();
+}
+
+/// Most sensitive range keeping the counts under LTR303_COUNTS_TARGET.
+static uint8_t ltr303_best_range(uint32_t counts) {
+	uint32_t sensitivity = ltr303_lux_denominator(ltr303_data.range);
+	uint8_t range = LTR303_RANGE_COUNT - 1u;
+
+	while ((range > 0u) && ((uint64_t) counts * ltr303_lux_denominator(range) > (uint64_t) LTR303_COUNTS_TARGET * sensitivity)) {
+		range--;
+	}
+
+	return range;
+}
+
+/// Datasheet lux equation in integer math, LUX_SCALE units, truncated.
+uint32_t ltr303_convert_lux(uint16_t ch0, uint16_t ch1, uint8_t range) {
+	uint32_t num = ltr303_lux_numerator(ch0, ch1);
+	uint32_t den = ltr303_lux_denominator(range);
+
+	return (num / den) * LUX_SCALE + ((num % den) * LUX_SCALE) / den;
+}
+
+/// Float reference of ltr303_convert_lux(), only used by the benchmark.
+uint32_t ltr303_convert_lux_reference(uint16_t ch0, uint16_t ch1, uint8_t range) {
+	float gain = (float) ltr303_gain[ltr303_range[range].gain];
+	float integration_time = (float) ltr303_integration_time_ms[ltr303_range[range].integration_time] / 100.f;
+	float ratio;
+	float lux;
+
+	if ((ch0 + ch1) == 0) {
+		return 0u;
+	}
+
+	ratio = (float) ch1 / ((float) ch0 + (float) ch1);
 
 	if (ratio < 0.45f) {
-		*lux = (1.7743f * (float) CH0_data_raw + 1.1059f * (float) CH1_data_raw)
-				/ ltr303_gain[LTR303_GAIN]
-				/ ltr303_integration_time[LTR303_INTEGRATION_TIME];
+		lux = (1.7743f * (float) ch0 + 1.1059f * (float) ch1) / gain / integration_time;
 	} else if (ratio < 0.64f) {
-		*lux = (4.2785f * (float) CH0_data_raw - 1.9548f * (float) CH1_data_raw)
-				/ ltr303_gain[LTR303_GAIN]
-				/ ltr303_integration_time[LTR303_INTEGRATION_TIME];
+		lux = (4.2785f * (float) ch0 - 1.9548f * (float) ch1) / gain / integration_time;
 	} else if (ratio < 0.85f) {
-		*lux = (0.5926f * (float) CH0_data_raw + 0.1185f * (float) CH1_data_raw)
-				/ ltr303_gain[LTR303_GAIN]
-				/ ltr303_integration_time[LTR303_INTEGRATION_TIME];
+		lux = (0.5926f * (float) ch0 + 0.1185f * (float) ch1) / gain / integration_time;
 	} else {
-		*lux = 0.f;
+		lux = 0.f;
+	}
+
+	return (uint32_t) (lux * LUX_SCALE);
+}
+
+/// Returns 1 without a value while the range settles, the range follows every reading.
+int ltr303_measure_lux(uint32_t *lux) {
+	if (lux == NULL) {
+		printf("Invalid lux pointer.\n");
+		return -1;
 	}
 
-//	printf("CH0_data_raw: %u - CH1_data_raw: %u - lux: %.3f\n", CH0_data_raw, CH1_data_raw, *lux);
-	*lux = CH0_data_raw;
+	*lux = LTR303_LUX_INVALID;
+
+	uint8_t data[5];
+
+	// CH1, CH0 and status in one transfer: reading CH1 first latches the CH0 pair of the same conversion
+	int err = read_registers(LTR303_DATA_CH1_0, data, sizeof(data));
+	if (err != 0) {
+		printf("Failed to read ALS data.\n");
+		return -1;
+	}
+
+	uint16_t CH1_data_raw = ((uint16_t) data[1] << 8) | data[0];
+	uint16_t CH0_data_raw = ((uint16_t) data[3] << 8) | data[2];
+	uint8_t status = data[4];
+	uint8_t range = ltr303_data.range;
+	uint32_t counts = CH0_data_raw > CH1_data_raw ? CH0_data_raw : CH1_data_raw;
+
+	if (((xTaskGetTickCount() - ltr303_data.range_tick) < pdMS_TO_TICKS(LTR303_SETTLE_MS)) ||
+		(((status >> LTR303_STATUS_GAIN_SHIFT) & LTR303_STATUS_GAIN_MASK) != ltr303_range[range].gain)) {
+		return 1;
+	}
+
+	if (status & LTR303_STATUS_DATA_INVALID) {
+		counts = UINT16_MAX;
+	}
+
+	if ((counts > LTR303_COUNTS_HIGH) || (counts < LTR303_COUNTS_LOW)) {
+		uint8_t best = ltr303_best_range(counts);
+
+		if ((best != range) && ltr303_set_range(best)) {
+			printf("Failed to set ALS range.\n");
+		}
+	}
+
+	// Saturated, the value comes from the next range
+	if ((status & LTR303_STATUS_DATA_INVALID) || (CH0_data_raw == UINT16_MAX) || (CH1_data_raw == UINT16_MAX)) {
+		return 1;
+	}
+
+	uint32_t num = ltr303_lux_numerator(CH0_data_raw, CH1_data_raw);
+
+	if (num && (CH0_data_raw >= LTR303_COUNTS_LOW)) {
+		ltr303_data.num_ref = num;
+		ltr303_data.ch0_ref = CH0_data_raw;
+	}
+
+//	printf("CH0_data_raw: %u - CH1_data_raw: %u - range: %u\n", CH0_data_raw, CH1_data_raw, range);
+	*lux = ltr303_convert_lux(CH0_data_raw, CH1_data_raw, range);
 
 	return 0;
 }
+
+/// One transfer, LTR303_STATUS_INT reports a threshold crossing.
+int ltr303_read_status(uint8_t *status) {
+	return read_registers(LTR303_STATUS, status, sizeof(uint8_t));
+}
+
+/// Window in lux (LUX_SCALE), converted to CH0 counts: LTR303_PERSIST + 1 conversions in a row outside raise the interrupt.
+int ltr303_set_window(uint32_t lower, uint32_t upper) {
+	ltr303_data.window_lower = lower;
+	ltr303_data.window_upper = upper;
+
+	return ltr303_write_window();
+}
+
+uint8_t ltr303_get_range(void) {
+	return ltr303_data.range;
+}
@@ -9,6 +9,7 @@
 #define __LTR303_H__
 
 #include "system.h"
+#include "types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,30 +37,21 @@ extern "C" {
 #define LTR303_ACTIVE					0x01
 #define LTR303_RESET					0x02
 
+#define LTR303_STATUS_DATA_INVALID		0x80
+#define LTR303_STATUS_INT				0x08		// Threshold crossed, cleared once read
+#define LTR303_STATUS_NEW_DATA			0x04
+#define LTR303_STATUS_GAIN_SHIFT		4u
+#define LTR303_STATUS_GAIN_MASK			0x07
 
-#define CONFIG_LTR303_GAIN_96X
-#define CONFIG_LTR303_MEASUREMENT_RATE_500MS
-#define CONFIG_LTR303_INTEGRATION_TIME_250MS
-
-#if defined CONFIG_LTR303_GAIN_1X
-	#define LTR303_LUX_RANGE			f64000
-	#define LTR303_GAIN					0x00
-#elif defined CONFIG_LTR303_GAIN_2X
-	#define LTR303_LUX_RANGE			32000
-	#define LTR303_GAIN					0x01
-#elif defined CONFIG_LTR303_GAIN_4X
-	#define LTR303_LUX_RANGE			16000
-	#define LTR303_GAIN					0x02
-#elif defined CONFIG_LTR303_GAIN_8X
-	#define LTR303_LUX_RANGE			8000
-	#define LTR303_GAIN					0x03
-#elif defined CONFIG_LTR303_GAIN_48X
-	#define LTR303_LUX_RANGE			1300
-	#define LTR303_GAIN					0x06
-#elif defined CONFIG_LTR303_GAIN_96X
-	#define LTR303_LUX_RANGE			600
-	#define LTR303_GAIN					0x07
-#endif
+#define LTR303_INTERRUPT_MODE_ALS		0x02		// INT pin active low
+
+#define LTR303_PERSIST					7u			// Interrupt after LTR303_PERSIST + 1 conversions out of the window
+
+
+#define LTR303_COEFF_SCALE				10000u		// Lux equation coefficients
+
+
+#define CONFIG_LTR303_MEASUREMENT_RATE_500MS		// Not shorter than the longest integration time
 
 #if defined CONFIG_LTR303_MEASUREMENT_RATE_50MS
 	#define LTR303_MEASUREMENT_RATE		0x00
@@ -69,37 +61,65 @@ extern "C" {
 	#define LTR303_MEASUREMENT_RATE		0x02
 #elif defined CONFIG_LTR303_MEASUREMENT_RATE_500MS
 	#define LTR303_MEASUREMENT_RATE		0x03
+	#define LTR303_MEASUREMENT_RATE_MS	500u
 #elif defined CONFIG_LTR303_MEASUREMENT_RATE_1000MS
 	#define LTR303_MEASUREMENT_RATE		0x04
 #elif defined CONFIG_LTR303_MEASUREMENT_RATE_2000MS
 	#define LTR303_MEASUREMENT_RATE		0x05
 #endif
 
-#if defined CONFIG_LTR303_INTEGRATION_TIME_50MS
-	#define LTR303_INTEGRATION_TIME		0x01
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_100MS
-	#define LTR303_INTEGRATION_TIME		0x00
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_150MS
-	#define LTR303_INTEGRATION_TIME		0x04
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_200MS
-	#define LTR303_INTEGRATION_TIME		0x02
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_250MS
-	#define LTR303_INTEGRATION_TIME		0x05
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_300MS
-	#define LTR303_INTEGRATION_TIME		0x06
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_350MS
-	#define LTR303_INTEGRATION_TIME		0x07
-#elif defined CONFIG_LTR303_INTEGRATION_TIME_400MS
-	#define LTR303_INTEGRATION_TIME		0x03
-#endif
+// ALS_GAIN field
+#define LTR303_GAIN_1X					0x00
+#define LTR303_GAIN_2X					0x01
+#define LTR303_GAIN_4X					0x02
+#define LTR303_GAIN_8X					0x03
+#define LTR303_GAIN_48X					0x06
+#define LTR303_GAIN_96X					0x07
+
+// ALS_INT field
+#define LTR303_INTEGRATION_TIME_50MS	0x01
+#define LTR303_INTEGRATION_TIME_100MS	0x00
+#define LTR303_INTEGRATION_TIME_400MS	0x03
+
+// Auto-ranging on the largest channel
+#define LTR303_RANGE_COUNT				8u
+#define LTR303_RANGE_DEFAULT			4u			// 8X, 100 ms
+#define LTR303_COUNTS_HIGH				30000u		// Less sensitive range above
+#define LTR303_COUNTS_LOW				2000u		// More sensitive range below
+#define LTR303_COUNTS_TARGET			20000u		// Expected counts after a range change
+#define LTR303_SETTLE_MS				(2u * LTR303_MEASUREMENT_RATE_MS)	// Data of the previous range until then
+
+#define LTR303_LUX_INVALID				UINT32_MAX
+
+#define LTR303_WINDOW_NONE_LOW			0u
+#define LTR303_WINDOW_NONE_HIGH			UINT32_MAX
 
 struct ltr303_config {
 	struct i2c_dev_s *i2c_dev;
 	uint8_t	i2c_dev_address;
 };
 
+struct ltr303_range_s {
+	uint8_t gain;					// ALS_GAIN field
+	uint8_t integration_time;		// ALS_INT field
+};
+
+struct ltr303_data {
+	uint8_t range;
+	TickType_t range_tick;			// Last range change
+	uint32_t window_lower;			// LUX_SCALE
+	uint32_t window_upper;
+	uint32_t num_ref;				// Lux equation numerator and CH0 of the last reading, for the window counts
+	uint16_t ch0_ref;
+};
+
 int ltr303_init(struct i2c_dev_s *i2c_dev);
-int ltr303_measure_lux(float *lux);
+uint32_t ltr303_convert_lux(uint16_t ch0, uint16_t ch1, uint8_t range);
+uint32_t ltr303_convert_lux_reference(uint16_t ch0, uint16_t ch1, uint8_t range);
+int ltr303_measure_lux(uint32_t *lux);
+int ltr303_read_status(uint8_t *status);
+int ltr303_set_window(uint32_t lower, uint32_t upper);
+uint8_t ltr303_get_range(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2022, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sensirion_gas_index_algorithm_fix16.h"
+
+#define FIX16_LN2 F16(0.69314718)
+
+static fix16_t fix16_mul(fix16_t a, fix16_t b);
+static fix16_t fix16_div(fix16_t a, fix16_t b);
+static fix16_t fix16_ratio(int64_t numerator, int64_t denominator);
+static fix16_t fix16_sqrt(fix16_t x);
+static fix16_t fix16_exp(fix16_t x);
+
+static void
+GasIndexAlgorithmFix16__init_instances(GasIndexAlgorithmFix16Params* params);
+static void GasIndexAlgorithmFix16__mean_variance_estimator__set_parameters(
+    GasIndexAlgorithmFix16Params* params);
+static void GasIndexAlgorithmFix16__mean_variance_estimator__set_states(
+    GasIndexAlgorithmFix16Params* params, fix16_t mean, fix16_t std,
+    fix16_t uptime_gamma);
+static fix16_t GasIndexAlgorithmFix16__mean_variance_estimator__get_std(
+    const GasIndexAlgorithmFix16Params* params);
+static fix16_t GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(
+    const GasIndexAlgorithmFix16Params* params);
+static bool GasIndexAlgorithmFix16__mean_variance_estimator__is_initialized(
+    GasIndexAlgorithmFix16Params* params);
+static void GasIndexAlgorithmFix16__mean_variance_estimator___calculate_gamma(
+    GasIndexAlgorithmFix16Params* params);
+static void GasIndexAlgorithmFix16__mean_variance_estimator__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sraw);
+static void
+GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t X0, fix16_t K);
+static fix16_t
+GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample);
+static void GasIndexAlgorithmFix16__mox_model__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t SRAW_STD,
+    fix16_t SRAW_MEAN);
+static fix16_t
+GasIndexAlgorithmFix16__mox_model__process(GasIndexAlgorithmFix16Params* params,
+                                           fix16_t sraw);
+static void GasIndexAlgorithmFix16__sigmoid_scaled__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t X0, fix16_t K,
+    fix16_t offset_default);
+static fix16_t GasIndexAlgorithmFix16__sigmoid_scaled__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample);
+static void GasIndexAlgorithmFix16__adaptive_lowpass__set_parameters(
+    GasIndexAlgorithmFix16Params* params);
+static fix16_t GasIndexAlgorithmFix16__adaptive_lowpass__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample);
+
+/* Q16.16 helpers: rounded, saturated to the fix16_t range. */
+
+static fix16_t fix16_saturate(int64_t x) {
+    if (x > (int64_t)FIX16_MAXIMUM) {
+        return FIX16_MAXIMUM;
+    } else if (x < (int64_t)FIX16_MINIMUM) {
+        return FIX16_MINIMUM;
+    }
+    return (fix16_t)x;
+}
+
+static fix16_t fix16_mul(fix16_t a, fix16_t b) {
+    return fix16_saturate((((int64_t)a * b) + 0x8000) >> 16);
+}
+
+static fix16_t fix16_ratio(int64_t numerator, int64_t denominator) {
+    if (denominator == 0) {
+        return (numerator >= 0) ? FIX16_MAXIMUM : FIX16_MINIMUM;
+    }
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    numerator *= 65536;
+    numerator += (numerator >= 0) ? (denominator / 2) : -(denominator / 2);
+    return fix16_saturate(numerator / denominator);
+}
+
+static fix16_t fix16_div(fix16_t a, fix16_t b) {
+    return fix16_ratio(a, b);
+}
+
+static fix16_t fix16_sqrt(fix16_t x) {
+    uint64_t num;
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 46;
+
+    if (x <= 0) {
+        return 0;
+    }
+    num = (uint64_t)x << 16;
+    while (bit > num) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (num >= (res + bit)) {
+            num -= (res + bit);
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    if (num > res) {
+        res++;
+    }
+    return (fix16_t)res;
+}
+
+static fix16_t fix16_exp(fix16_t x) {
+    int32_t n;
+    int64_t r;
+    int64_t p;
+
+    if (x >= F16(10.3972)) {
+        return FIX16_MAXIMUM;
+    } else if (x <= F16(-11.7835)) {
+        return 0;
+    }
+    // exp(x) = 2^n * exp(r), |r| <= ln2 / 2
+    if (x >= 0) {
+        n = (x + (FIX16_LN2 / 2)) / FIX16_LN2;
+    } else {
+        n = -((-x + (FIX16_LN2 / 2)) / FIX16_LN2);
+    }
+    r = ((int64_t)x - ((int64_t)n * FIX16_LN2)) << 14;  // Q30
+    // Taylor series to r^5, error below 3e-6 on the reduced range
+    p = (1LL << 30) / 120;
+    p = ((1LL << 30) / 24) + ((p * r) >> 30);
+    p = ((1LL << 30) / 6) + ((p * r) >> 30);
+    p = ((1LL << 30) / 2) + ((p * r) >> 30);
+    p = (1LL << 30) + ((p * r) >> 30);
+    p = (1LL << 30) + ((p * r) >> 30);
+    if (n >= 14) {
+        return fix16_saturate(p << (n - 14));
+    }
+    return fix16_saturate((p + (1LL << (13 - n))) >> (14 - n));
+}
+
+void GasIndexAlgorithmFix16_init_with_sampling_interval(
+    GasIndexAlgorithmFix16Params* params, int32_t algorithm_type,
+    fix16_t sampling_interval) {
+    params->mAlgorithm_Type = algorithm_type;
+    params->mSamplingInterval = sampling_interval;
+    if ((algorithm_type == GasIndexAlgorithm_ALGORITHM_TYPE_NOX)) {
+        params->mIndex_Offset =
+            F16(GasIndexAlgorithm_NOX_INDEX_OFFSET_DEFAULT);
+        params->mSraw_Minimum = GasIndexAlgorithm_NOX_SRAW_MINIMUM;
+        params->mGating_Max_Duration_Minutes =
+            F16(GasIndexAlgorithm_GATING_NOX_MAX_DURATION_MINUTES);
+        params->mInit_Duration_Mean =
+            F16(GasIndexAlgorithm_INIT_DURATION_MEAN_NOX);
+        params->mInit_Duration_Variance =
+            F16(GasIndexAlgorithm_INIT_DURATION_VARIANCE_NOX);
+        params->mGating_Threshold = F16(GasIndexAlgorithm_GATING_THRESHOLD_NOX);
+    } else {
+        params->mIndex_Offset =
+            F16(GasIndexAlgorithm_VOC_INDEX_OFFSET_DEFAULT);
+        params->mSraw_Minimum = GasIndexAlgorithm_VOC_SRAW_MINIMUM;
+        params->mGating_Max_Duration_Minutes =
+            F16(GasIndexAlgorithm_GATING_VOC_MAX_DURATION_MINUTES);
+        params->mInit_Duration_Mean =
+            F16(GasIndexAlgorithm_INIT_DURATION_MEAN_VOC);
+        params->mInit_Duration_Variance =
+            F16(GasIndexAlgorithm_INIT_DURATION_VARIANCE_VOC);
+        params->mGating_Threshold = F16(GasIndexAlgorithm_GATING_THRESHOLD_VOC);
+    }
+    params->mIndex_Gain = F16(GasIndexAlgorithm_INDEX_GAIN);
+    params->mTau_Mean_Hours = F16(GasIndexAlgorithm_TAU_MEAN_HOURS);
+    params->mTau_Variance_Hours = F16(GasIndexAlgorithm_TAU_VARIANCE_HOURS);
+    params->mSraw_Std_Initial = F16(GasIndexAlgorithm_SRAW_STD_INITIAL);
+    GasIndexAlgorithmFix16_reset(params);
+}
+
+void GasIndexAlgorithmFix16_init(GasIndexAlgorithmFix16Params* params,
+                                 int32_t algorithm_type) {
+    GasIndexAlgorithmFix16_init_with_sampling_interval(
+        params, algorithm_type,
+        F16(GasIndexAlgorithm_DEFAULT_SAMPLING_INTERVAL));
+}
+
+void GasIndexAlgorithmFix16_reset(GasIndexAlgorithmFix16Params* params) {
+    params->mUptime = 0;
+    params->mSraw = 0;
+    params->mGas_Index = 0;
+    GasIndexAlgorithmFix16__init_instances(params);
+}
+
+static void
+GasIndexAlgorithmFix16__init_instances(GasIndexAlgorithmFix16Params* params) {
+
+    GasIndexAlgorithmFix16__mean_variance_estimator__set_parameters(params);
+    GasIndexAlgorithmFix16__mox_model__set_parameters(
+        params, GasIndexAlgorithmFix16__mean_variance_estimator__get_std(params),
+        GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(params));
+    if ((params->mAlgorithm_Type == GasIndexAlgorithm_ALGORITHM_TYPE_NOX)) {
+        GasIndexAlgorithmFix16__sigmoid_scaled__set_parameters(
+            params, F16(GasIndexAlgorithm_SIGMOID_X0_NOX),
+            F16(GasIndexAlgorithm_SIGMOID_K_NOX),
+            F16(GasIndexAlgorithm_NOX_INDEX_OFFSET_DEFAULT));
+    } else {
+        GasIndexAlgorithmFix16__sigmoid_scaled__set_parameters(
+            params, F16(GasIndexAlgorithm_SIGMOID_X0_VOC),
+            F16(GasIndexAlgorithm_SIGMOID_K_VOC),
+            F16(GasIndexAlgorithm_VOC_INDEX_OFFSET_DEFAULT));
+    }
+    GasIndexAlgorithmFix16__adaptive_lowpass__set_parameters(params);
+}
+
+void GasIndexAlgorithmFix16_get_sampling_interval(
+    const GasIndexAlgorithmFix16Params* params, fix16_t* sampling_interval) {
+    *sampling_interval = params->mSamplingInterval;
+}
+
+void GasIndexAlgorithmFix16_get_states(
+    const GasIndexAlgorithmFix16Params* params, fix16_t* state0,
+    fix16_t* state1) {
+
+    *state0 = GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(params);
+    *state1 = GasIndexAlgorithmFix16__mean_variance_estimator__get_std(params);
+    return;
+}
+
+void GasIndexAlgorithmFix16_set_states(GasIndexAlgorithmFix16Params* params,
+                                       fix16_t state0, fix16_t state1) {
+
+    GasIndexAlgorithmFix16__mean_variance_estimator__set_states(
+        params, state0, state1,
+        F16(GasIndexAlgorithm_PERSISTENCE_UPTIME_GAMMA));
+    GasIndexAlgorithmFix16__mox_model__set_parameters(
+        params, GasIndexAlgorithmFix16__mean_variance_estimator__get_std(params),
+        GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(params));
+    params->mSraw = state0;
+}
+
+void GasIndexAlgorithmFix16_set_tuning_parameters(
+    GasIndexAlgorithmFix16Params* params, int32_t index_offset,
+    int32_t learning_time_offset_hours, int32_t learning_time_gain_hours,
+    int32_t gating_max_duration_minutes, int32_t std_initial,
+    int32_t gain_factor) {
+
+    params->mIndex_Offset = (index_offset * FIX16_ONE);
+    params->mTau_Mean_Hours = (learning_time_offset_hours * FIX16_ONE);
+    params->mTau_Variance_Hours = (learning_time_gain_hours * FIX16_ONE);
+    params->mGating_Max_Duration_Minutes =
+        (gating_max_duration_minutes * FIX16_ONE);
+    params->mSraw_Std_Initial = (std_initial * FIX16_ONE);
+    params->mIndex_Gain = (gain_factor * FIX16_ONE);
+    GasIndexAlgorithmFix16__init_instances(params);
+}
+
+void GasIndexAlgorithmFix16_get_tuning_parameters(
+    const GasIndexAlgorithmFix16Params* params, int32_t* index_offset,
+    int32_t* learning_time_offset_hours, int32_t* learning_time_gain_hours,
+    int32_t* gating_max_duration_minutes, int32_t* std_initial,
+    int32_t* gain_factor) {
+
+    *index_offset = (params->mIndex_Offset >> 16);
+    *learning_time_offset_hours = (params->mTau_Mean_Hours >> 16);
+    *learning_time_gain_hours = (params->mTau_Variance_Hours >> 16);
+    *gating_max_duration_minutes = (params->mGating_Max_Duration_Minutes >> 16);
+    *std_initial = (params->mSraw_Std_Initial >> 16);
+    *gain_factor = (params->mIndex_Gain >> 16);
+    return;
+}
+
+void GasIndexAlgorithmFix16_process(GasIndexAlgorithmFix16Params* params,
+                                    int32_t sraw, int32_t* gas_index) {
+
+    if ((params->mUptime <= F16(GasIndexAlgorithm_INITIAL_BLACKOUT))) {
+        params->mUptime = (params->mUptime + params->mSamplingInterval);
+    } else {
+        if (((sraw > 0) && (sraw < 65000))) {
+            if ((sraw < (params->mSraw_Minimum + 1))) {
+                sraw = (params->mSraw_Minimum + 1);
+            } else if ((sraw > (params->mSraw_Minimum + 32767))) {
+                sraw = (params->mSraw_Minimum + 32767);
+            }
+            params->mSraw = ((sraw - params->mSraw_Minimum) * FIX16_ONE);
+        }
+        if (((params->mAlgorithm_Type ==
+              GasIndexAlgorithm_ALGORITHM_TYPE_VOC) ||
+             GasIndexAlgorithmFix16__mean_variance_estimator__is_initialized(
+                 params))) {
+            params->mGas_Index =
+                GasIndexAlgorithmFix16__mox_model__process(params,
+                                                           params->mSraw);
+            params->mGas_Index =
+                GasIndexAlgorithmFix16__sigmoid_scaled__process(
+                    params, params->mGas_Index);
+        } else {
+            params->mGas_Index = params->mIndex_Offset;
+        }
+        params->mGas_Index = GasIndexAlgorithmFix16__adaptive_lowpass__process(
+            params, params->mGas_Index);
+        if ((params->mGas_Index < F16(0.5))) {
+            params->mGas_Index = F16(0.5);
+        }
+        if ((params->mSraw > 0)) {
+            GasIndexAlgorithmFix16__mean_variance_estimator__process(
+                params, params->mSraw);
+            GasIndexAlgorithmFix16__mox_model__set_parameters(
+                params,
+                GasIndexAlgorithmFix16__mean_variance_estimator__get_std(params),
+                GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(
+                    params));
+        }
+    }
+    *gas_index = ((params->mGas_Index + F16(0.5)) >> 16);
+    return;
+}
+
+static void GasIndexAlgorithmFix16__mean_variance_estimator__set_parameters(
+    GasIndexAlgorithmFix16Params* params) {
+
+    // Gammas are computed once with 64 bit intermediates: the hour based
+    // denominators do not fit in fix16_t.
+    int64_t gamma_scaling = F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__GAMMA_SCALING);
+    int64_t additional_gamma_mean_scaling = F16(
+        GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__ADDITIONAL_GAMMA_MEAN_SCALING);
+    int64_t sampling_interval = params->mSamplingInterval;
+
+    params->m_Mean_Variance_Estimator___Initialized = false;
+    params->m_Mean_Variance_Estimator___Mean = 0;
+    params->m_Mean_Variance_Estimator___Sraw_Offset = 0;
+    params->m_Mean_Variance_Estimator___Std = params->mSraw_Std_Initial;
+    params->m_Mean_Variance_Estimator___Gamma_Mean = fix16_ratio(
+        ((additional_gamma_mean_scaling * gamma_scaling) >> 16) *
+            sampling_interval,
+        ((int64_t)params->mTau_Mean_Hours * 3600 + sampling_interval) << 16);
+    params->m_Mean_Variance_Estimator___Gamma_Variance = fix16_ratio(
+        gamma_scaling * sampling_interval,
+        ((int64_t)params->mTau_Variance_Hours * 3600 + sampling_interval)
+            << 16);
+    if ((params->mAlgorithm_Type == GasIndexAlgorithm_ALGORITHM_TYPE_NOX)) {
+        params->m_Mean_Variance_Estimator___Gamma_Initial_Mean = fix16_ratio(
+            ((additional_gamma_mean_scaling * gamma_scaling) >> 16) *
+                sampling_interval,
+            (F16(GasIndexAlgorithm_TAU_INITIAL_MEAN_NOX) + sampling_interval)
+                << 16);
+    } else {
+        params->m_Mean_Variance_Estimator___Gamma_Initial_Mean = fix16_ratio(
+            ((additional_gamma_mean_scaling * gamma_scaling) >> 16) *
+                sampling_interval,
+            (F16(GasIndexAlgorithm_TAU_INITIAL_MEAN_VOC) + sampling_interval)
+                << 16);
+    }
+    params->m_Mean_Variance_Estimator___Gamma_Initial_Variance = fix16_ratio(
+        gamma_scaling * sampling_interval,
+        (F16(GasIndexAlgorithm_TAU_INITIAL_VARIANCE) + sampling_interval)
+            << 16);
+    params->m_Mean_Variance_Estimator__Gamma_Mean = 0;
+    params->m_Mean_Variance_Estimator__Gamma_Variance = 0;
+    params->m_Mean_Variance_Estimator___Uptime_Gamma = 0;
+    params->m_Mean_Variance_Estimator___Uptime_Gating = 0;
+    params->m_Mean_Variance_Estimator___Gating_Duration_Minutes = 0;
+}
+
+static void GasIndexAlgorithmFix16__mean_variance_estimator__set_states(
+    GasIndexAlgorithmFix16Params* params, fix16_t mean, fix16_t std,
+    fix16_t uptime_gamma) {
+
+    params->m_Mean_Variance_Estimator___Mean = mean;
+    params->m_Mean_Variance_Estimator___Std = std;
+    params->m_Mean_Variance_Estimator___Uptime_Gamma = uptime_gamma;
+    params->m_Mean_Variance_Estimator___Initialized = true;
+}
+
+static fix16_t GasIndexAlgorithmFix16__mean_variance_estimator__get_std(
+    const GasIndexAlgorithmFix16Params* params) {
+
+    return params->m_Mean_Variance_Estimator___Std;
+}
+
+static fix16_t GasIndexAlgorithmFix16__mean_variance_estimator__get_mean(
+    const GasIndexAlgorithmFix16Params* params) {
+
+    return (params->m_Mean_Variance_Estimator___Mean +
+            params->m_Mean_Variance_Estimator___Sraw_Offset);
+}
+
+static bool GasIndexAlgorithmFix16__mean_variance_estimator__is_initialized(
+    GasIndexAlgorithmFix16Params* params) {
+
+    return params->m_Mean_Variance_Estimator___Initialized;
+}
+
+static void GasIndexAlgorithmFix16__mean_variance_estimator___calculate_gamma(
+    GasIndexAlgorithmFix16Params* params) {
+
+    fix16_t uptime_limit;
+    fix16_t sigmoid_gamma_mean;
+    fix16_t gamma_mean;
+    fix16_t gating_threshold_mean;
+    fix16_t sigmoid_gating_mean;
+    fix16_t sigmoid_gamma_variance;
+    fix16_t gamma_variance;
+    fix16_t gating_threshold_variance;
+    fix16_t sigmoid_gating_variance;
+
+    uptime_limit =
+        (F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__FIX16_MAX) -
+         params->mSamplingInterval);
+    if ((params->m_Mean_Variance_Estimator___Uptime_Gamma < uptime_limit)) {
+        params->m_Mean_Variance_Estimator___Uptime_Gamma =
+            (params->m_Mean_Variance_Estimator___Uptime_Gamma +
+             params->mSamplingInterval);
+    }
+    if ((params->m_Mean_Variance_Estimator___Uptime_Gating < uptime_limit)) {
+        params->m_Mean_Variance_Estimator___Uptime_Gating =
+            (params->m_Mean_Variance_Estimator___Uptime_Gating +
+             params->mSamplingInterval);
+    }
+    GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+        params, params->mInit_Duration_Mean,
+        F16(GasIndexAlgorithm_INIT_TRANSITION_MEAN));
+    sigmoid_gamma_mean =
+        GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+            params, params->m_Mean_Variance_Estimator___Uptime_Gamma);
+    gamma_mean =
+        (params->m_Mean_Variance_Estimator___Gamma_Mean +
+         fix16_mul((params->m_Mean_Variance_Estimator___Gamma_Initial_Mean -
+                    params->m_Mean_Variance_Estimator___Gamma_Mean),
+                   sigmoid_gamma_mean));
+    gating_threshold_mean =
+        (params->mGating_Threshold +
+         fix16_mul(
+             (F16(GasIndexAlgorithm_GATING_THRESHOLD_INITIAL) -
+              params->mGating_Threshold),
+             GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+                 params, params->m_Mean_Variance_Estimator___Uptime_Gating)));
+    GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+        params, gating_threshold_mean,
+        F16(GasIndexAlgorithm_GATING_THRESHOLD_TRANSITION));
+    sigmoid_gating_mean =
+        GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+            params, params->mGas_Index);
+    params->m_Mean_Variance_Estimator__Gamma_Mean =
+        fix16_mul(sigmoid_gating_mean, gamma_mean);
+    GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+        params, params->mInit_Duration_Variance,
+        F16(GasIndexAlgorithm_INIT_TRANSITION_VARIANCE));
+    sigmoid_gamma_variance =
+        GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+            params, params->m_Mean_Variance_Estimator___Uptime_Gamma);
+    gamma_variance =
+        (params->m_Mean_Variance_Estimator___Gamma_Variance +
+         fix16_mul(
+             (params->m_Mean_Variance_Estimator___Gamma_Initial_Variance -
+              params->m_Mean_Variance_Estimator___Gamma_Variance),
+             (sigmoid_gamma_variance - sigmoid_gamma_mean)));
+    gating_threshold_variance =
+        (params->mGating_Threshold +
+         fix16_mul(
+             (F16(GasIndexAlgorithm_GATING_THRESHOLD_INITIAL) -
+              params->mGating_Threshold),
+             GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+                 params, params->m_Mean_Variance_Estimator___Uptime_Gating)));
+    GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+        params, gating_threshold_variance,
+        F16(GasIndexAlgorithm_GATING_THRESHOLD_TRANSITION));
+    sigmoid_gating_variance =
+        GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+            params, params->mGas_Index);
+    params->m_Mean_Variance_Estimator__Gamma_Variance =
+        fix16_mul(sigmoid_gating_variance, gamma_variance);
+    params->m_Mean_Variance_Estimator___Gating_Duration_Minutes =
+        (params->m_Mean_Variance_Estimator___Gating_Duration_Minutes +
+         fix16_mul(fix16_div(params->mSamplingInterval, F16(60.)),
+                   (fix16_mul((FIX16_ONE - sigmoid_gating_mean),
+                              F16((1. + GasIndexAlgorithm_GATING_MAX_RATIO))) -
+                    F16(GasIndexAlgorithm_GATING_MAX_RATIO))));
+    if ((params->m_Mean_Variance_Estimator___Gating_Duration_Minutes < 0)) {
+        params->m_Mean_Variance_Estimator___Gating_Duration_Minutes = 0;
+    }
+    if ((params->m_Mean_Variance_Estimator___Gating_Duration_Minutes >
+         params->mGating_Max_Duration_Minutes)) {
+        params->m_Mean_Variance_Estimator___Uptime_Gating = 0;
+    }
+}
+
+static void GasIndexAlgorithmFix16__mean_variance_estimator__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sraw) {
+
+    fix16_t delta_sgp;
+    fix16_t c;
+    fix16_t additional_scaling;
+
+    if ((params->m_Mean_Variance_Estimator___Initialized == false)) {
+        params->m_Mean_Variance_Estimator___Initialized = true;
+        params->m_Mean_Variance_Estimator___Sraw_Offset = sraw;
+        params->m_Mean_Variance_Estimator___Mean = 0;
+    } else {
+        if (((params->m_Mean_Variance_Estimator___Mean >= F16(100.)) ||
+             (params->m_Mean_Variance_Estimator___Mean <= F16(-100.)))) {
+            params->m_Mean_Variance_Estimator___Sraw_Offset =
+                (params->m_Mean_Variance_Estimator___Sraw_Offset +
+                 params->m_Mean_Variance_Estimator___Mean);
+            params->m_Mean_Variance_Estimator___Mean = 0;
+        }
+        sraw = (sraw - params->m_Mean_Variance_Estimator___Sraw_Offset);
+        GasIndexAlgorithmFix16__mean_variance_estimator___calculate_gamma(
+            params);
+        delta_sgp = fix16_div(
+            (sraw - params->m_Mean_Variance_Estimator___Mean),
+            F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__GAMMA_SCALING));
+        if ((delta_sgp < 0)) {
+            c = (params->m_Mean_Variance_Estimator___Std - delta_sgp);
+        } else {
+            c = (params->m_Mean_Variance_Estimator___Std + delta_sgp);
+        }
+        additional_scaling = FIX16_ONE;
+        if ((c > F16(1440.))) {
+            additional_scaling = fix16_mul(fix16_div(c, F16(1440.)),
+                                           fix16_div(c, F16(1440.)));
+        }
+        params->m_Mean_Variance_Estimator___Std = fix16_mul(
+            fix16_sqrt(fix16_mul(
+                additional_scaling,
+                (F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__GAMMA_SCALING) -
+                 params->m_Mean_Variance_Estimator__Gamma_Variance))),
+            fix16_sqrt(
+                (fix16_mul(
+                     params->m_Mean_Variance_Estimator___Std,
+                     fix16_div(
+                         params->m_Mean_Variance_Estimator___Std,
+                         fix16_mul(
+                             F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__GAMMA_SCALING),
+                             additional_scaling))) +
+                 fix16_mul(
+                     fix16_div(
+                         fix16_mul(
+                             params->m_Mean_Variance_Estimator__Gamma_Variance,
+                             delta_sgp),
+                         additional_scaling),
+                     delta_sgp))));
+        params->m_Mean_Variance_Estimator___Mean =
+            (params->m_Mean_Variance_Estimator___Mean +
+             fix16_div(
+                 fix16_mul(params->m_Mean_Variance_Estimator__Gamma_Mean,
+                           delta_sgp),
+                 F16(GasIndexAlgorithm_MEAN_VARIANCE_ESTIMATOR__ADDITIONAL_GAMMA_MEAN_SCALING)));
+    }
+}
+
+static void
+GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t X0, fix16_t K) {
+
+    params->m_Mean_Variance_Estimator___Sigmoid__K = K;
+    params->m_Mean_Variance_Estimator___Sigmoid__X0 = X0;
+}
+
+static fix16_t
+GasIndexAlgorithmFix16__mean_variance_estimator___sigmoid__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample) {
+
+    fix16_t x;
+
+    x = fix16_mul(params->m_Mean_Variance_Estimator___Sigmoid__K,
+                  (sample - params->m_Mean_Variance_Estimator___Sigmoid__X0));
+    if ((x < F16(-50.))) {
+        return FIX16_ONE;
+    } else if ((x > F16(50.))) {
+        return 0;
+    } else {
+        return fix16_div(FIX16_ONE, (FIX16_ONE + fix16_exp(x)));
+    }
+}
+
+static void GasIndexAlgorithmFix16__mox_model__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t SRAW_STD,
+    fix16_t SRAW_MEAN) {
+
+    params->m_Mox_Model__Sraw_Std = SRAW_STD;
+    params->m_Mox_Model__Sraw_Mean = SRAW_MEAN;
+}
+
+static fix16_t
+GasIndexAlgorithmFix16__mox_model__process(GasIndexAlgorithmFix16Params* params,
+                                           fix16_t sraw) {
+
+    if ((params->mAlgorithm_Type == GasIndexAlgorithm_ALGORITHM_TYPE_NOX)) {
+        return fix16_mul(fix16_div((sraw - params->m_Mox_Model__Sraw_Mean),
+                                   F16(GasIndexAlgorithm_SRAW_STD_NOX)),
+                         params->mIndex_Gain);
+    } else {
+        return fix16_mul(
+            fix16_div((sraw - params->m_Mox_Model__Sraw_Mean),
+                      (-(params->m_Mox_Model__Sraw_Std +
+                         F16(GasIndexAlgorithm_SRAW_STD_BONUS_VOC)))),
+            params->mIndex_Gain);
+    }
+}
+
+static void GasIndexAlgorithmFix16__sigmoid_scaled__set_parameters(
+    GasIndexAlgorithmFix16Params* params, fix16_t X0, fix16_t K,
+    fix16_t offset_default) {
+
+    params->m_Sigmoid_Scaled__K = K;
+    params->m_Sigmoid_Scaled__X0 = X0;
+    params->m_Sigmoid_Scaled__Offset_Default = offset_default;
+}
+
+static fix16_t GasIndexAlgorithmFix16__sigmoid_scaled__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample) {
+
+    fix16_t x;
+    fix16_t shift;
+
+    x = fix16_mul(params->m_Sigmoid_Scaled__K,
+                  (sample - params->m_Sigmoid_Scaled__X0));
+    if ((x < F16(-50.))) {
+        return F16(GasIndexAlgorithm_SIGMOID_L);
+    } else if ((x > F16(50.))) {
+        return 0;
+    } else {
+        if ((sample >= 0)) {
+            if ((params->m_Sigmoid_Scaled__Offset_Default == FIX16_ONE)) {
+                shift = fix16_mul(F16((500. / 499.)),
+                                  (FIX16_ONE - params->mIndex_Offset));
+            } else {
+                shift = fix16_div(
+                    (F16(GasIndexAlgorithm_SIGMOID_L) -
+                     fix16_mul(F16(5.), params->mIndex_Offset)),
+                    F16(4.));
+            }
+            return (fix16_div((F16(GasIndexAlgorithm_SIGMOID_L) + shift),
+                              (FIX16_ONE + fix16_exp(x))) -
+                    shift);
+        } else {
+            return fix16_mul(
+                fix16_div(params->mIndex_Offset,
+                          params->m_Sigmoid_Scaled__Offset_Default),
+                fix16_div(F16(GasIndexAlgorithm_SIGMOID_L),
+                          (FIX16_ONE + fix16_exp(x))));
+        }
+    }
+}
+
+static void GasIndexAlgorithmFix16__adaptive_lowpass__set_parameters(
+    GasIndexAlgorithmFix16Params* params) {
+
+    params->m_Adaptive_Lowpass__A1 = fix16_div(
+        params->mSamplingInterval,
+        (F16(GasIndexAlgorithm_LP_TAU_FAST) + params->mSamplingInterval));
+    params->m_Adaptive_Lowpass__A2 = fix16_div(
+        params->mSamplingInterval,
+        (F16(GasIndexAlgorithm_LP_TAU_SLOW) + params->mSamplingInterval));
+    params->m_Adaptive_Lowpass___Initialized = false;
+}
+
+static fix16_t GasIndexAlgorithmFix16__adaptive_lowpass__process(
+    GasIndexAlgorithmFix16Params* params, fix16_t sample) {
+
+    fix16_t abs_delta;
+    fix16_t F1;
+    fix16_t tau_a;
+    fix16_t a3;
+
+    if ((params->m_Adaptive_Lowpass___Initialized == false)) {
+        params->m_Adaptive_Lowpass___X1 = sample;
+        params->m_Adaptive_Lowpass___X2 = sample;
+        params->m_Adaptive_Lowpass___X3 = sample;
+        params->m_Adaptive_Lowpass___Initialized = true;
+    }
+    params->m_Adaptive_Lowpass___X1 =
+        (fix16_mul((FIX16_ONE - params->m_Adaptive_Lowpass__A1),
+                   params->m_Adaptive_Lowpass___X1) +
+         fix16_mul(params->m_Adaptive_Lowpass__A1, sample));
+    params->m_Adaptive_Lowpass___X2 =
+        (fix16_mul((FIX16_ONE - params->m_Adaptive_Lowpass__A2),
+                   params->m_Adaptive_Lowpass___X2) +
+         fix16_mul(params->m_Adaptive_Lowpass__A2, sample));
+    abs_delta =
+        (params->m_Adaptive_Lowpass___X1 - params->m_Adaptive_Lowpass___X2);
+    if ((abs_delta < 0)) {
+        abs_delta = (-abs_delta);
+    }
+    F1 = fix16_exp(fix16_mul(F16(GasIndexAlgorithm_LP_ALPHA), abs_delta));
+    tau_a = (fix16_mul(F16((GasIndexAlgorithm_LP_TAU_SLOW -
+                            GasIndexAlgorithm_LP_TAU_FAST)),
+                       F1) +
+             F16(GasIndexAlgorithm_LP_TAU_FAST));
+    a3 = fix16_div(params->mSamplingInterval,
+                   (params->mSamplingInterval + tau_a));
+    params->m_Adaptive_Lowpass___X3 =
+        (fix16_mul((FIX16_ONE - a3), params->m_Adaptive_Lowpass___X3) +
+         fix16_mul(a3, sample));
+    return params->m_Adaptive_Lowpass___X3;
+}
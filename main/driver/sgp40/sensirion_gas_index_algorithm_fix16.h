@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2022, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Fixed-point (Q16.16) port of the gas index algorithm above, for cores
+ * without FPU. Same processing steps, tuning constants and state layout,
+ * every float is replaced by a fix16_t.
+ */
+
+#ifndef GASINDEXALGORITHM_FIX16_H_
+#define GASINDEXALGORITHM_FIX16_H_
+
+#include "sensirion_gas_index_algorithm.h"
+
+typedef int32_t fix16_t;
+
+#define F16(x)                                                               \
+    ((fix16_t)(((x) >= 0) ? ((x)*65536.0 + 0.5) : ((x)*65536.0 - 0.5)))
+#define FIX16_ONE ((fix16_t)0x00010000)
+#define FIX16_MAXIMUM ((fix16_t)0x7FFFFFFF)
+#define FIX16_MINIMUM ((fix16_t)0x80000000)
+
+/**
+ * Struct to hold all parameters and states of the gas algorithm, fix16_t
+ * counterpart of GasIndexAlgorithmParams.
+ */
+typedef struct {
+    int mAlgorithm_Type;
+    fix16_t mSamplingInterval;
+    fix16_t mIndex_Offset;
+    int32_t mSraw_Minimum;
+    fix16_t mGating_Max_Duration_Minutes;
+    fix16_t mInit_Duration_Mean;
+    fix16_t mInit_Duration_Variance;
+    fix16_t mGating_Threshold;
+    fix16_t mIndex_Gain;
+    fix16_t mTau_Mean_Hours;
+    fix16_t mTau_Variance_Hours;
+    fix16_t mSraw_Std_Initial;
+    fix16_t mUptime;
+    fix16_t mSraw;
+    fix16_t mGas_Index;
+    bool m_Mean_Variance_Estimator___Initialized;
+    fix16_t m_Mean_Variance_Estimator___Mean;
+    fix16_t m_Mean_Variance_Estimator___Sraw_Offset;
+    fix16_t m_Mean_Variance_Estimator___Std;
+    fix16_t m_Mean_Variance_Estimator___Gamma_Mean;
+    fix16_t m_Mean_Variance_Estimator___Gamma_Variance;
+    fix16_t m_Mean_Variance_Estimator___Gamma_Initial_Mean;
+    fix16_t m_Mean_Variance_Estimator___Gamma_Initial_Variance;
+    fix16_t m_Mean_Variance_Estimator__Gamma_Mean;
+    fix16_t m_Mean_Variance_Estimator__Gamma_Variance;
+    fix16_t m_Mean_Variance_Estimator___Uptime_Gamma;
+    fix16_t m_Mean_Variance_Estimator___Uptime_Gating;
+    fix16_t m_Mean_Variance_Estimator___Gating_Duration_Minutes;
+    fix16_t m_Mean_Variance_Estimator___Sigmoid__K;
+    fix16_t m_Mean_Variance_Estimator___Sigmoid__X0;
+    fix16_t m_Mox_Model__Sraw_Std;
+    fix16_t m_Mox_Model__Sraw_Mean;
+    fix16_t m_Sigmoid_Scaled__K;
+    fix16_t m_Sigmoid_Scaled__X0;
+    fix16_t m_Sigmoid_Scaled__Offset_Default;
+    fix16_t m_Adaptive_Lowpass__A1;
+    fix16_t m_Adaptive_Lowpass__A2;
+    bool m_Adaptive_Lowpass___Initialized;
+    fix16_t m_Adaptive_Lowpass___X1;
+    fix16_t m_Adaptive_Lowpass___X2;
+    fix16_t m_Adaptive_Lowpass___X3;
+} GasIndexAlgorithmFix16Params;
+
+/**
+ * See GasIndexAlgorithm_init().
+ */
+void GasIndexAlgorithmFix16_init(GasIndexAlgorithmFix16Params* params,
+                                 int32_t algorithm_type);
+
+/**
+ * See GasIndexAlgorithm_init_with_sampling_interval(), the sampling interval
+ * is given in fix16_t seconds.
+ */
+void GasIndexAlgorithmFix16_init_with_sampling_interval(
+    GasIndexAlgorithmFix16Params* params, int32_t algorithm_type,
+    fix16_t sampling_interval);
+
+/**
+ * See GasIndexAlgorithm_reset().
+ */
+void GasIndexAlgorithmFix16_reset(GasIndexAlgorithmFix16Params* params);
+
+/**
+ * See GasIndexAlgorithm_get_states(), states are fix16_t.
+ */
+void GasIndexAlgorithmFix16_get_states(
+    const GasIndexAlgorithmFix16Params* params, fix16_t* state0,
+    fix16_t* state1);
+
+/**
+ * See GasIndexAlgorithm_set_states(), states are fix16_t.
+ */
+void GasIndexAlgorithmFix16_set_states(GasIndexAlgorithmFix16Params* params,
+                                       fix16_t state0, fix16_t state1);
+
+/**
+ * See GasIndexAlgorithm_set_tuning_parameters().
+ */
+void GasIndexAlgorithmFix16_set_tuning_parameters(
+    GasIndexAlgorithmFix16Params* params, int32_t index_offset,
+    int32_t learning_time_offset_hours, int32_t learning_time_gain_hours,
+    int32_t gating_max_duration_minutes, int32_t std_initial,
+    int32_t gain_factor);
+
+/**
+ * See GasIndexAlgorithm_get_tuning_parameters().
+ */
+void GasIndexAlgorithmFix16_get_tuning_parameters(
+    const GasIndexAlgorithmFix16Params* params, int32_t* index_offset,
+    int32_t* learning_time_offset_hours, int32_t* learning_time_gain_hours,
+    int32_t* gating_max_duration_minutes, int32_t* std_initial,
+    int32_t* gain_factor);
+
+/**
+ * See GasIndexAlgorithm_get_sampling_interval(), fix16_t seconds.
+ */
+void GasIndexAlgorithmFix16_get_sampling_interval(
+    const GasIndexAlgorithmFix16Params* params, fix16_t* sampling_interval);
+
+/**
+ * See GasIndexAlgorithm_process().
+ */
+void GasIndexAlgorithmFix16_process(GasIndexAlgorithmFix16Params* params,
+                                    int32_t sraw, int32_t* gas_index);
+
+#endif /* GASINDEXALGORITHM_FIX16_H_ */
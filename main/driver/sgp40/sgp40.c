@@ -6,11 +6,15 @@
  */
 
 #include "sgp40.h"
-#include "sensirion_gas_index_algorithm.h"
+#include "sensirion_gas_index_algorithm_fix16.h"
+
+#include <stdlib.h>
 
 #include <freertos/task.h>
 
-#include "driver/i2c.h"
+#include "i2c_bus.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
 
 ///
 struct sgp40_config sgp40_config;
@@ -34,25 +38,45 @@ static uint8_t sgp40_compute_crc(uint8_t *buf, size_t size) {
 static int sgp40_write_command(uint16_t cmd) {
 	uint8_t tx_buf[2] = { cmd >> 8, cmd & 0xff };
 
-	if (xSemaphoreTake(sgp40_config.i2c_dev->lock, sgp40_config.i2c_dev->i2c_timeout) != pdTRUE) {
+	if (i2c_bus_transfer(I2C_BUS_DEVICE_SGP40, sgp40_config.i2c_dev_address, tx_buf, sizeof(tx_buf), NULL, 0)) {
 		return -1;
 	}
 
-	if (i2c_master_write_to_device(sgp40_config.i2c_dev->i2c_num, sgp40_config.i2c_dev_address, tx_buf, sizeof(tx_buf), sgp40_config.i2c_dev->i2c_timeout)) {
-		xSemaphoreGive(sgp40_config.i2c_dev->lock);
+	return 0;
+}
 
-		return -1;
+/// Compensation ticks, inverse of the SHT4x conversion, rounded to nearest.
+void sgp40_compensation_ticks(int16_t t_amb, uint16_t r_hum, uint16_t *t_ticks, uint16_t *rh_ticks) {
+	int32_t t = t_amb;
+
+	if (t < SGP40_T_MIN) {
+		t = SGP40_T_MIN;
+	} else if (t > SGP40_T_MAX) {
+		t = SGP40_T_MAX;
+	}
+	if (r_hum > 100u * RELATIVE_HUMIDITY_SCALE) {
+		r_hum = 100u * RELATIVE_HUMIDITY_SCALE;
 	}
 
-	xSemaphoreGive(sgp40_config.i2c_dev->lock);
+	*t_ticks = (uint16_t) (((uint32_t) (t - SGP40_T_MIN) * SGP40_TICKS_MAX + SGP40_T_SPAN / 2u) / SGP40_T_SPAN);
+	*rh_ticks = (uint16_t) (((uint32_t) r_hum * SGP40_TICKS_MAX + SGP40_RH_SPAN / 2u) / SGP40_RH_SPAN);
+}
 
-	return 0;
+/// Float reference of sgp40_compensation_ticks(), only used by the benchmark.
+void sgp40_compensation_ticks_reference(int16_t t_amb, uint16_t r_hum, uint16_t *t_ticks, uint16_t *rh_ticks) {
+	float t = (float) t_amb / TEMPERATURE_SCALE;
+	float rh = (float) r_hum / RELATIVE_HUMIDITY_SCALE;
+
+	*t_ticks = (uint16_t)((((t + 45.f) * 65535.f) + 87.f) / 175.f);
+	*rh_ticks = (uint16_t)(((rh * 65535.f) + 50.f) / 100.f);
 }
 
-static int sgp40_write_measure_command(float t_amb, float r_hum) {
+static int sgp40_write_measure_command(int16_t t_amb, uint16_t r_hum) {
 	uint8_t tx_buf[8];
-	uint16_t t_ticks =  (uint16_t)((((t_amb + 45.f) * 65535.f) + 87.f) / 175.f);
-	uint16_t rh_ticks = (uint16_t)(((r_hum * 65535.f) + 50.f) / 100.f);
+	uint16_t t_ticks;
+	uint16_t rh_ticks;
+
+	sgp40_compensation_ticks(t_amb, r_hum, &t_ticks, &rh_ticks);
 
 	tx_buf[0] = (SGP40_CMD_MEASURE_RAW >> 8) & 0xff;
 	tx_buf[1] = SGP40_CMD_MEASURE_RAW & 0xff;
@@ -63,19 +87,10 @@ static int sgp40_write_measure_command(float t_amb, float r_hum) {
 	tx_buf[6] = rh_ticks & 0xff;
 	tx_buf[7] = sgp40_compute_crc(&tx_buf[5], 2);
 
-
-	if (xSemaphoreTake(sgp40_config.i2c_dev->lock, sgp40_config.i2c_dev->i2c_timeout) != pdTRUE) {
-		return -1;
-	}
-
-	if (i2c_master_write_to_device(sgp40_config.i2c_dev->i2c_num, sgp40_config.i2c_dev_address, tx_buf, sizeof(tx_buf), sgp40_config.i2c_dev->i2c_timeout)) {
-		xSemaphoreGive(sgp40_config.i2c_dev->lock);
-
+	if (i2c_bus_transfer(I2C_BUS_DEVICE_SGP40, sgp40_config.i2c_dev_address, tx_buf, sizeof(tx_buf), NULL, 0)) {
 		return -1;
 	}
 
-	xSemaphoreGive(sgp40_config.i2c_dev->lock);
-
 	return 0;
 }
 
@@ -83,18 +98,10 @@ static int sgp40_read_sample(void) {
 	uint8_t rx_buf[3];
 	uint16_t voc_raw_sample;
 
-	if (xSemaphoreTake(sgp40_config.i2c_dev->lock, sgp40_config.i2c_dev->i2c_timeout) != pdTRUE) {
-		return -1;
-	}
-
-	if (i2c_master_read_from_device(sgp40_config.i2c_dev->i2c_num, sgp40_config.i2c_dev_address, rx_buf, sizeof(rx_buf), sgp40_config.i2c_dev->i2c_timeout)) {
-		xSemaphoreGive(sgp40_config.i2c_dev->lock);
-
+	if (i2c_bus_transfer(I2C_BUS_DEVICE_SGP40, sgp40_config.i2c_dev_address, NULL, 0, rx_buf, sizeof(rx_buf))) {
 		return -1;
 	}
 
-	xSemaphoreGive(sgp40_config.i2c_dev->lock);
-
 	voc_raw_sample = ((uint16_t)rx_buf[0] << 8) | (uint16_t)rx_buf[1];
 
 	if (sgp40_compute_crc(&rx_buf[0], 2) != rx_buf[2]) {
@@ -117,31 +124,171 @@ int sgp40_init(struct i2c_dev_s *i2c_dev) {
 
 	vTaskDelay(pdMS_TO_TICKS(10u));
 
-	GasIndexAlgorithm_init(&sgp40_data.engine_algorithm_params, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+	GasIndexAlgorithmFix16_init(&sgp40_data.engine_algorithm_params, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
 
 	return 0;
 }
 
-int sgp40_sample(float t_amb, float r_hum, uint16_t *voc_idx) {
+int sgp40_start(int16_t t_amb, uint16_t r_hum) {
+	if ((t_amb == TEMPERATURE_INVALID) || (r_hum == RELATIVE_HUMIDITY_INVALID)) {
+		t_amb = SGP40_DEFAULT_TEMPERATURE;
+		r_hum = SGP40_DEFAULT_HUMIDITY;
+	}
+
+	return sgp40_write_measure_command(t_amb, r_hum);
+}
+
+int sgp40_read(uint16_t *voc_idx) {
+	int32_t gas_index;
+
 	*voc_idx = GAS_U_INVALID;
 
-	if (sgp40_write_measure_command(t_amb, r_hum)) {
+	if (sgp40_read_sample()) {
 //		sgp40_write_command(SGP40_CMD_HEATER_OFF);
 
 		return -1;
 	}
 
-	vTaskDelay(pdMS_TO_TICKS(SGP40_MEASURE_WAIT_MS));
+//	sgp40_write_command(SGP40_CMD_HEATER_OFF);
 
-	if (sgp40_read_sample()) {
+	GasIndexAlgorithmFix16_process(&sgp40_data.engine_algorithm_params, (int32_t)sgp40_data.voc_raw_sample, &gas_index);
+	*voc_idx = (uint16_t) gas_index;
+
+	return 0;
+}
+
+int sgp40_sample(int16_t t_amb, uint16_t r_hum, uint16_t *voc_idx) {
+	*voc_idx = GAS_U_INVALID;
+
+	if (sgp40_start(t_amb, r_hum)) {
 //		sgp40_write_command(SGP40_CMD_HEATER_OFF);
 
 		return -1;
 	}
 
-//	sgp40_write_command(SGP40_CMD_HEATER_OFF);
+	vTaskDelay(pdMS_TO_TICKS(SGP40_MEASURE_WAIT_MS));
 
-	GasIndexAlgorithm_process(&sgp40_data.engine_algorithm_params, (int32_t)sgp40_data.voc_raw_sample, (int32_t *)voc_idx);
+	return sgp40_read(voc_idx);
+}
+
+/// Read a conversion without feeding the gas index algorithm (preheat).
+int sgp40_read_raw(uint16_t *voc_raw) {
+	if (sgp40_read_sample()) {
+		return -1;
+	}
+
+	*voc_raw = sgp40_data.voc_raw_sample;
 
 	return 0;
 }
+
+int sgp40_heater_off(void) {
+	return sgp40_write_command(SGP40_CMD_HEATER_OFF);
+}
+
+/// Restart the gas index algorithm with another sampling interval, the learnt states are kept.
+void sgp40_set_sampling_interval(uint32_t sampling_interval) {
+	GasIndexAlgorithmFix16Params *params = &sgp40_data.engine_algorithm_params;
+	bool learnt = params->m_Mean_Variance_Estimator___Initialized;
+	fix16_t state0;
+	fix16_t state1;
+
+	GasIndexAlgorithmFix16_get_states(params, &state0, &state1);
+	GasIndexAlgorithmFix16_init_with_sampling_interval(params, GasIndexAlgorithm_ALGORITHM_TYPE_VOC, (fix16_t) sampling_interval * FIX16_ONE);
+
+	if (learnt) {
+		GasIndexAlgorithmFix16_set_states(params, state0, state1);
+
+		// The sensor is already warm, skip the initial blackout
+		params->mUptime = F16(GasIndexAlgorithm_INITIAL_BLACKOUT) + params->mSamplingInterval;
+	}
+}
+
+/// Gas index algorithm states (fix16_t mean and std), to skip the learning phase after a reboot.
+void sgp40_get_states(fix16_t *state0, fix16_t *state1) {
+	GasIndexAlgorithmFix16_get_states(&sgp40_data.engine_algorithm_params, state0, state1);
+}
+
+void sgp40_set_states(fix16_t state0, fix16_t state1) {
+	GasIndexAlgorithmFix16_set_states(&sgp40_data.engine_algorithm_params, state0, state1);
+}
+
+/// Deterministic SRAW trace: drift, periodic VOC events and noise.
+static int32_t sgp40_benchmark_sraw(uint32_t t, uint32_t *seed) {
+	uint32_t phase = t % (12u * SECONDS_PER_HOUR);
+	int32_t sraw = SGP40_BENCHMARK_SRAW_BASE;
+
+	// Triangle drift
+	if (phase < 6u * SECONDS_PER_HOUR) {
+		sraw += (int32_t) (phase * SGP40_BENCHMARK_DRIFT / (6u * SECONDS_PER_HOUR));
+	} else {
+		sraw += (int32_t) ((12u * SECONDS_PER_HOUR - phase) * SGP40_BENCHMARK_DRIFT / (6u * SECONDS_PER_HOUR));
+	}
+
+	// Triangle VOC event, lower SRAW means higher index
+	phase = t % (2u * SECONDS_PER_HOUR);
+	if (phase < 450u) {
+		sraw -= (int32_t) (phase * SGP40_BENCHMARK_EVENT / 450u);
+	} else if (phase < 900u) {
+		sraw -= (int32_t) ((900u - phase) * SGP40_BENCHMARK_EVENT / 450u);
+	}
+
+	*seed = *seed * 1664525u + 1013904223u;
+
+	return sraw + (int32_t) ((*seed >> 8) % (2u * SGP40_BENCHMARK_NOISE + 1u)) - SGP40_BENCHMARK_NOISE;
+}
+
+/// Float reference against the fixed-point gas index on the same trace: cycles, CPU time per day and index error.
+void sgp40_gas_index_benchmark(uint32_t hours) {
+	static GasIndexAlgorithmParams reference;
+	static GasIndexAlgorithmFix16Params fixed;
+	uint32_t samples = hours * SECONDS_PER_HOUR;
+	uint32_t seed = 12345u;
+	uint64_t reference_cycles = 0u;
+	uint64_t fixed_cycles = 0u;
+	uint32_t err_count = 0u;
+	int32_t err_max = 0;
+	int32_t reference_index;
+	int32_t fixed_index;
+	int32_t sraw;
+	uint32_t start;
+
+	if (samples == 0u) {
+		return;
+	}
+
+	GasIndexAlgorithm_init(&reference, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+	GasIndexAlgorithmFix16_init(&fixed, GasIndexAlgorithm_ALGORITHM_TYPE_VOC);
+
+	for (uint32_t t = 0u; t < samples; t++) {
+		sraw = sgp40_benchmark_sraw(t, &seed);
+
+		start = esp_cpu_get_cycle_count();
+		GasIndexAlgorithm_process(&reference, sraw, &reference_index);
+		reference_cycles += esp_cpu_get_cycle_count() - start;
+
+		start = esp_cpu_get_cycle_count();
+		GasIndexAlgorithmFix16_process(&fixed, sraw, &fixed_index);
+		fixed_cycles += esp_cpu_get_cycle_count() - start;
+
+		if (reference_index != fixed_index) {
+			err_count++;
+			if (abs(reference_index - fixed_index) > err_max) {
+				err_max = abs(reference_index - fixed_index);
+			}
+		}
+
+		// Let the idle task run, a long trace takes several seconds
+		if ((t % SECONDS_PER_HOUR) == 0u) {
+			vTaskDelay(1);
+		}
+	}
+
+	printf("gas index: %lu samples - float %lu cycles (%lu ms CPU/day) - fixed %lu cycles (%lu ms CPU/day)\n",
+			samples,
+			(uint32_t) (reference_cycles / samples),
+			(uint32_t) (reference_cycles / samples * 86400u / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000u)),
+			(uint32_t) (fixed_cycles / samples),
+			(uint32_t) (fixed_cycles / samples * 86400u / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000u)));
+	printf("gas index: max error %ld - samples differing %lu\n", err_max, err_count);
+}
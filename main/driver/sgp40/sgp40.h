@@ -9,7 +9,8 @@
 #define MAIN_DRIVER_SGP40_SGP40_H_
 
 #include "system.h"
-#include "sensirion_gas_index_algorithm.h"
+#include "types.h"
+#include "sensirion_gas_index_algorithm_fix16.h"
 
 #define SGP40_I2C_ADDRESS 		0x59
 
@@ -21,6 +22,30 @@
 
 #define SGP40_RESET_WAIT_MS		10u
 #define SGP40_MEASURE_WAIT_MS	30u
+#define SGP40_PREHEAT_WAIT_MS	170u		// Heater on before a low power measurement
+
+#define SGP40_SAMPLING_INTERVAL				1u		// s
+#define SGP40_SAMPLING_INTERVAL_LOW_POWER	10u		// s
+
+// Datasheet supply current at 3.3 V
+#define SGP40_CURRENT_MEASURE_UA	2600u		// Heater on
+#define SGP40_CURRENT_IDLE_UA		34u			// Heater off
+
+#define SGP40_DEFAULT_TEMPERATURE	(25 * TEMPERATURE_SCALE)		// Compensation used until a valid SHT4x sample exists
+#define SGP40_DEFAULT_HUMIDITY		(50u * RELATIVE_HUMIDITY_SCALE)
+
+// Compensation ticks use the SHT4x format: T = -45 + 175 * ticks / (2^16 - 1), RH = 100 * ticks / (2^16 - 1)
+#define SGP40_TICKS_MAX			65535u
+#define SGP40_T_MIN				(-45 * TEMPERATURE_SCALE)
+#define SGP40_T_MAX				(130 * TEMPERATURE_SCALE)
+#define SGP40_T_SPAN			(175u * TEMPERATURE_SCALE)
+#define SGP40_RH_SPAN			(100u * RELATIVE_HUMIDITY_SCALE)
+
+// Gas index benchmark: synthetic SRAW trace at 1 Hz
+#define SGP40_BENCHMARK_SRAW_BASE		30000
+#define SGP40_BENCHMARK_DRIFT			800			// Triangle over 12 h
+#define SGP40_BENCHMARK_EVENT			2500		// 15 min dip every 2 h
+#define SGP40_BENCHMARK_NOISE			15
 
 struct sgp40_config {
 	struct i2c_dev_s *i2c_dev;
@@ -29,10 +54,20 @@ struct sgp40_config {
 
 struct sgp40_data {
 	uint16_t voc_raw_sample;
-	GasIndexAlgorithmParams engine_algorithm_params;
+	GasIndexAlgorithmFix16Params engine_algorithm_params;
 };
 
 int sgp40_init(struct i2c_dev_s *i2c_dev);
-int sgp40_sample(float t_amb, float r_hum, uint16_t *voc_idx);
+void sgp40_compensation_ticks(int16_t t_amb, uint16_t r_hum, uint16_t *t_ticks, uint16_t *rh_ticks);
+void sgp40_compensation_ticks_reference(int16_t t_amb, uint16_t r_hum, uint16_t *t_ticks, uint16_t *rh_ticks);
+int sgp40_start(int16_t t_amb, uint16_t r_hum);
+int sgp40_read(uint16_t *voc_idx);
+int sgp40_sample(int16_t t_amb, uint16_t r_hum, uint16_t *voc_idx);
+int sgp40_read_raw(uint16_t *voc_raw);
+int sgp40_heater_off(void);
+void sgp40_set_sampling_interval(uint32_t sampling_interval);
+void sgp40_get_states(fix16_t *state0, fix16_t *state1);
+void sgp40_set_states(fix16_t state0, fix16_t state1);
+void sgp40_gas_index_benchmark(uint32_t hours);
 
 #endif /* MAIN_DRIVER_SGP40_SGP40_H_ */
@@ -9,7 +9,7 @@
 
 #include <freertos/task.h>
 
-#include "driver/i2c.h"
+#include "i2c_bus.h"
 
 ///
 struct sht4x_config sht4x_config;
@@ -33,19 +33,10 @@ static uint8_t sht4x_compute_crc(uint8_t *buf, size_t size) {
 static int sht4x_write_command(uint8_t cmd) {
 	uint8_t tx_buf[1] = { cmd };
 
-	if (xSemaphoreTake(sht4x_config.i2c_dev->lock, sht4x_config.i2c_dev->i2c_timeout) != pdTRUE) {
-
-		return -1;
-	}
-
-	if (i2c_master_write_to_device(sht4x_config.i2c_dev->i2c_num, sht4x_config.i2c_dev_address, tx_buf, sizeof(tx_buf), sht4x_config.i2c_dev->i2c_timeout) != ESP_OK) {
-		xSemaphoreGive(sht4x_config.i2c_dev->lock);
-
+	if (i2c_bus_transfer(I2C_BUS_DEVICE_SHT4X, sht4x_config.i2c_dev_address, tx_buf, sizeof(tx_buf), NULL, 0)) {
 		return -1;
 	}
 
-	xSemaphoreGive(sht4x_config.i2c_dev->lock);
-
 	return 0;
 }
 
@@ -54,18 +45,10 @@ static int sht4x_read_sample(void) {
 	uint16_t rh_sample;
 	uint8_t rx_buf[6];
 
-	if (xSemaphoreTake(sht4x_config.i2c_dev->lock, sht4x_config.i2c_dev->i2c_timeout) != pdTRUE) {
+	if (i2c_bus_transfer(I2C_BUS_DEVICE_SHT4X, sht4x_config.i2c_dev_address, NULL, 0, rx_buf, sizeof(rx_buf))) {
 		return -1;
 	}
 
-	if (i2c_master_read_from_device(sht4x_config.i2c_dev->i2c_num, sht4x_config.i2c_dev_address, rx_buf, sizeof(rx_buf), sht4x_config.i2c_dev->i2c_timeout)) {
-		xSemaphoreGive(sht4x_config.i2c_dev->lock);
-
-		return -1;
-	}
-
-	xSemaphoreGive(sht4x_config.i2c_dev->lock);
-
 	t_sample = ((uint16_t)rx_buf[0] << 8) | (uint16_t)rx_buf[1];
 	rh_sample = ((uint16_t)rx_buf[3] << 8) | (uint16_t)rx_buf[4];
 
@@ -92,22 +75,58 @@ int sht4x_init(struct i2c_dev_s *i2c_dev) {
 	return 0;
 }
 
-int sht4x_sample(float *t_amb, float *r_hum) {
-	*t_amb = TEMP_F_INVALID;
-	*r_hum = HUM_F_INVALID;
+/// Raw words to TEMPERATURE_SCALE / RELATIVE_HUMIDITY_SCALE, rounded to nearest, RH clamped to 0..100 %.
+void sht4x_convert(uint16_t t_sample, uint16_t rh_sample, int16_t *t_amb, uint16_t *r_hum) {
+	int32_t rh;
 
-	if (sht4x_write_command(SHT4X_CMD_MEASURE_HIGH)) {
-		return -1;
+	*t_amb = (int16_t) ((int32_t) (((uint32_t) t_sample * SHT4X_T_SPAN + SHT4X_RAW_MAX / 2u) / SHT4X_RAW_MAX) - SHT4X_T_OFFSET);
+
+	rh = (int32_t) (((uint32_t) rh_sample * SHT4X_RH_SPAN + SHT4X_RAW_MAX / 2u) / SHT4X_RAW_MAX) - SHT4X_RH_OFFSET;
+	if (rh < 0) {
+		rh = 0;
+	} else if (rh > (int32_t) (100u * RELATIVE_HUMIDITY_SCALE)) {
+		rh = 100u * RELATIVE_HUMIDITY_SCALE;
 	}
+	*r_hum = (uint16_t) rh;
+}
 
-	vTaskDelay(pdMS_TO_TICKS(SHT4X_MEASURE_WAIT_MS));
+/// Float reference of sht4x_convert(), only used by the benchmark.
+void sht4x_convert_reference(uint16_t t_sample, uint16_t rh_sample, int16_t *t_amb, uint16_t *r_hum) {
+	float t = t_sample * 175.0f / 65535.0f - 45.0f;
+	float rh = rh_sample * 125.0f / 65535.0f - 6.0f;
+
+	rh = rh < 0.f ? 0.f : (rh > 100.f ? 100.f : rh);
+
+	*t_amb = (int16_t) (t * TEMPERATURE_SCALE);
+	*r_hum = (uint16_t) (rh * RELATIVE_HUMIDITY_SCALE);
+}
+
+int sht4x_start(void) {
+	return sht4x_write_command(SHT4X_CMD_MEASURE_HIGH);
+}
+
+int sht4x_read(int16_t *t_amb, uint16_t *r_hum) {
+	*t_amb = TEMPERATURE_INVALID;
+	*r_hum = RELATIVE_HUMIDITY_INVALID;
 
 	if (sht4x_read_sample()) {
 		return -1;
 	}
 
-	*t_amb = sht4x_data.t_sample * 175.0f / 65535.0f - 45.0f;
-	*r_hum = sht4x_data.rh_sample * 125.0f / 65535.0f - 6.0f;
+	sht4x_convert(sht4x_data.t_sample, sht4x_data.rh_sample, t_amb, r_hum);
 
 	return 0;
 }
+
+int sht4x_sample(int16_t *t_amb, uint16_t *r_hum) {
+	*t_amb = TEMPERATURE_INVALID;
+	*r_hum = RELATIVE_HUMIDITY_INVALID;
+
+	if (sht4x_start()) {
+		return -1;
+	}
+
+	vTaskDelay(pdMS_TO_TICKS(SHT4X_MEASURE_WAIT_MS));
+
+	return sht4x_read(t_amb, r_hum);
+}
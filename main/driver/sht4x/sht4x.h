@@ -9,6 +9,7 @@
 #define MAIN_DRIVER_SHT4X_SHT4X_H_
 
 #include "system.h"
+#include "types.h"
 
 #define SHT4X_I2C_ADDRESS		0x44
 
@@ -21,6 +22,13 @@
 #define SHT4X_RESET_WAIT_MS		1u
 #define SHT4X_MEASURE_WAIT_MS	10u
 
+// Datasheet conversion: T = -45 + 175 * S / (2^16 - 1), RH = -6 + 125 * S / (2^16 - 1)
+#define SHT4X_RAW_MAX			65535u
+#define SHT4X_T_SPAN			(175u * TEMPERATURE_SCALE)
+#define SHT4X_T_OFFSET			(45 * TEMPERATURE_SCALE)
+#define SHT4X_RH_SPAN			(125u * RELATIVE_HUMIDITY_SCALE)
+#define SHT4X_RH_OFFSET			(6 * (int32_t) RELATIVE_HUMIDITY_SCALE)
+
 struct sht4x_config {
 	struct i2c_dev_s *i2c_dev;
 	uint8_t	i2c_dev_address;
@@ -32,6 +40,10 @@ struct sht4x_data {
 };
 
 int sht4x_init(struct i2c_dev_s *i2c_dev);
-int sht4x_sample(float *t_amb, float *r_hum);
+void sht4x_convert(uint16_t t_sample, uint16_t rh_sample, int16_t *t_amb, uint16_t *r_hum);
+void sht4x_convert_reference(uint16_t t_sample, uint16_t rh_sample, int16_t *t_amb, uint16_t *r_hum);
+int sht4x_start(void);
+int sht4x_read(int16_t *t_amb, uint16_t *r_hum);
+int sht4x_sample(int16_t *t_amb, uint16_t *r_hum);
 
 #endif /* MAIN_DRIVER_SHT4X_SHT4X_H_ */
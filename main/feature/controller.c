@@ -7,8 +7,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "freertos/timers.h"
 
+#include "esp_timer.h"
+
 #include "math.h"
 
 #include "blufi.h"
@@ -20,6 +23,8 @@
 #include "statistic.h"
 #include "user_experience.h"
 #include "protocol.h"
+#include "interpolation.h"
+#include "humidity.h"
 
 
 #define	CONTROLLER_TASK_STACK_SIZE			        (configMINIMAL_STACK_SIZE * 4)
@@ -30,7 +35,6 @@
 #define DURATION_FIXED_CYCLE_MS						SECONDS_TO_MS(DURATION_FIXED_CYCLE)
 #define DURATION_AUTOMATIC_CYCLE_OUT_MS				SECONDS_TO_MS(DURATION_AUTOMATIC_CYCLE_OUT)
 #define DURATION_AUTOMATIC_CYCLE_IN_MS				SECONDS_TO_MS(DURATION_AUTOMATIC_CYCLE_IN)
-#define DURATION_RESTART_AUTOMATIC_CYCLE_MS			SECONDS_TO_MS(DURATION_RESTART_AUTOMATIC_CYCLE)
 
 #define DURATION_EXTRA_CYCLE_BOOST_MS			    SECONDS_TO_MS(DURATION_EXTRA_CYCLE_BOOST)
 #define DURATION_RESTART_EXTRA_CYCLE_MS		    	SECONDS_TO_MS(DURATION_RESTART_EXTRA_CYCLE)
@@ -45,29 +49,122 @@
 #define CALCULATE_DURATION_INVERSIONS_MAX		    1U
 
 #define CONDITION_COUNT_MAX						    3U
-#define CONDITION_COUNT_RETURN_LUX				    300U
 
 #define CONTROLLER_FILTER_WARNING_PERIOD_MS			SECONDS_TO_MS(300U)
+
+#define CONTROLLER_WORK_QUEUE_LENGTH				(4U)
+
+#define DURATION_ESTIMATOR_SHIFT					(2U)		// Weight 1/4 for every completed phase
+#define DURATION_ESTIMATOR_STEP_MAX					(5)			// Maximum duration change per inversion (seconds)
+
+#ifndef CONTROLLER_TRACE
+#define CONTROLLER_TRACE							0	// Set to 1 to print the transitions on the UART, the RAM trace and the latency are always recorded
+#endif
+#define CONTROLLER_VERBOSE							0	// Set to 1 to print the sensor conditions on every period
+
+/// Events handled by the controller worker.
+enum controller_event_e {
+	CONTROLLER_EVENT_INVERSION					= 0,
+	CONTROLLER_EVENT_EXTRA_CYCLE,
+	CONTROLLER_EVENT_CALCULATE_DURATION,
+};
+
+#define DURATION_LUT_SHIFT							(2U)		// Table breakpoints are multiples of 4
 //
 static uint16_t calculate_duration_automatic_cycle(int16_t emission_temperature, int16_t immission_temperature);
+static int32_t calculate_duration_automatic_cycle_reference(int32_t delta);
 //
 static void controller_task(void *pvParameters);
 
-static void controller_state_machine(void);
+static void controller_state_machine(bool sensor_tick);
 
+#if CONTROLLER_TRACE
 static void controller_log(void);
+#endif
 
 static void controller_set(void);
+static uint8_t controller_apply_speed_set(uint8_t speed_state);
+static void controller_latency_update(void);
+static void controller_reason_set(uint8_t reason);
+static void controller_trace_record(void);
+static bool controller_ventilation_dries(void);
+static void controller_rh_slope_push(uint16_t relative_humidity);
+static bool controller_rh_slope_get(int32_t *slope);
+static void controller_fan_apply(void);
+static uint16_t controller_excess_percentage(uint16_t value, uint16_t threshold, uint16_t invalid, uint16_t span);
+static void controller_proportional_update(uint16_t relative_humidity, uint16_t relative_humidity_threshold, uint16_t voc, uint16_t voc_threshold);
 static void reset_automatic_cycle_count(void);
+static void duration_estimator_seed(int16_t internal_temperature, int16_t external_temperature);
+static void duration_estimator_update(uint8_t direction);
 //
 static void work_task(void *arg);
+static void controller_work(uint8_t event);
+static void controller_work_inversion(void);
+static void controller_work_sequence_start(uint8_t sequence);
+static void controller_work_sequence(uint8_t *reason);
+static void controller_post_pending(void);
+static int controller_post_event(uint8_t event);
 
 // Define Semaphore handler
 static SemaphoreHandle_t extra_cycle_count_sem;
 
+// Define the worker queue handle
+static QueueHandle_t work_queue = NULL;
+
+// Events that found the worker queue full, posted again by the controller task
+static portMUX_TYPE work_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t work_pending;
+static uint32_t work_dropped;
+
+// Define the controller task handle, used to wake it up on setting changes
+static TaskHandle_t controller_task_handle = NULL;
+
+/// Command to PWM latency instrumentation.
+struct controller_latency_s {
+	volatile bool		pending;		///< A command is waiting to reach fan_set()
+	volatile uint32_t	command_us;		///< Time of the oldest pending command (us)
+	uint32_t			last_us;		///< Last measured latency (us)
+	uint32_t			max_us;			///< Worst measured latency (us)
+	uint32_t			count;			///< Number of measured commands
+};
+
+static struct controller_latency_s controller_latency;
+
+/// Online estimate of the regenerator end-of-phase temperatures.
+struct duration_estimator_s {
+	bool		valid;				///< Seeded by the initial calculate duration cycle
+	int32_t		internal_acc;		///< Internal temperature average << DURATION_ESTIMATOR_SHIFT
+	int32_t		external_acc;		///< External temperature average << DURATION_ESTIMATOR_SHIFT
+};
+
+static struct duration_estimator_s duration_estimator;
+
+/// Last RH samples for the rate of change, one per controller period.
+struct rh_slope_window_s {
+	uint16_t	sample[RH_SLOPE_WINDOW];
+	uint8_t		head;				///< Next slot to write
+	uint8_t		count;				///< Valid samples, up to RH_SLOPE_WINDOW
+};
+
+static struct rh_slope_window_s rh_slope_window;
+
+/// Decision trace: the entries are written by the controller task, the reason by the controller and worker tasks under controller_trace_lock.
+struct controller_trace_s {
+	struct controller_trace_entry_s	entry[CONTROLLER_TRACE_DEPTH];
+	uint16_t						head;			///< Next slot to write
+	uint16_t						count;			///< Valid entries, up to CONTROLLER_TRACE_DEPTH
+	struct controller_trace_entry_s	cond;			///< Last conditions seen by controller_set()
+	uint8_t							reason;			///< Pending reason for the next record
+};
+
+static struct controller_trace_s controller_trace;
+static portMUX_TYPE controller_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Airflow of the proportional speed (percentage)
+static uint8_t proportional_percentage = PROPORTIONAL_PERCENTAGE_MIN;
+
 // Define the timer handle
 static TimerHandle_t controller_timer = NULL;
-static TimerHandle_t restart_automatic_cycle_timer = NULL;
 static TimerHandle_t restart_extra_cycle_timer = NULL;
 static TimerHandle_t filter_warning_timer = NULL;
 
@@ -92,6 +189,20 @@ static const struct time_shape time_convert[] = {
 		{ 25 * TEMPERATURE_SCALE, 35U },
 };
 
+#define DURATION_LUT_SIZE	((((25 * TEMPERATURE_SCALE) - (-10 * TEMPERATURE_SCALE)) >> DURATION_LUT_SHIFT) + 1U)
+
+static int16_t duration_lut_y[DURATION_LUT_SIZE];
+
+/// Automatic cycle duration (seconds) indexed by the temperature delta.
+static struct interp_lut_s duration_lut = {
+	.name = "cycle duration",
+	.reference = calculate_duration_automatic_cycle_reference,
+	.x_min = -10 * TEMPERATURE_SCALE,
+	.shift = DURATION_LUT_SHIFT,
+	.size = DURATION_LUT_SIZE,
+	.y = duration_lut_y,
+};
+
 //
 static void controller_task(void *pvParameters) {
 	TickType_t controller_task_time;
@@ -103,25 +214,42 @@ static void controller_task(void *pvParameters) {
 	controller_task_time = xTaskGetTickCount();
 
 	while (1) {
+		TickType_t elapsed = xTaskGetTickCount() - controller_task_time;
+		bool sensor_tick = false;
+
+		// Sleep until the next period, setting changes wake the task earlier
+		if (elapsed < CONTROLLER_TASK_PERIOD) {
+			ulTaskNotifyTake(pdTRUE, CONTROLLER_TASK_PERIOD - elapsed);
+		}
+
+		if ((xTaskGetTickCount() - controller_task_time) >= CONTROLLER_TASK_PERIOD) {
+			controller_task_time += CONTROLLER_TASK_PERIOD;
+			sensor_tick = true;
+		}
+
+		controller_post_pending();
+
 		if (test_in_progress() == false) {
-			controller_state_machine();
-			statistic_update_handler();
+			controller_state_machine(sensor_tick);
+
+			if (sensor_tick) {
+				statistic_update_handler();
 
-			if (get_device_state() & THRESHOLD_FILTER_WARNING) {
-				if (!get_wrn_flt_disable() && user_experience_in_operative()) {
-					if (!xTimerIsTimerActive(filter_warning_timer)) {
-						rgb_led_mode(RGB_LED_COLOR_FILTER_WARNING, RGB_LED_MODE_DOUBLE_BLINK, false);
+				if (get_device_state() & THRESHOLD_FILTER_WARNING) {
+					if (!get_wrn_flt_disable() && user_experience_in_operative()) {
+						if (!xTimerIsTimerActive(filter_warning_timer)) {
+							rgb_led_mode(RGB_LED_COLOR_FILTER_WARNING, RGB_LED_MODE_DOUBLE_BLINK, false);
 
-						xTimerStart(filter_warning_timer, 0);
+							xTimerStart(filter_warning_timer, 0);
+						}
 					}
 				}
 			}
 		}
-		vTaskDelayUntil(&controller_task_time, CONTROLLER_TASK_PERIOD);
 	}
 }
 
-static void controller_state_machine(void) {
+static void controller_state_machine(bool sensor_tick) {
 	uint8_t mode_set = get_mode_set();
 	uint8_t mode_state = get_mode_state();
 	uint8_t speed_set = get_speed_set();
@@ -132,8 +260,8 @@ static void controller_state_machine(void) {
 
 	if (mode_state != mode_set) {
 		xTimerStop(controller_timer, 0);
-		xTimerStop(restart_automatic_cycle_timer, 0);
 		reset_automatic_cycle_count();
+		controller_reason_set(CONTROLLER_REASON_MODE_CHANGE);
 
 		switch (mode_set) {
 		case MODE_OFF:
@@ -178,8 +306,7 @@ static void controller_state_machine(void) {
 			printf("MODE AUTOMATIC CYCLE STARTED\n");
 			set_mode_state( MODE_AUTOMATIC_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
 			set_automatic_cycle_duration(0U);
-			xTaskCreate(work_task, "work task", CONTROLLER_TASK_STACK_SIZE, NULL, CONTROLLER_TASK_PRIORITY, NULL);
-			xTimerStart(restart_automatic_cycle_timer, 0);
+			controller_post_event(CONTROLLER_EVENT_CALCULATE_DURATION);
 			break;
 
 		default:
@@ -187,19 +314,39 @@ static void controller_state_machine(void) {
 		}
 	}
 
-	controller_set();
-	fan_set(get_direction_state(), ADJUST_SPEED(get_speed_state()));
+	if (sensor_tick) {
+		controller_set();
+	} else {
+		// Setting change only: the sensor conditions are evaluated on the periodic tick
+		if (speed_state != speed_set) {
+			controller_reason_set(CONTROLLER_REASON_SETTING);
+		}
+
+		uint8_t new_speed_state = controller_apply_speed_set(get_speed_state());
+
+		if (get_mode_set() != MODE_AUTOMATIC_CYCLE) {
+			new_speed_state &= ~(SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT);
+		}
+
+		set_speed_state(new_speed_state);
+	}
+	controller_fan_apply();
+	controller_latency_update();
+	controller_trace_record();
 
 	if ( mode_state != mode_set || speed_state != speed_set ) {
 		blufi_wifi_send_voluntary(PROTOCOL_FUNCT_VOLUNTARY,PROTOCOL_OBJID_OPER,0);
 	}
 
+#if CONTROLLER_TRACE
 	controller_log();
+#endif
 }
 
+#if CONTROLLER_TRACE
 static void controller_log(void) {
 	static const char *mode_log_str[] = { "Off", "Immission","Emission", "Fixed cycle", "Automatic cycle" };
-	static const char *speed_log_str[] = { "None", "Night", "Vel1","Vel2", "Vel3", "Boost" };
+	static const char *speed_log_str[] = { "None", "Night", "Vel1","Vel2", "Vel3", "Boost", "Prop" };
 	static const char *direction_log_str[] = { "None", "In", "Out" };
 	static uint8_t mode_log = MODE_OFF;
 	static uint8_t speed_log = SPEED_NONE;
@@ -236,80 +383,80 @@ static void controller_log(void) {
 			(direction_log_str[direction_log]),
 			(interval_time));
 
+     // One fixed-format line per transition, meant to be diffed between runs
+     printf("TRC;%lu;%02x;%02x;%02x;%u;%u\r\n",
+			(unsigned long) pdTICKS_TO_MS(current_tick),
+			mode_log,
+			speed_log,
+			speed_set_log,
+			direction_log,
+			get_automatic_cycle_duration());
 	}
 }
+#endif
 
 static uint16_t calculate_duration_automatic_cycle(int16_t emission_temperature,int16_t immission_temperature) {
-	int16_t delta = emission_temperature - immission_temperature;
+	int32_t delta = (int32_t) emission_temperature - (int32_t) immission_temperature;
+
+	return (uint16_t) interp_lut_get(&duration_lut, delta);
+}
+
+/// Reference conversion, only used to build the lookup table.
+static int32_t calculate_duration_automatic_cycle_reference(int32_t delta) {
 	size_t i;
 
 	if (delta < time_convert[0U].temperature) {
 		return time_convert[0U].time;
 	}
 
-	for (i = 1U; i < sizeof(time_convert); i++) {
+	for (i = 1U; i < ARRAY_SIZE(time_convert); i++) {
 		if (delta < time_convert[i].temperature) {
 			return (uint16_t) (ceiling_fraction(((delta - time_convert[i - 1U].temperature)* ((int16_t )time_convert[i].time- (int16_t )time_convert[i - 1U].time)),(time_convert[i].temperature- time_convert[i - 1U].temperature))+ (int16_t) time_convert[i - 1U].time);
 		}
 	}
 
-	return time_convert[sizeof(time_convert) - 1U].time;
+	return time_convert[ARRAY_SIZE(time_convert) - 1U].time;
 }
 
 static void controller_set(void) {
-	static const uint16_t luminosity_threshold_convert[] = { 0U, LUMINOSITY_THRESHOLD_LOW, LUMINOSITY_THRESHOLD_MEDIUM,LUMINOSITY_THRESHOLD_HIGH };
 	static const uint16_t relative_humidity_threshold_convert[] = { 0U, RH_THRESHOLD_LOW, RH_THRESHOLD_MEDIUM, RH_THRESHOLD_HIGH };
 	static const uint16_t voc_threshold_convert[] = { 0U, VOC_THRESHOLD_LOW, VOC_THRESHOLD_MEDIUM, VOC_THRESHOLD_HIGH };
-	uint8_t speed_set = get_speed_set();
 	uint8_t speed_state = get_speed_state();
-	uint16_t luminosity = get_lux();
+	uint8_t luminosity_state = get_luminosity_state();
 	uint16_t relative_humidity = get_relative_humidity();
 	uint16_t voc = get_voc();
 
-	uint16_t luminosity_threshold = luminosity_threshold_convert[get_lux_set()];
 	uint16_t relative_humidity_threshold = relative_humidity_threshold_convert[get_relative_humidity_set()];
 	uint16_t voc_threshold = voc_threshold_convert[get_voc_set()];
 	static uint8_t cond_flags = 0U;
-	static uint16_t count_luminosity = 0U;
 	static uint8_t count_rh_extra_cycle = 0U;
 	static uint8_t count_voc_extra_cycle = 0U;
 
-	if ((speed_state & ~(SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT)) != speed_set) {
-		speed_state &= (SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT);
+	int32_t relative_humidity_slope = 0;
+	bool relative_humidity_slope_valid;
 
-		speed_state |= speed_set;
+	speed_state = controller_apply_speed_set(speed_state);
 
-		if ((get_mode_state() & MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION) && (speed_state == SPEED_NONE)) {
-			speed_state |= SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT;
-		}
-	}
+	controller_rh_slope_push(relative_humidity);
+	relative_humidity_slope_valid = controller_rh_slope_get(&relative_humidity_slope);
 
 	if (get_mode_set() == MODE_AUTOMATIC_CYCLE) {
 
 		if (!(get_mode_state() & (MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION))) {
 			if (get_lux_set() != LUX_THRESHOLD_SETTING_NOT_CONFIGURED) {
-				printf("LUX: %u - LUX_TH: %u\r\n", luminosity / LUX_SCALE, luminosity_threshold / LUX_SCALE);
-				if ((luminosity != LUX_INVALID) && (luminosity > (luminosity_threshold + LUMINOSITY_DIFFERENTIAL_HIGH))) {
-					if (count_luminosity) {
-						count_luminosity--;
-					} else {
-						cond_flags &= ~COND_LUMINOSITY;
-					}
-				}
-
-				if (luminosity <= (luminosity_threshold - LUMINOSITY_DIFFERENTIAL_LOW)) {
-					if (count_luminosity < CONDITION_COUNT_MAX) {
-						count_luminosity++;
-					} else {
-						if (!(cond_flags & COND_LUMINOSITY)) {
-							cond_flags |= COND_LUMINOSITY;
-							count_luminosity = CONDITION_COUNT_RETURN_LUX;
-						}
-					}
+#if CONTROLLER_VERBOSE
+				printf("LUX: %lu - LUX_STATE: %u\r\n", (unsigned long) (get_lux() / LUX_SCALE), luminosity_state);
+#endif
+				// Crossings come debounced from the LTR303 threshold interrupt
+				if ((luminosity_state == LUMINOSITY_STATE_NIGHT) && !(cond_flags & COND_LUMINOSITY)) {
+					cond_flags |= COND_LUMINOSITY;
+					controller_reason_set(CONTROLLER_REASON_LUX_NIGHT);
+				} else if ((luminosity_state == LUMINOSITY_STATE_DAY) && (cond_flags & COND_LUMINOSITY)) {
+					cond_flags &= ~COND_LUMINOSITY;
+					controller_reason_set(CONTROLLER_REASON_LUX_DAY);
 				}
 			} else {
 				cond_flags &= ~COND_LUMINOSITY;
-				count_luminosity = 0U;
 			}
 
 			if (cond_flags & COND_LUMINOSITY) {
@@ -319,7 +466,9 @@ static void controller_set(void) {
 			}
 
 			if (get_relative_humidity_set() != RH_THRESHOLD_SETTING_NOT_CONFIGURED) {
+#if CONTROLLER_VERBOSE
 				printf("RH: %u.%01u - RH_TH: %u\r\n", RH_RAW_TO_INT(relative_humidity), RH_RAW_TO_DEC(relative_humidity), relative_humidity_threshold / RELATIVE_HUMIDITY_SCALE);
+#endif
 				if ((relative_humidity != TEMPERATURE_INVALID) && (relative_humidity > (relative_humidity_threshold + RH_DIFFERENTIAL_HIGH))) {
 					if (count_rh_extra_cycle < CONDITION_COUNT_MAX) {
 						count_rh_extra_cycle++;
@@ -335,8 +484,22 @@ static void controller_set(void) {
 				count_rh_extra_cycle = 0U;
 			}
 
+			// Steep rise (shower): start at once, without waiting for the static threshold
+			if ((get_relative_humidity_set() != RH_THRESHOLD_SETTING_NOT_CONFIGURED) && relative_humidity_slope_valid &&
+				(get_relative_humidity_slope_threshold() != 0U) && (relative_humidity_slope >= get_relative_humidity_slope_threshold())) {
+#if CONTROLLER_VERBOSE
+				printf("RH slope: %ld.%02u %%/min\r\n", relative_humidity_slope / RELATIVE_HUMIDITY_SCALE, (unsigned) (abs((int) relative_humidity_slope) % RELATIVE_HUMIDITY_SCALE));
+#endif
+				if (!(cond_flags & COND_RH_EXTRA_CYCLE)) {
+					controller_reason_set(CONTROLLER_REASON_RH_SLOPE);
+				}
+				cond_flags |= COND_RH_EXTRA_CYCLE;
+			}
+
 			if (get_voc_set() != VOC_THRESHOLD_SETTING_NOT_CONFIGURED) {
+#if CONTROLLER_VERBOSE
 				printf("VOC: %u - VOC_TH: %u\r\n", voc / VOC_SCALE, voc_threshold / VOC_SCALE);
+#endif
 				if ((voc != VOC_INVALID) && (voc > (voc_threshold + VOC_DIFFERENTIAL_HIGH))) {
 					if (count_voc_extra_cycle < CONDITION_COUNT_MAX) {
 						count_voc_extra_cycle++;
@@ -352,15 +515,29 @@ static void controller_set(void) {
 				count_voc_extra_cycle = 0U;
 			}
 
-			if (cond_flags & (COND_RH_EXTRA_CYCLE | COND_VOC_EXTRA_CYCLE)) {
+			// Outdoor air as wet as indoor air: an RH extra cycle would only cost energy
+			if ((cond_flags & COND_RH_EXTRA_CYCLE) && !controller_ventilation_dries()) {
+				cond_flags &= ~COND_RH_EXTRA_CYCLE;
+				count_rh_extra_cycle = 0U;
+				controller_reason_set(CONTROLLER_REASON_RH_SUPPRESSED);
+			}
+
+			if ((speed_state & ~(SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT)) == SPEED_PROPORTIONAL) {
+				// The airflow follows the excess instead of running extra cycles at boost
+				controller_proportional_update(relative_humidity, relative_humidity_threshold, voc, voc_threshold);
+				controller_reason_set(CONTROLLER_REASON_PROPORTIONAL);
+				cond_flags &= ~(COND_RH_EXTRA_CYCLE | COND_VOC_EXTRA_CYCLE);
+				speed_state &= ~SPEED_AUTOMATIC_CYCLE_FORCE_BOOST;
+			} else if (cond_flags & (COND_RH_EXTRA_CYCLE | COND_VOC_EXTRA_CYCLE)) {
 				if (!(get_mode_state() & MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE)) {
 					if (xSemaphoreTake(extra_cycle_count_sem, 0) == pdPASS) {
 						printf("MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE - [%d]\n", EXTRA_CYCLE_COUNT_MAX - uxSemaphoreGetCount(extra_cycle_count_sem));
+						controller_reason_set(cond_flags & COND_RH_EXTRA_CYCLE ? CONTROLLER_REASON_RH_EXTRA_CYCLE : CONTROLLER_REASON_VOC_EXTRA_CYCLE);
 						set_mode_state(get_mode_state() | MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE);
 						if (speed_state > SPEED_NIGHT) {
 							speed_state |= SPEED_AUTOMATIC_CYCLE_FORCE_BOOST;
 						}
-						xTaskCreate(work_task, "work task", CONTROLLER_TASK_STACK_SIZE, NULL, CONTROLLER_TASK_PRIORITY, NULL);
+						controller_post_event(CONTROLLER_EVENT_EXTRA_CYCLE);
 						if (!xTimerIsTimerActive(restart_extra_cycle_timer)) {
 							xTimerStart(restart_extra_cycle_timer, 0);
 						}
@@ -375,6 +552,8 @@ static void controller_set(void) {
 						cond_flags &= ~(COND_RH_EXTRA_CYCLE | COND_VOC_EXTRA_CYCLE);
 						count_rh_extra_cycle = 0U;
 						count_voc_extra_cycle = 0U;
+					} else {
+						controller_reason_set(CONTROLLER_REASON_EXTRA_CYCLE_LIMIT);
 					}
 				}
 			} else {
@@ -383,39 +562,301 @@ static void controller_set(void) {
 
 		} else {
 			cond_flags = 0U;
-			count_luminosity = 0U;
 			count_rh_extra_cycle = 0U;
 			count_voc_extra_cycle = 0U;
 		}
 	} else {
 		cond_flags = 0U;
-		count_luminosity = 0U;
 		count_rh_extra_cycle = 0U;
 		count_voc_extra_cycle = 0U;
 		speed_state &= ~(SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT);
 	}
 
+	controller_trace.cond.cond_flags = cond_flags;
+	controller_trace.cond.luminosity_state = luminosity_state;
+	controller_trace.cond.count_rh_extra_cycle = count_rh_extra_cycle;
+	controller_trace.cond.count_voc_extra_cycle = count_voc_extra_cycle;
+
 	set_speed_state(speed_state);
 }
 
+static uint8_t controller_apply_speed_set(uint8_t speed_state) {
+	uint8_t speed_set = get_speed_set();
+
+	if ((speed_state & ~(SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT)) != speed_set) {
+		speed_state &= (SPEED_AUTOMATIC_CYCLE_FORCE_BOOST | SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT);
+
+		speed_state |= speed_set;
+
+		if ((get_mode_state() & MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION) && (speed_state == SPEED_NONE)) {
+			speed_state |= SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT;
+		}
+	}
+
+	return speed_state;
+}
+
+static void controller_fan_apply(void) {
+	uint8_t direction = get_direction_state();
+	uint8_t speed = ADJUST_SPEED(get_speed_state());
+
+	if (speed == SPEED_PROPORTIONAL) {
+		if ((get_mode_state() & ~(MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION)) == MODE_AUTOMATIC_CYCLE) {
+			fan_set_percentage(direction, proportional_percentage);
+		} else {
+			// Proportional speed has no meaning outside the automatic cycle
+			fan_set(direction, SPEED_MEDIUM);
+		}
+		return;
+	}
+
+	fan_set(direction, speed);
+}
+
+static uint16_t controller_excess_percentage(uint16_t value, uint16_t threshold, uint16_t invalid, uint16_t span) {
+	uint32_t excess;
+
+	if ((threshold == 0U) || (value == invalid) || (value <= threshold)) {
+		return 0U;
+	}
+
+	excess = ((uint32_t) (value - threshold) * 100U) / span;
+
+	return excess > 100U ? 100U : (uint16_t) excess;
+}
+
+static void controller_proportional_update(uint16_t relative_humidity, uint16_t relative_humidity_threshold, uint16_t voc, uint16_t voc_threshold) {
+	uint16_t rh_excess = 0U;
+	uint16_t voc_excess = 0U;
+	uint16_t demand;
+	uint8_t target;
+
+	if (get_relative_humidity_set() != RH_THRESHOLD_SETTING_NOT_CONFIGURED) {
+		rh_excess = controller_excess_percentage(relative_humidity, relative_humidity_threshold, RELATIVE_HUMIDITY_INVALID, PROPORTIONAL_RH_SPAN);
+	}
+	if (get_voc_set() != VOC_THRESHOLD_SETTING_NOT_CONFIGURED) {
+		voc_excess = controller_excess_percentage(voc, voc_threshold, VOC_INVALID, PROPORTIONAL_VOC_SPAN);
+	}
+
+	demand = rh_excess > voc_excess ? rh_excess : voc_excess;
+	target = (uint8_t) (PROPORTIONAL_PERCENTAGE_MIN + ((PROPORTIONAL_PERCENTAGE_MAX - PROPORTIONAL_PERCENTAGE_MIN) * demand) / 100U);
+
+	// Ramp instead of stepping, the change stays inaudible
+	if (target > proportional_percentage + PROPORTIONAL_PERCENTAGE_STEP) {
+		proportional_percentage += PROPORTIONAL_PERCENTAGE_STEP;
+	} else if (target + PROPORTIONAL_PERCENTAGE_STEP < proportional_percentage) {
+		proportional_percentage -= PROPORTIONAL_PERCENTAGE_STEP;
+	} else {
+		proportional_percentage = target;
+	}
+}
+
+/// True when the outdoor air holds less water than the indoor air, or when it is not known.
+static bool controller_ventilation_dries(void) {
+	int16_t temperature = get_temperature();
+	uint16_t relative_humidity = get_relative_humidity();
+	uint16_t absolute_humidity_in = humidity_absolute(temperature, relative_humidity);
+	uint16_t absolute_humidity_out = get_external_absolute_humidity();
+	uint16_t absolute_humidity_saturation = humidity_absolute_saturation(get_external_temperature());
+#if CONTROLLER_VERBOSE
+	int16_t dew_point_in;
+#endif
+
+	if ((absolute_humidity_in == ABSOLUTE_HUMIDITY_INVALID) || (absolute_humidity_out == ABSOLUTE_HUMIDITY_INVALID)) {
+		return true;
+	}
+
+	// Outdoor air can not hold more water than its saturation at the NTC outdoor temperature
+	if ((absolute_humidity_saturation != ABSOLUTE_HUMIDITY_INVALID) && (absolute_humidity_out > absolute_humidity_saturation)) {
+		absolute_humidity_out = absolute_humidity_saturation;
+	}
+
+	if ((absolute_humidity_out + AH_EXTRA_CYCLE_MARGIN) < absolute_humidity_in) {
+		return true;
+	}
+
+#if CONTROLLER_VERBOSE
+	dew_point_in = humidity_dew_point(temperature, relative_humidity);
+	printf("RH extra cycle suppressed - AH in: %u.%02u g/m3 - AH out: %u.%02u g/m3 - dew point in: %d.%01d\r\n",
+			absolute_humidity_in / ABSOLUTE_HUMIDITY_SCALE, absolute_humidity_in % ABSOLUTE_HUMIDITY_SCALE,
+			absolute_humidity_out / ABSOLUTE_HUMIDITY_SCALE, absolute_humidity_out % ABSOLUTE_HUMIDITY_SCALE,
+			TEMP_RAW_TO_INT(dew_point_in), TEMP_RAW_TO_DEC(dew_point_in));
+#endif
+
+	return false;
+}
+
+static void controller_rh_slope_push(uint16_t relative_humidity) {
+	// A gap breaks the regression, start filling again
+	if (relative_humidity == RELATIVE_HUMIDITY_INVALID) {
+		rh_slope_window.count = 0U;
+		return;
+	}
+
+	rh_slope_window.sample[rh_slope_window.head] = relative_humidity;
+	rh_slope_window.head = (rh_slope_window.head + 1U) % RH_SLOPE_WINDOW;
+
+	if (rh_slope_window.count < RH_SLOPE_WINDOW) {
+		rh_slope_window.count++;
+	}
+}
+
+/// Least squares slope over the full window, in RELATIVE_HUMIDITY_SCALE per minute.
+static bool controller_rh_slope_get(int32_t *slope) {
+	// Slope per sample = sum((2 * i - (N - 1)) * y[i]) / (N * (N^2 - 1) / 6)
+	static const int32_t den = (int32_t) (RH_SLOPE_WINDOW * (RH_SLOPE_WINDOW * RH_SLOPE_WINDOW - 1U)) / 6;
+	int32_t num = 0;
+	size_t idx;
+
+	if (rh_slope_window.count < RH_SLOPE_WINDOW) {
+		return false;
+	}
+
+	// Oldest sample first: head points to it once the window is full
+	idx = rh_slope_window.head;
+	for (int32_t i = 0; i < (int32_t) RH_SLOPE_WINDOW; i++) {
+		num += (2 * i - (int32_t) (RH_SLOPE_WINDOW - 1U)) * (int32_t) rh_slope_window.sample[idx];
+		idx = (idx + 1U) % RH_SLOPE_WINDOW;
+	}
+
+	*slope = (num * 60) / den;
+
+	return true;
+}
+
+/// The first reason raised since the last record wins, called from the controller and worker tasks.
+static void controller_reason_set(uint8_t reason) {
+	taskENTER_CRITICAL(&controller_trace_lock);
+	if (controller_trace.reason == CONTROLLER_REASON_NONE) {
+		controller_trace.reason = reason;
+	}
+	taskEXIT_CRITICAL(&controller_trace_lock);
+}
+
+static void controller_trace_record(void) {
+	struct controller_trace_entry_s *last;
+	struct controller_trace_entry_s entry;
+
+	taskENTER_CRITICAL(&controller_trace_lock);
+	entry.reason = controller_trace.reason;
+	controller_trace.reason = CONTROLLER_REASON_NONE;
+	taskEXIT_CRITICAL(&controller_trace_lock);
+
+	entry.mode_state = get_mode_state();
+	entry.speed_state = get_speed_state();
+	entry.direction_state = get_direction_state();
+
+	// Steady state: keep only what differs from the last decision
+	if (controller_trace.count) {
+		last = &controller_trace.entry[(controller_trace.head + CONTROLLER_TRACE_DEPTH - 1U) % CONTROLLER_TRACE_DEPTH];
+		if ((entry.mode_state == last->mode_state) && (entry.speed_state == last->speed_state) && (entry.direction_state == last->direction_state) &&
+			((entry.reason == CONTROLLER_REASON_NONE) || (entry.reason == last->reason))) {
+			return;
+		}
+	}
+
+	entry.time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	entry.temperature = get_temperature();
+	entry.relative_humidity = get_relative_humidity();
+	entry.voc = get_voc();
+	entry.lux = get_lux();
+	entry.cond_flags = controller_trace.cond.cond_flags;
+	entry.luminosity_state = controller_trace.cond.luminosity_state;
+	entry.count_rh_extra_cycle = controller_trace.cond.count_rh_extra_cycle;
+	entry.count_voc_extra_cycle = controller_trace.cond.count_voc_extra_cycle;
+
+	taskENTER_CRITICAL(&controller_trace_lock);
+	controller_trace.entry[controller_trace.head] = entry;
+	controller_trace.head = (controller_trace.head + 1U) % CONTROLLER_TRACE_DEPTH;
+	if (controller_trace.count < CONTROLLER_TRACE_DEPTH) {
+		controller_trace.count++;
+	}
+	taskEXIT_CRITICAL(&controller_trace_lock);
+}
+
+static void controller_latency_update(void) {
+	if (controller_latency.pending) {
+		controller_latency.pending = false;
+		controller_latency.last_us = (uint32_t) esp_timer_get_time() - controller_latency.command_us;
+
+		if (controller_latency.last_us > controller_latency.max_us) {
+			controller_latency.max_us = controller_latency.last_us;
+		}
+		controller_latency.count++;
+	}
+}
+
 static void reset_automatic_cycle_count(void) {
 	calculate_duration_inversions_count = 0U;
 	extra_cycle_inversions_count = 0U;
+	duration_estimator.valid = false;
 }
 
-static void controller_timer_expiry(TimerHandle_t xTimer) {
-//	printf("Timer_Expired\n");
-	xTaskCreate(work_task, "work task", CONTROLLER_TASK_STACK_SIZE, NULL,CONTROLLER_TASK_PRIORITY, NULL);
+static void duration_estimator_seed(int16_t internal_temperature, int16_t external_temperature) {
+	if ((internal_temperature == TEMPERATURE_INVALID) || (external_temperature == TEMPERATURE_INVALID)) {
+		return;
+	}
 
+	duration_estimator.internal_acc = (int32_t) internal_temperature << DURATION_ESTIMATOR_SHIFT;
+	duration_estimator.external_acc = (int32_t) external_temperature << DURATION_ESTIMATOR_SHIFT;
+	duration_estimator.valid = true;
 }
 
-static void restart_automatic_cycle_timer_expiry(TimerHandle_t xTimer) {
+/// Called at the end of every regular automatic cycle phase, before the direction changes.
+static void duration_estimator_update(uint8_t direction) {
+	int32_t *acc;
+	int16_t temperature;
+	int16_t internal_temperature;
+	int16_t external_temperature;
+	int32_t duration;
+	int32_t target;
+
+	if (!duration_estimator.valid) {
+		return;
+	}
+
+	// The NTC sits in the regenerator: it reads the internal air on the way out, the external one on the way in
+	if (direction == DIRECTION_OUT) {
+		temperature = get_internal_temperature();
+		acc = &duration_estimator.internal_acc;
+	} else if (direction == DIRECTION_IN) {
+		temperature = get_external_temperature();
+		acc = &duration_estimator.external_acc;
+	} else {
+		return;
+	}
+
+	if (temperature == TEMPERATURE_INVALID) {
+		return;
+	}
+
+	*acc += temperature - (*acc >> DURATION_ESTIMATOR_SHIFT);
 
-	set_mode_state(get_mode_state() | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
+	internal_temperature = (int16_t) (duration_estimator.internal_acc >> DURATION_ESTIMATOR_SHIFT);
+	external_temperature = (int16_t) (duration_estimator.external_acc >> DURATION_ESTIMATOR_SHIFT);
+	target = calculate_duration_automatic_cycle(internal_temperature, external_temperature);
 
-	xTimerStart(restart_automatic_cycle_timer, 0);
+	// Move by small steps so a single disturbed phase can not swing the cycle
+	duration = get_automatic_cycle_duration();
+	if (target > duration + DURATION_ESTIMATOR_STEP_MAX) {
+		duration += DURATION_ESTIMATOR_STEP_MAX;
+	} else if (target < duration - DURATION_ESTIMATOR_STEP_MAX) {
+		duration -= DURATION_ESTIMATOR_STEP_MAX;
+	} else {
+		duration = target;
+	}
 
-	printf("MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION - RESET TIMER\n");
+	if (duration != get_automatic_cycle_duration()) {
+		set_automatic_cycle_duration((uint16_t) duration);
+		printf("Int avg: %d.%01d - Ext avg: %d.%01d - duration = %u\n", TEMP_RAW_TO_INT(internal_temperature), TEMP_RAW_TO_DEC(internal_temperature),
+																		TEMP_RAW_TO_INT(external_temperature), TEMP_RAW_TO_DEC(external_temperature),
+																		get_automatic_cycle_duration());
+	}
+}
+
+static void controller_timer_expiry(TimerHandle_t xTimer) {
+//	printf("Timer_Expired\n");
+	controller_post_event(CONTROLLER_EVENT_INVERSION);
 }
 
 static void restart_extra_cycle_timer_expiry(TimerHandle_t xTimer) {
@@ -429,8 +870,90 @@ static void filter_warning_timer_expiry(TimerHandle_t xTimer) {
 }
 
 
+static int controller_post_event(uint8_t event) {
+	// Never block: called from the timer service task as well
+	if (xQueueSend(work_queue, &event, 0) != pdPASS) {
+		taskENTER_CRITICAL(&work_pending_lock);
+		work_pending |= BIT(event);
+		work_dropped++;
+		taskEXIT_CRITICAL(&work_pending_lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+/// Retries the events that found the queue full, the same event is only posted once.
+static void controller_post_pending(void) {
+	uint8_t pending;
+
+	taskENTER_CRITICAL(&work_pending_lock);
+	pending = work_pending;
+	work_pending = 0U;
+	taskEXIT_CRITICAL(&work_pending_lock);
+
+	for (uint8_t event = CONTROLLER_EVENT_INVERSION; pending; event++) {
+		if (pending & BIT(event)) {
+			pending &= ~BIT(event);
+			controller_post_event(event);
+		}
+	}
+}
+
 static void work_task(void *arg) {
+	uint8_t event;
+
+	while (1) {
+		if (xQueueReceive(work_queue, &event, portMAX_DELAY) == pdPASS) {
+			controller_work(event);
+
+			// Apply the new direction without waiting for the next period
+			xTaskNotifyGive(controller_task_handle);
+		}
+	}
+}
+
+static void controller_work(uint8_t event) {
+	switch (event) {
+	case CONTROLLER_EVENT_INVERSION:
+		controller_work_inversion();
+		break;
+
+	case CONTROLLER_EVENT_EXTRA_CYCLE:
+		controller_work_sequence_start(MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE);
+		break;
+
+	case CONTROLLER_EVENT_CALCULATE_DURATION:
+		controller_work_sequence_start(MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/// Extra cycle or calculate duration flagged by the controller task: start its first phase now.
+static void controller_work_sequence_start(uint8_t sequence) {
 	uint8_t mode_state = get_mode_state();
+	uint8_t reason = CONTROLLER_REASON_NONE;
+
+	// Mode changed or sequence cancelled since the event was posted
+	if (((mode_state & ~(MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION)) != MODE_AUTOMATIC_CYCLE) || !(mode_state & sequence)) {
+		return;
+	}
+
+	// A sequence in progress keeps its timer, the flagged one starts on the inversion that ends it
+	if ((calculate_duration_inversions_count != 0U) || (extra_cycle_inversions_count != 0U)) {
+		return;
+	}
+
+	controller_work_sequence(&reason);
+}
+
+/// Phase timer expired.
+static void controller_work_inversion(void) {
+	uint8_t mode_state = get_mode_state();
+	uint8_t reason = CONTROLLER_REASON_INVERSION;
 
 	mode_state &= ~(MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
 	switch (mode_state) {
@@ -456,91 +979,164 @@ static void work_task(void *arg) {
 		break;
 
 	case MODE_AUTOMATIC_CYCLE:
+		// Regular phase completed: refine the duration from the temperatures it ended on
+		if (!(get_mode_state() & (MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE | MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION))) {
+			duration_estimator_update(get_direction_state());
+		}
+
 		if (get_direction_state() == DIRECTION_OUT) {
 			set_direction_state(DIRECTION_IN);
 		} else if (get_direction_state() == DIRECTION_IN) {
 			set_direction_state(DIRECTION_OUT);
 		}
 
-		if (get_mode_state() & MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION) {
-			// Extra cycle not startedwsf
-			if (extra_cycle_inversions_count == 0U) {
-				if (calculate_duration_inversions_count == 0U) {
-					calculate_duration_inversions_count++;
-					set_direction_state(DIRECTION_OUT);
-					xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_AUTOMATIC_CYCLE_OUT_MS), 0);
-					xTimerStart(controller_timer, 0);
+		controller_work_sequence(&reason);
+
+		// The end of a sequence is more telling than the inversion that completed it
+		controller_reason_set(reason);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/// Automatic cycle phase scheduling: calculate duration, extra cycle, then the regular cycle.
+static void controller_work_sequence(uint8_t *reason) {
+	if (get_mode_state() & MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION) {
+		// Extra cycle not startedwsf
+		if (extra_cycle_inversions_count == 0U) {
+			if (calculate_duration_inversions_count == 0U) {
+				calculate_duration_inversions_count++;
+				set_direction_state(DIRECTION_OUT);
+				xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_AUTOMATIC_CYCLE_OUT_MS), 0);
+				xTimerStart(controller_timer, 0);
 //					printf("MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION - START\n");
-				} else if (calculate_duration_inversions_count <= CALCULATE_DURATION_INVERSIONS_MAX) {
+			} else if (calculate_duration_inversions_count <= CALCULATE_DURATION_INVERSIONS_MAX) {
 //					printf("MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION - inversione_count=%d\n", calculate_duration_inversions_count);
-					calculate_duration_inversions_count++;
-					xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_AUTOMATIC_CYCLE_IN_MS), 0);
-					xTimerStart(controller_timer, 0);
-				} else {
-					calculate_duration_inversions_count = 0U;
-					set_automatic_cycle_duration(calculate_duration_automatic_cycle(get_internal_temperature(), get_external_temperature())); // VERIFY the functions inside arguments
-					printf("Int: %d.%01d - Ext: %d.%01d - duration = %u\n", TEMP_RAW_TO_INT(get_internal_temperature()), TEMP_RAW_TO_DEC(get_internal_temperature()),
-																			TEMP_RAW_TO_INT(get_external_temperature()), TEMP_RAW_TO_DEC(get_external_temperature()),
-																			get_automatic_cycle_duration());
-
-					set_mode_state( get_mode_state() & ~MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
+				calculate_duration_inversions_count++;
+				xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_AUTOMATIC_CYCLE_IN_MS), 0);
+				xTimerStart(controller_timer, 0);
+			} else {
+				calculate_duration_inversions_count = 0U;
+				set_automatic_cycle_duration(calculate_duration_automatic_cycle(get_internal_temperature(), get_external_temperature())); // VERIFY the functions inside arguments
+				duration_estimator_seed(get_internal_temperature(), get_external_temperature());
+				printf("Int: %d.%01d - Ext: %d.%01d - duration = %u\n", TEMP_RAW_TO_INT(get_internal_temperature()), TEMP_RAW_TO_DEC(get_internal_temperature()),
+																		TEMP_RAW_TO_INT(get_external_temperature()), TEMP_RAW_TO_DEC(get_external_temperature()),
+																		get_automatic_cycle_duration());
+
+				set_mode_state( get_mode_state() & ~MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION);
+				*reason = CONTROLLER_REASON_DURATION_DONE;
 //				    printf("MODE_AUTOMATIC_CYCLE_CALCULATE_DURATION - STOP\n");
 
-				}
 			}
 		}
+	}
 
-		if (get_mode_state() & MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE) {
-			// Calculate duration not started
-			if (calculate_duration_inversions_count == 0U) {
-				if (extra_cycle_inversions_count == 0U) {
-					extra_cycle_inversions_count++;
-					set_direction_state(DIRECTION_OUT);
-					xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_EXTRA_CYCLE_BOOST_MS), 0);
-					xTimerStart(controller_timer, 0);
+	if (get_mode_state() & MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE) {
+		// Calculate duration not started
+		if (calculate_duration_inversions_count == 0U) {
+			if (extra_cycle_inversions_count == 0U) {
+				extra_cycle_inversions_count++;
+				set_direction_state(DIRECTION_OUT);
+				xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_EXTRA_CYCLE_BOOST_MS), 0);
+				xTimerStart(controller_timer, 0);
 //					printf("MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE - START\n");
-				} else if (extra_cycle_inversions_count <= EXTRA_CYCLE_INVERSIONS_MAX) {
-					extra_cycle_inversions_count++;
-					set_speed_state(get_speed_state() & ~SPEED_AUTOMATIC_CYCLE_FORCE_BOOST);
-					xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_FIXED_CYCLE_MS), 0);
-					xTimerStart(controller_timer, 0);
-				} else {
-					extra_cycle_inversions_count = 0U;
-					set_mode_state( get_mode_state() & ~MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE);
+			} else if (extra_cycle_inversions_count <= EXTRA_CYCLE_INVERSIONS_MAX) {
+				extra_cycle_inversions_count++;
+				set_speed_state(get_speed_state() & ~SPEED_AUTOMATIC_CYCLE_FORCE_BOOST);
+				xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(DURATION_FIXED_CYCLE_MS), 0);
+				xTimerStart(controller_timer, 0);
+			} else {
+				extra_cycle_inversions_count = 0U;
+				set_mode_state( get_mode_state() & ~MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE);
+				*reason = CONTROLLER_REASON_EXTRA_CYCLE_DONE;
 //					printf("MODE_AUTOMATIC_CYCLE_EXTRA_CYCLE - STOP\n");
-				}
 			}
 		}
+	}
 
-		// Calculate duration and Extra cycle not started
-		if ((calculate_duration_inversions_count == 0U) && (extra_cycle_inversions_count == 0U)) {
-			xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(SECONDS_TO_MS(get_automatic_cycle_duration())), 0);
-			xTimerStart(controller_timer, 0);
-		}
+	// Calculate duration and Extra cycle not started
+	if ((calculate_duration_inversions_count == 0U) && (extra_cycle_inversions_count == 0U)) {
+		xTimerChangePeriod(controller_timer, pdMS_TO_TICKS(SECONDS_TO_MS(get_automatic_cycle_duration())), 0);
+		xTimerStart(controller_timer, 0);
+	}
+}
 
-		break;
+void controller_notify_setting_changed(void) {
+	if (controller_task_handle == NULL) {
+		return;
+	}
 
-	default:
-		break;
+	if (!controller_latency.pending) {
+		controller_latency.command_us = (uint32_t) esp_timer_get_time();
+		controller_latency.pending = true;
 	}
-	// Delete this task once the function finishes executing
-	vTaskDelete(NULL);
+
+	xTaskNotifyGive(controller_task_handle);
+}
+
+uint8_t controller_get_proportional_percentage(void) {
+	return proportional_percentage;
+}
+
+uint16_t controller_trace_count(void) {
+	return controller_trace.count;
+}
+
+/// Index 0 is the most recent decision.
+int controller_trace_get(uint16_t index, struct controller_trace_entry_s *entry) {
+	int ret = -1;
+
+	taskENTER_CRITICAL(&controller_trace_lock);
+	if (index < controller_trace.count) {
+		*entry = controller_trace.entry[(controller_trace.head + CONTROLLER_TRACE_DEPTH - 1U - index) % CONTROLLER_TRACE_DEPTH];
+		ret = 0;
+	}
+	taskEXIT_CRITICAL(&controller_trace_lock);
+
+	return ret;
+}
+
+void controller_get_latency(uint32_t *last_us, uint32_t *max_us, uint32_t *count) {
+	*last_us = controller_latency.last_us;
+	*max_us = controller_latency.max_us;
+	*count = controller_latency.count;
+}
+
+/// Events that found the worker queue full, each one was retried.
+uint32_t controller_get_work_dropped(void) {
+	return work_dropped;
+}
+
+/// Same event as a phase timer expiry, for the console heap check.
+int controller_post_inversion(void) {
+	if (work_queue == NULL) {
+		return -1;
+	}
+
+	return controller_post_event(CONTROLLER_EVENT_INVERSION);
 }
 
 int controller_init() {
 	// Initialization of the semaphore
 	extra_cycle_count_sem = xSemaphoreCreateCounting(EXTRA_CYCLE_COUNT_MAX, EXTRA_CYCLE_COUNT_MAX);
 
+	interp_lut_build(&duration_lut);
+
+	// Worker queue and task are allocated once, the inversions only post events
+	work_queue = xQueueCreate(CONTROLLER_WORK_QUEUE_LENGTH, sizeof(uint8_t));
+
 	// Create the timer
 	controller_timer = xTimerCreate("controller_timer", pdMS_TO_TICKS(1000), pdFALSE, (void*) 0, controller_timer_expiry);
 
-	restart_automatic_cycle_timer = xTimerCreate("restart_automatic_cycle_timer", pdMS_TO_TICKS(DURATION_RESTART_AUTOMATIC_CYCLE_MS), pdFALSE, (void*) 0, restart_automatic_cycle_timer_expiry);
-
 	restart_extra_cycle_timer = xTimerCreate("restart_extra_cycle_timer", pdMS_TO_TICKS(DURATION_RESTART_EXTRA_CYCLE_MS), pdFALSE, (void*) 0, restart_extra_cycle_timer_expiry);
 
 	filter_warning_timer = xTimerCreate("filter_warning_timer", pdMS_TO_TICKS(CONTROLLER_FILTER_WARNING_PERIOD_MS), pdFALSE, (void *) 0, filter_warning_timer_expiry);
 
-	BaseType_t controller_task_created = xTaskCreate(controller_task, "Controller task ", CONTROLLER_TASK_STACK_SIZE, NULL, CONTROLLER_TASK_PRIORITY, NULL);
+	BaseType_t work_task_created = xTaskCreate(work_task, "work task", CONTROLLER_TASK_STACK_SIZE, NULL, CONTROLLER_TASK_PRIORITY, NULL);
+
+	BaseType_t controller_task_created = xTaskCreate(controller_task, "Controller task ", CONTROLLER_TASK_STACK_SIZE, NULL, CONTROLLER_TASK_PRIORITY, &controller_task_handle);
 
-	return ( (controller_task_created) == pdPASS ? 0 : -1);
+	return ( (work_queue != NULL) && (work_task_created == pdPASS) && (controller_task_created == pdPASS) ? 0 : -1);
 }
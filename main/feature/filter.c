@@ -0,0 +1,135 @@
+/*
+ * filter.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#include <stdlib.h>
+
+#include "filter.h"
+
+/// Insertion sort into a stack copy, count is at most FILTER_WINDOW_MAX.
+int32_t filter_median(const int32_t *values, size_t count) {
+	int32_t sorted[FILTER_WINDOW_MAX];
+	int32_t val;
+	size_t i;
+	size_t j;
+
+	if (count > FILTER_WINDOW_MAX) {
+		count = FILTER_WINDOW_MAX;
+	}
+
+	for (i = 0U; i < count; i++) {
+		val = values[i];
+
+		for (j = i; (j > 0U) && (sorted[j - 1U] > val); j--) {
+			sorted[j] = sorted[j - 1U];
+		}
+		sorted[j] = val;
+	}
+
+	return sorted[count / 2U];
+}
+
+static int32_t filter_ema_output(int32_t ema) {
+	int32_t half = 1 << (FILTER_EMA_FRACTION_BITS - 1U);
+
+	return (ema >= 0 ? ema + half : ema - half) / (1 << FILTER_EMA_FRACTION_BITS);
+}
+
+int filter_init(struct filter_s *filter, const struct filter_config_s *config) {
+	if ((config->window == 0U) || (config->window > FILTER_WINDOW_MAX) || !(config->window & 1U) ||
+			(config->ema_shift >= FILTER_EMA_FRACTION_BITS) || (config->mad_min < 0)) {
+		return -1;
+	}
+
+	filter->config = *config;
+	filter_reset(filter);
+
+	filter->samples = 0U;
+	filter->rejected = 0U;
+	filter->invalid = 0U;
+
+	return 0;
+}
+
+/// Restart from an empty window, the statistics are kept.
+void filter_reset(struct filter_s *filter) {
+	filter->index = 0U;
+	filter->count = 0U;
+	filter->invalid_count = 0U;
+	filter->ema_valid = false;
+	filter->ema = 0;
+}
+
+/// Returns -1 until a first valid sample and after FILTER_INVALID_HOLD invalid ones in a row.
+int filter_update(struct filter_s *filter, int32_t sample, bool valid, int32_t *output) {
+	const struct filter_config_s *config = &filter->config;
+	int32_t median;
+	int32_t deviation[FILTER_WINDOW_MAX];
+	int32_t mad;
+	int32_t value;
+
+	if (!valid) {
+		filter->invalid++;
+
+		if (filter->invalid_count < FILTER_INVALID_HOLD) {
+			filter->invalid_count++;
+		}
+
+		if ((filter->invalid_count >= FILTER_INVALID_HOLD) || !filter->ema_valid) {
+			filter_reset(filter);
+
+			return -1;
+		}
+
+		*output = filter_ema_output(filter->ema);
+
+		return 0;
+	}
+
+	filter->samples++;
+	filter->invalid_count = 0U;
+
+	filter->window[filter->index] = sample;
+	filter->index = (filter->index + 1U) % config->window;
+	if (filter->count < config->window) {
+		filter->count++;
+	}
+
+	value = sample;
+
+	if (config->window > 1U) {
+		median = filter_median(filter->window, filter->count);
+
+		if (config->hampel_k == 0U) {
+			value = median;
+		} else if (filter->count >= 3U) {
+			for (size_t i = 0U; i < filter->count; i++) {
+				deviation[i] = abs((int) (filter->window[i] - median));
+			}
+
+			mad = filter_median(deviation, filter->count);
+			if (mad < config->mad_min) {
+				mad = config->mad_min;
+			}
+
+			// |x - m| > k / 10 * 1.4826 * MAD
+			if ((int64_t) abs((int) (sample - median)) * 10000 > (int64_t) config->hampel_k * FILTER_MAD_SCALE_PERMILLE * mad) {
+				filter->rejected++;
+				value = median;
+			}
+		}
+	}
+
+	if ((config->ema_shift == 0U) || !filter->ema_valid) {
+		filter->ema = value * (1 << FILTER_EMA_FRACTION_BITS);
+	} else {
+		filter->ema += (value * (1 << FILTER_EMA_FRACTION_BITS) - filter->ema) / (1 << config->ema_shift);
+	}
+	filter->ema_valid = true;
+
+	*output = filter_ema_output(filter->ema);
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * humidity.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#include "humidity.h"
+
+#define HUMIDITY_TABLE_TEMPERATURE_MIN		(-20 * TEMPERATURE_SCALE)
+#define HUMIDITY_TABLE_TEMPERATURE_STEP		(5 * TEMPERATURE_SCALE)
+
+#define WATER_VAPOR_CONSTANT				(21668L)		// 1 / Rv (g.K/(m3.Pa)) * 10^4: e * 21668 / T (dK) gives mg/m3
+#define KELVIN_OFFSET						(27315L)		// TEMPERATURE_SCALE
+
+/// Saturation vapor pressure over water (Pa), every 5 celsius from -20 to 50.
+static const uint16_t saturation_pressure[] = {
+		125U, 191U, 286U, 422U, 611U, 872U, 1228U, 1705U,
+		2339U, 3169U, 4246U, 5628U, 7384U, 9593U, 12352U,
+};
+
+#define HUMIDITY_TABLE_TEMPERATURE_MAX		(HUMIDITY_TABLE_TEMPERATURE_MIN + (int32_t) (ARRAY_SIZE(saturation_pressure) - 1U) * HUMIDITY_TABLE_TEMPERATURE_STEP)
+
+/// Saturation vapor pressure (Pa), linear between the table nodes.
+static int32_t saturation_pressure_get(int16_t temperature) {
+	int32_t offset;
+	size_t i;
+
+	if (temperature <= HUMIDITY_TABLE_TEMPERATURE_MIN) {
+		return saturation_pressure[0];
+	}
+	if (temperature >= HUMIDITY_TABLE_TEMPERATURE_MAX) {
+		return saturation_pressure[ARRAY_SIZE(saturation_pressure) - 1U];
+	}
+
+	offset = temperature - HUMIDITY_TABLE_TEMPERATURE_MIN;
+	i = offset / HUMIDITY_TABLE_TEMPERATURE_STEP;
+	offset %= HUMIDITY_TABLE_TEMPERATURE_STEP;
+
+	return saturation_pressure[i] + ((saturation_pressure[i + 1U] - saturation_pressure[i]) * offset) / HUMIDITY_TABLE_TEMPERATURE_STEP;
+}
+
+/// Absolute humidity (ABSOLUTE_HUMIDITY_SCALE) of air with a vapor pressure in Pa.
+static uint16_t vapor_pressure_to_absolute(int32_t pressure, int16_t temperature) {
+	int32_t temperature_dk = (temperature + KELVIN_OFFSET) / 10;
+
+	// rho = e / (Rv * T), e * 21668 stays below 2^31 on the whole table
+	return (uint16_t) ((((pressure * WATER_VAPOR_CONSTANT) / temperature_dk) * ABSOLUTE_HUMIDITY_SCALE + 500L) / 1000L);
+}
+
+uint16_t humidity_absolute(int16_t temperature, uint16_t relative_humidity) {
+	int32_t pressure;
+
+	if ((temperature == TEMPERATURE_INVALID) || (relative_humidity == RELATIVE_HUMIDITY_INVALID)) {
+		return ABSOLUTE_HUMIDITY_INVALID;
+	}
+
+	pressure = (saturation_pressure_get(temperature) * relative_humidity) / (100L * RELATIVE_HUMIDITY_SCALE);
+
+	return vapor_pressure_to_absolute(pressure, temperature);
+}
+
+uint16_t humidity_absolute_saturation(int16_t temperature) {
+	if (temperature == TEMPERATURE_INVALID) {
+		return ABSOLUTE_HUMIDITY_INVALID;
+	}
+
+	return vapor_pressure_to_absolute(saturation_pressure_get(temperature), temperature);
+}
+
+/// Relative humidity of the same air brought to another temperature, the vapor pressure is kept.
+uint16_t humidity_relative_at(int16_t temperature, uint16_t relative_humidity, int16_t new_temperature) {
+	int32_t relative;
+
+	if ((temperature == TEMPERATURE_INVALID) || (relative_humidity == RELATIVE_HUMIDITY_INVALID) || (new_temperature == TEMPERATURE_INVALID)) {
+		return RELATIVE_HUMIDITY_INVALID;
+	}
+
+	relative = (relative_humidity * saturation_pressure_get(temperature)) / saturation_pressure_get(new_temperature);
+
+	return (uint16_t) (relative > (int32_t) (100L * RELATIVE_HUMIDITY_SCALE) ? 100L * RELATIVE_HUMIDITY_SCALE : relative);
+}
+
+int16_t humidity_dew_point(int16_t temperature, uint16_t relative_humidity) {
+	int32_t pressure;
+	size_t i;
+
+	if ((temperature == TEMPERATURE_INVALID) || (relative_humidity == RELATIVE_HUMIDITY_INVALID)) {
+		return TEMPERATURE_INVALID;
+	}
+
+	pressure = (saturation_pressure_get(temperature) * relative_humidity) / (100L * RELATIVE_HUMIDITY_SCALE);
+
+	// Temperature at which the vapor pressure saturates: inverse lookup in the same table
+	if (pressure <= saturation_pressure[0]) {
+		return HUMIDITY_TABLE_TEMPERATURE_MIN;
+	}
+
+	for (i = 1U; i < ARRAY_SIZE(saturation_pressure); i++) {
+		if (pressure < saturation_pressure[i]) {
+			return (int16_t) (HUMIDITY_TABLE_TEMPERATURE_MIN + (int32_t) (i - 1U) * HUMIDITY_TABLE_TEMPERATURE_STEP
+					+ ((pressure - saturation_pressure[i - 1U]) * HUMIDITY_TABLE_TEMPERATURE_STEP) / (saturation_pressure[i] - saturation_pressure[i - 1U]));
+		}
+	}
+
+	return (int16_t) HUMIDITY_TABLE_TEMPERATURE_MAX;
+}
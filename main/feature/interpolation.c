@@ -0,0 +1,83 @@
+/*
+ * interpolation.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#include "esp_cpu.h"
+
+#include "interpolation.h"
+
+#define INTERP_BENCHMARK_ITERATIONS		(1000U)
+#define INTERP_BENCHMARK_STEP			(37)
+
+static const struct interp_lut_s *interp_lut_registered[INTERP_LUT_MAX_REGISTERED];
+static size_t interp_lut_registered_count = 0U;
+
+int interp_lut_build(struct interp_lut_s *lut) {
+	if ((lut == NULL) || (lut->reference == NULL) || (lut->y == NULL) || (lut->size < 2U)) {
+		return -1;
+	}
+
+	for (size_t i = 0U; i < lut->size; i++) {
+		lut->y[i] = (int16_t) lut->reference(lut->x_min + (int32_t) (i << lut->shift));
+	}
+
+	if (interp_lut_registered_count < INTERP_LUT_MAX_REGISTERED) {
+		interp_lut_registered[interp_lut_registered_count++] = lut;
+	}
+
+	return 0;
+}
+
+void interp_lut_benchmark(void) {
+	for (size_t i = 0U; i < interp_lut_registered_count; i++) {
+		const struct interp_lut_s *lut = interp_lut_registered[i];
+		int32_t range = (int32_t) ((uint32_t) (lut->size - 1U) << lut->shift);
+		volatile int32_t sink;
+		int32_t err_max = 0;
+		int32_t x;
+		uint32_t start;
+		uint32_t reference_cycles;
+		uint32_t lut_cycles;
+
+		// Same pseudo-random walk over the table range for both implementations
+		x = lut->x_min;
+		start = esp_cpu_get_cycle_count();
+		for (uint32_t n = 0U; n < INTERP_BENCHMARK_ITERATIONS; n++) {
+			sink = lut->reference(x);
+			x += INTERP_BENCHMARK_STEP;
+			if (x >= lut->x_min + range) {
+				x -= range;
+			}
+		}
+		reference_cycles = esp_cpu_get_cycle_count() - start;
+
+		x = lut->x_min;
+		start = esp_cpu_get_cycle_count();
+		for (uint32_t n = 0U; n < INTERP_BENCHMARK_ITERATIONS; n++) {
+			sink = interp_lut_get(lut, x);
+			x += INTERP_BENCHMARK_STEP;
+			if (x >= lut->x_min + range) {
+				x -= range;
+			}
+		}
+		lut_cycles = esp_cpu_get_cycle_count() - start;
+		(void) sink;
+
+		for (x = lut->x_min; x < lut->x_min + range; x++) {
+			int32_t err = abs((int) (lut->reference(x) - interp_lut_get(lut, x)));
+
+			if (err > err_max) {
+				err_max = err;
+			}
+		}
+
+		printf("%s: reference %lu cycles - lut %lu cycles - max error %ld (%u nodes)\n",
+				lut->name,
+				reference_cycles / INTERP_BENCHMARK_ITERATIONS,
+				lut_cycles / INTERP_BENCHMARK_ITERATIONS,
+				err_max,
+				lut->size);
+	}
+}
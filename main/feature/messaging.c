@@ -48,6 +48,7 @@ static void th_lux_callback(char *pnt_data, size_t length);
 static void th_voc_callback(char *pnt_data, size_t length);
 static void offset_rh_callback(char *pnt_data, size_t length);
 static void offset_t_callback(char *pnt_data, size_t length);
+static void slope_rh_callback(char *pnt_data, size_t length);
 
 static const struct custom_command_s custom_commands_table[] = {
 	{ 	BLUFI_CMD_OTA,		    	ota_callback	         	},
@@ -68,6 +69,7 @@ static const struct custom_command_s custom_commands_table[] = {
 	{   BLUFI_CMD_TH_VOC,           th_voc_callback             },
 	{   BLUFI_CMD_OFFSET_RH,        offset_rh_callback          },
 	{   BLUFI_CMD_OFFSET_T,         offset_t_callback           },
+	{   BLUFI_CMD_SLOPE_RH,         slope_rh_callback           },
 };
 
 int ble_analyse_received_data(const uint8_t *data, uint32_t data_len) {
@@ -342,33 +344,24 @@ static void factory_callback(char *pnt_data, size_t length) {
 static void th_rh_callback(char *pnt_data, size_t length) {
 	uint8_t th_rh = (uint8_t) (pnt_data[0]);
 
-	if (th_rh < 0x34 && th_rh >= 0x30) {
-		th_rh -= 0x30;
-        set_relative_humidity_set(th_rh);
-	}
-    else {
+	// The setter bounds the upper end
+	if ((th_rh < 0x30) || set_relative_humidity_set(th_rh - 0x30)) {
         printf("Received RH THRESHOLD data exceeds the storage limit.\n");
     }
 }
 static void th_lux_callback(char *pnt_data, size_t length) {
 	uint8_t th_lux = (uint8_t) (pnt_data[0]);
 
-	if (th_lux < 0x34 && th_lux >= 0x30) {
-		th_lux -= 0x30;
-        set_lux_set(th_lux);
-	}
-    else {
+	// The setter bounds the upper end
+	if ((th_lux < 0x30) || set_lux_set(th_lux - 0x30)) {
         printf("Received LUX THRESHOLD data exceeds the storage limit.\n");
     }
 }
 static void th_voc_callback(char *pnt_data, size_t length) {
 	uint8_t th_voc = (uint8_t) (pnt_data[0]);
 
-	if (th_voc < 0x34 && th_voc >= 0x30) {
-		th_voc -= 0x30;
-        set_voc_set(th_voc);
-	}
-    else {
+	// The setter bounds the upper end
+	if ((th_voc < 0x30) || set_voc_set(th_voc - 0x30)) {
         printf("Received VOC THRESHOLD data exceeds the storage limit.\n");
     }
 }
@@ -376,19 +369,23 @@ static void th_voc_callback(char *pnt_data, size_t length) {
 static void offset_rh_callback(char *pnt_data, size_t length) {
 	int offset = atoi(pnt_data);
 
-	 if (offset >= OFFSET_BOUND_MIN && offset <= OFFSET_BOUND_MAX) {
-	     set_relative_humidity_offset(offset);
-	  } else {
-	     printf("Received offset is outside the allowed range (-50 to 50).\n");
-	  }
+	if ((offset < INT16_MIN) || (offset > INT16_MAX) || set_relative_humidity_offset((int16_t) offset)) {
+		printf("Received offset is outside the allowed range (-50 to 50).\n");
+	}
 }
 
 static void offset_t_callback(char *pnt_data, size_t length) {
 	int offset = atoi(pnt_data);
 
-	 if (offset >= OFFSET_BOUND_MIN && offset <= OFFSET_BOUND_MAX) {
-	     set_temperature_offset(offset);
-	  } else {
-	     printf("Received offset is outside the allowed range (-50 to 50).\n");
-	  }
+	if ((offset < INT16_MIN) || (offset > INT16_MAX) || set_temperature_offset((int16_t) offset)) {
+		printf("Received offset is outside the allowed range (-50 to 50).\n");
+	}
+}
+
+static void slope_rh_callback(char *pnt_data, size_t length) {
+	int slope = atoi(pnt_data);
+
+	if (slope < 0 || set_relative_humidity_slope_threshold((uint16_t) slope)) {
+		printf("Received RH SLOPE is outside the allowed range (0 to %u).\n", RH_SLOPE_THRESHOLD_MAX);
+	}
 }
@@ -18,6 +18,7 @@
 #include <storage.h>
 #include <blufi.h>
 #include "protocol.h"
+#include "controller.h"
 
 static uint8_t calculate_crc(const void *buf, size_t len);
 static int proto_prepare_trame(uint8_t funct, const void *buf, size_t len, uint8_t *out_data, size_t *out_data_size);
@@ -280,6 +281,34 @@ int proto_prepare_answer_voluntary(uint8_t funct, uint16_t obj_id, uint16_t inde
 			break;
 		}
 
+		case PROTOCOL_OBJID_TRACE:
+		{
+			struct controller_trace_entry_s entry;
+
+			if (controller_trace_get(index, &entry)) {
+				return -1;
+			}
+
+			content.data.trace.count = convert_big_endian_16(controller_trace_count());
+			content.data.trace.time_ms = convert_big_endian_32(entry.time_ms);
+			content.data.trace.temperature = convert_big_endian_16(entry.temperature);
+			content.data.trace.relative_humidity = convert_big_endian_16(entry.relative_humidity);
+			content.data.trace.voc = convert_big_endian_16(entry.voc);
+			content.data.trace.lux = convert_big_endian_32(entry.lux);
+			content.data.trace.cond_flags = entry.cond_flags;
+			content.data.trace.luminosity_state = entry.luminosity_state;
+			content.data.trace.count_rh_extra_cycle = entry.count_rh_extra_cycle;
+			content.data.trace.count_voc_extra_cycle = entry.count_voc_extra_cycle;
+			content.data.trace.mode_state = entry.mode_state;
+			content.data.trace.speed_state = entry.speed_state;
+			content.data.trace.direction_state = entry.direction_state;
+			content.data.trace.reason = entry.reason;
+
+			len = SIZEOF_CONTENT(content.data.trace);
+
+			break;
+		}
+
 		default:
 			return -1;
 	}
@@ -305,11 +334,12 @@ static int proto_parse_query_data(const void *buf, uint8_t *out_data, size_t *ou
 	uint16_t index;
 
 	obj_id = convert_big_endian_16(content->obj_id);
-	index = convert_big_endian_32(content->index);
+	index = convert_big_endian_16(content->index);
 
 	if ((obj_id != PROTOCOL_OBJID_INFO) && (obj_id != PROTOCOL_OBJID_CONF) && (obj_id != PROTOCOL_OBJID_ADV_CONF) &&
 		(obj_id != PROTOCOL_OBJID_WIFI_CONF) && (obj_id != PROTOCOL_OBJID_PROFILE) && (obj_id != PROTOCOL_OBJID_CLOCK) &&
-		(obj_id != PROTOCOL_OBJID_OPER) && (obj_id != PROTOCOL_OBJID_STATS) && (obj_id != PROTOCOL_OBJID_MASTER_STATE) && (obj_id != PROTOCOL_OBJID_STATE)) {
+		(obj_id != PROTOCOL_OBJID_OPER) && (obj_id != PROTOCOL_OBJID_STATS) && (obj_id != PROTOCOL_OBJID_MASTER_STATE) && (obj_id != PROTOCOL_OBJID_STATE) &&
+		(obj_id != PROTOCOL_OBJID_TRACE)) {
 
 		proto_prepare_nack(PROTOCOL_NACK_CODE_QUERY_ERR, PROTOCOL_FUNCT_QUERY, obj_id, out_data, out_data_size);
 		return -1;
@@ -320,6 +350,11 @@ static int proto_parse_query_data(const void *buf, uint8_t *out_data, size_t *ou
 	    return -1;
 	}
 
+	if ((obj_id == PROTOCOL_OBJID_TRACE) && (index >= controller_trace_count())) {
+		proto_prepare_nack(PROTOCOL_NACK_CODE_QUERY_ERR, PROTOCOL_FUNCT_QUERY, obj_id, out_data, out_data_size);
+		return -1;
+	}
+
     proto_prepare_answer_voluntary(PROTOCOL_FUNCT_ANSWER, obj_id, index, out_data, out_data_size);
     return 0;
 }
@@ -340,11 +375,7 @@ static int proto_parse_write_data(const void *buf, uint8_t *out_data, size_t *ou
 				return -1;
 			}
 
-			if ((content->data.conf.rh_setting != RH_THRESHOLD_SETTING_NOT_CONFIGURED) &&
-				(content->data.conf.rh_setting  < RH_THRESHOLD_SETTING_LOW) &&
-				(content->data.conf.rh_setting  > RH_THRESHOLD_SETTING_HIGH) &&
-				(content->data.conf.rh_setting != VALUE_UNMODIFIED)) {
-
+			if ((content->data.conf.rh_setting > RH_THRESHOLD_SETTING_HIGH) && (content->data.conf.rh_setting != VALUE_UNMODIFIED)) {
 				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id, out_data, out_data_size);
 				return -1;
 			}
@@ -354,11 +385,7 @@ static int proto_parse_write_data(const void *buf, uint8_t *out_data, size_t *ou
 				return -1;
 			}
 
-			if ((content->data.conf.voc_setting != VOC_THRESHOLD_SETTING_NOT_CONFIGURED) &&
-				(content->data.conf.voc_setting  < VOC_THRESHOLD_SETTING_LOW) &&
-				(content->data.conf.voc_setting > VOC_THRESHOLD_SETTING_HIGH) &&
-				(content->data.conf.voc_setting != VALUE_UNMODIFIED)) {
-
+			if ((content->data.conf.voc_setting > VOC_THRESHOLD_SETTING_HIGH) && (content->data.conf.voc_setting != VALUE_UNMODIFIED)) {
 				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id, out_data, out_data_size);
 				return -1;
 			}
@@ -373,14 +400,13 @@ static int proto_parse_write_data(const void *buf, uint8_t *out_data, size_t *ou
 				return -1;
 			}
 
-			if (content->data.conf.rh_setting != VALUE_UNMODIFIED) {
-				set_relative_humidity_set(content->data.conf.rh_setting);
-			}
-			if (content->data.conf.lux_setting != VALUE_UNMODIFIED) {
-				set_lux_set(content->data.conf.lux_setting);
-			}
-			if (content->data.conf.voc_setting != VALUE_UNMODIFIED) {
-				set_voc_set(content->data.conf.voc_setting);
+			// The setters reject what the schema does not allow, the checks above keep the write all or nothing
+			if (((content->data.conf.rh_setting != VALUE_UNMODIFIED) && set_relative_humidity_set(content->data.conf.rh_setting)) ||
+				((content->data.conf.lux_setting != VALUE_UNMODIFIED) && set_lux_set(content->data.conf.lux_setting)) ||
+				((content->data.conf.voc_setting != VALUE_UNMODIFIED) && set_voc_set(content->data.conf.voc_setting))) {
+
+				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id, out_data, out_data_size);
+				return -1;
 			}
 		    break;
 		}
@@ -400,12 +426,12 @@ static int proto_parse_write_data(const void *buf, uint8_t *out_data, size_t *ou
 				return -1;
 			}
 
-		    if (temperature_offset != VALUE_UNMODIFIED_LONG) {
-		        set_temperature_offset(temperature_offset);
-		    }
-		    if (humidity_offset != VALUE_UNMODIFIED_LONG) {
-		    	set_relative_humidity_offset(humidity_offset);
-		    }
+			if (((temperature_offset != VALUE_UNMODIFIED_LONG) && set_temperature_offset(temperature_offset)) ||
+				((humidity_offset != VALUE_UNMODIFIED_LONG) && set_relative_humidity_offset(humidity_offset))) {
+
+				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id, out_data, out_data_size);
+				return -1;
+			}
 
 		    break;
 		}
@@ -478,14 +504,16 @@ static int proto_parse_write_data(const void *buf, uint8_t *out_data, size_t *ou
 			}
 
 			if (((content->data.oper.mode_setting != MODE_AUTOMATIC_CYCLE) && (content->data.oper.speed_setting > SPEED_HIGH)) ||
-				((content->data.oper.mode_setting == MODE_AUTOMATIC_CYCLE) && (content->data.oper.speed_setting > SPEED_HIGH))) {
+				((content->data.oper.mode_setting == MODE_AUTOMATIC_CYCLE) && (content->data.oper.speed_setting > SPEED_HIGH) && (content->data.oper.speed_setting != SPEED_PROPORTIONAL))) {
 
 				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id , out_data, out_data_size);
 				return -1;
 			}
 
-			set_mode_set(content->data.oper.mode_setting);
-			set_speed_set(content->data.oper.speed_setting);
+			if (set_mode_set(content->data.oper.mode_setting) || set_speed_set(content->data.oper.speed_setting)) {
+				proto_prepare_nack(PROTOCOL_NACK_CODE_WRITE_ERR, PROTOCOL_FUNCT_WRITE, obj_id, out_data, out_data_size);
+				return -1;
+			}
 			break;
 		}
 
@@ -0,0 +1,220 @@
+/*
+ * self_heating.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "self_heating.h"
+
+/// Calibration: normal equations of the least squares fit in integer sums, 0.01 C and per mille inputs.
+/// A day of 1 s rows stays far below the int64 range.
+struct self_heating_calib_s {
+	int16_t reference;			// TEMPERATURE_INVALID: internal NTC temperature of the settled out phases
+	uint32_t samples;
+	int64_t a[SELF_HEATING_FEATURES][SELF_HEATING_FEATURES];
+	int64_t b[SELF_HEATING_FEATURES];
+	int64_t yy;
+	int32_t min[SELF_HEATING_FEATURES];
+	int32_t max[SELF_HEATING_FEATURES];
+};
+
+// Two runs: start prepares the idle one and swaps it in, the lock only covers the swap and the sums
+static struct self_heating_calib_s calib_buffer[2];
+static struct self_heating_calib_s *calib = &calib_buffer[0];
+static bool calib_running;
+
+static portMUX_TYPE calib_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// Rise of the SHT4x above the ambient air for the current load, TEMPERATURE_SCALE.
+int32_t self_heating_rise(const struct self_heating_s *model, const struct self_heating_load_s *load, int16_t t_sht) {
+	int32_t rise = model->offset + (model->fan * load->duty) / 1000;
+
+	if (load->t_die != TEMPERATURE_INVALID) {
+		rise += (model->die * (load->t_die - t_sht)) / 1000;
+	}
+	if (load->wifi) {
+		rise += model->wifi;
+	}
+
+	if (rise > SELF_HEATING_RISE_MAX) {
+		rise = SELF_HEATING_RISE_MAX;
+	} else if (rise < -SELF_HEATING_RISE_MAX) {
+		rise = -SELF_HEATING_RISE_MAX;
+	}
+
+	return rise;
+}
+
+/// Starts a logged run, reference in TEMPERATURE_SCALE or TEMPERATURE_INVALID for the internal NTC.
+void self_heating_calibration_start(int16_t reference) {
+	struct self_heating_calib_s *next = (calib == &calib_buffer[0]) ? &calib_buffer[1] : &calib_buffer[0];
+
+	memset(next, 0, sizeof(*next));
+	next->reference = reference;
+
+	taskENTER_CRITICAL(&calib_lock);
+	calib = next;
+	calib_running = true;
+	taskEXIT_CRITICAL(&calib_lock);
+}
+
+bool self_heating_calibration_running(void) {
+	return calib_running;
+}
+
+int16_t self_heating_calibration_reference(void) {
+	return calib->reference;
+}
+
+uint32_t self_heating_calibration_samples(void) {
+	return calib->samples;
+}
+
+/// One row of the logged run, the raw SHT4x temperature against the reference. The products are formed outside the lock.
+void self_heating_calibration_add(const struct self_heating_load_s *load, int16_t t_sht, int16_t reference) {
+	int32_t x[SELF_HEATING_FEATURES];
+	int64_t a[SELF_HEATING_FEATURES][SELF_HEATING_FEATURES];
+	int64_t b[SELF_HEATING_FEATURES];
+	int64_t yy;
+	int32_t y;
+
+	x[0] = (int32_t) load->t_die - t_sht;
+	x[1] = load->duty;
+	x[2] = load->wifi ? 1 : 0;
+	x[3] = 1;
+	y = (int32_t) t_sht - reference;
+
+	for (size_t i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		for (size_t j = i; j < SELF_HEATING_FEATURES; j++) {
+			a[i][j] = (int64_t) x[i] * x[j];
+		}
+		b[i] = (int64_t) x[i] * y;
+	}
+	yy = (int64_t) y * y;
+
+	taskENTER_CRITICAL(&calib_lock);
+	if (calib_running) {
+		for (size_t i = 0u; i < SELF_HEATING_FEATURES; i++) {
+			// Upper triangle only, the matrix is symmetric
+			for (size_t j = i; j < SELF_HEATING_FEATURES; j++) {
+				calib->a[i][j] += a[i][j];
+			}
+			calib->b[i] += b[i];
+
+			if (!calib->samples || (x[i] < calib->min[i])) {
+				calib->min[i] = x[i];
+			}
+			if (!calib->samples || (x[i] > calib->max[i])) {
+				calib->max[i] = x[i];
+			}
+		}
+		calib->yy += yy;
+		calib->samples++;
+	}
+	taskEXIT_CRITICAL(&calib_lock);
+}
+
+/// Least squares fit of the logged run, a load that did not change during the run keeps a zero coefficient.
+int self_heating_calibration_stop(struct self_heating_s *model) {
+	const struct self_heating_calib_s *run;
+	double ata[SELF_HEATING_FEATURES][SELF_HEATING_FEATURES];
+	double a[SELF_HEATING_FEATURES][SELF_HEATING_FEATURES + 1u];
+	double beta[SELF_HEATING_FEATURES];
+	bool used[SELF_HEATING_FEATURES];
+	double rss;
+	size_t i, j, k;
+
+	// No row is added once stopped, the run can be read without the lock
+	taskENTER_CRITICAL(&calib_lock);
+	calib_running = false;
+	run = calib;
+	taskEXIT_CRITICAL(&calib_lock);
+
+	if (run->samples < SELF_HEATING_MIN_SAMPLES) {
+		printf("self heating - %lu samples, %u needed\r\n", (unsigned long) run->samples, SELF_HEATING_MIN_SAMPLES);
+		return -1;
+	}
+
+	// Augmented matrix [A | b], the offset is always fitted
+	for (i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		used[i] = (i == SELF_HEATING_FEATURES - 1u) || (run->max[i] > run->min[i]);
+		for (j = 0u; j < SELF_HEATING_FEATURES; j++) {
+			ata[i][j] = (double) (j >= i ? run->a[i][j] : run->a[j][i]);
+			a[i][j] = ata[i][j];
+		}
+		a[i][SELF_HEATING_FEATURES] = (double) run->b[i];
+	}
+
+	// Unused features: identity row and no contribution to the others, zero coefficient
+	for (i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		if (!used[i]) {
+			for (j = 0u; j < SELF_HEATING_FEATURES; j++) {
+				a[i][j] = 0.;
+				a[j][i] = 0.;
+			}
+			a[i][i] = 1.;
+			a[i][SELF_HEATING_FEATURES] = 0.;
+		}
+	}
+
+	// Gauss-Jordan with partial pivoting
+	for (i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		size_t pivot = i;
+
+		for (k = i + 1u; k < SELF_HEATING_FEATURES; k++) {
+			if (fabs(a[k][i]) > fabs(a[pivot][i])) {
+				pivot = k;
+			}
+		}
+		if (fabs(a[pivot][i]) < 1e-9) {
+			printf("self heating - singular fit\r\n");
+			return -1;
+		}
+		if (pivot != i) {
+			for (j = 0u; j <= SELF_HEATING_FEATURES; j++) {
+				double tmp = a[i][j];
+
+				a[i][j] = a[pivot][j];
+				a[pivot][j] = tmp;
+			}
+		}
+
+		for (k = 0u; k < SELF_HEATING_FEATURES; k++) {
+			if (k != i) {
+				double factor = a[k][i] / a[i][i];
+
+				for (j = i; j <= SELF_HEATING_FEATURES; j++) {
+					a[k][j] -= factor * a[i][j];
+				}
+			}
+		}
+	}
+
+	for (i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		beta[i] = a[i][SELF_HEATING_FEATURES] / a[i][i];
+	}
+
+	// Residual sum of squares: y'y - 2 beta'b + beta'A beta
+	rss = (double) run->yy;
+	for (i = 0u; i < SELF_HEATING_FEATURES; i++) {
+		rss -= 2. * beta[i] * (double) run->b[i];
+		for (j = 0u; j < SELF_HEATING_FEATURES; j++) {
+			rss += beta[i] * ata[i][j] * beta[j];
+		}
+	}
+
+	model->die = (int32_t) lround(beta[0] * 1000.);
+	model->fan = (int32_t) lround(beta[1] * 1000.);
+	model->wifi = (int32_t) lround(beta[2]);
+	model->offset = (int32_t) lround(beta[3]);
+
+	printf("self heating - %lu samples - residual rms %ld (0.01 C)\r\n", (unsigned long) run->samples, (long) lround(sqrt(rss > 0. ? rss / run->samples : 0.)));
+
+	return 0;
+}
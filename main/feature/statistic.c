@@ -10,6 +10,7 @@
 #include "storage.h"
 #include "structs.h"
 #include "fan.h"
+#include "controller.h"
 
 #define SAVING_THRESHOLD_STATS				(1000u)
 
@@ -37,6 +38,10 @@ void statistic_init(void) {
 void statistic_update_handler(void) {
 	uint8_t speed_state = ADJUST_SPEED(get_speed_state());
 
+	if (speed_state == SPEED_PROPORTIONAL) {
+		speed_state = fan_percentage_to_speed(controller_get_proportional_percentage());
+	}
+
     switch(speed_state) {
         case SPEED_NIGHT:
             statistics_current.speed_counters_tot_sec.night++;
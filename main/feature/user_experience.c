@@ -125,7 +125,7 @@ static void user_experience_state_machine(void) {
 
 				case BUTTON_1:
 					if (get_mode_set() != MODE_OFF) {
-						rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + get_speed_set()), false);
+						rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + (get_speed_set() > SPEED_HIGH ? SPEED_HIGH : get_speed_set())), false);
 					}
 					else {
 						rgb_led_mode(RGB_LED_COLOR_POWER_OFF, RGB_LED_MODE_DOUBLE_BLINK, false);
@@ -141,7 +141,7 @@ static void user_experience_state_machine(void) {
 					if (get_speed_set() < SPEED_HIGH) {
 						system_mode_speed_set(VALUE_UNMODIFIED, get_speed_set() + 1);
 					}
-					rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + get_speed_set()), false);
+					rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + (get_speed_set() > SPEED_HIGH ? SPEED_HIGH : get_speed_set())), false);
 					break;
 
 				case BUTTON_3:
@@ -160,10 +160,13 @@ static void user_experience_state_machine(void) {
 					break;
 
 				case BUTTON_6:
-					if (get_speed_set() > SPEED_NIGHT) {
+					// Proportional sits above boost in the enum, boost is not a user setting
+					if (get_speed_set() == SPEED_PROPORTIONAL) {
+						system_mode_speed_set(VALUE_UNMODIFIED, SPEED_HIGH);
+					} else if (get_speed_set() > SPEED_NIGHT) {
 						system_mode_speed_set(VALUE_UNMODIFIED, get_speed_set() - 1);
 					}
-					rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + get_speed_set()), false);
+					rgb_led_mode((RGB_LED_COLOR_OFFSET + get_mode_set()), (RGB_LED_MODE_OFFSET + (get_speed_set() > SPEED_HIGH ? SPEED_HIGH : get_speed_set())), false);
 					break;
 
 				case BUTTON_7:
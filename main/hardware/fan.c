@@ -6,110 +6,241 @@
  */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "driver/gpio.h"
 #include "driver/ledc.h"
 #include "esp_rom_gpio.h"
+#include "esp_timer.h"
 
 #include "fan.h"
 #include "storage.h"
 
 #define	FAN_TASK_STACK_SIZE			(configMINIMAL_STACK_SIZE * 4)
 #define	FAN_TASK_PRIORITY			(1)
-#define	FAN_TASK_PERIOD				(100ul / portTICK_PERIOD_MS)
+
+#define FAN_REVERSAL_RAMP_DOWN_MS	(3000U)		// Fade to zero before the direction pin flips
+#define FAN_REVERSAL_COAST_MS		(1000U)		// Dead time at zero duty with the new direction
+#define FAN_REVERSAL_RAMP_UP_MS		(2000U)		// Fade back to the requested duty
+
+/// Soft reversal states, driven by the fan task.
+enum fan_reversal_state_e {
+	FAN_REVERSAL_IDLE = 0,
+	FAN_REVERSAL_RAMP_DOWN,
+	FAN_REVERSAL_RAMP_UP,
+};
+
+/// Soft reversal timing, in ms, configurable for tuning.
+struct fan_reversal_timing_s {
+	uint32_t ramp_down_ms;
+	uint32_t coast_ms;
+	uint32_t ramp_up_ms;
+};
 
 static int fan_speed = 0;
 
-static void fan_task(void *pvParameters) {
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(FAN_TASK_PERIOD));  // Sleep for 100 ms
-    }
+static TaskHandle_t fan_task_handle = NULL;
+static SemaphoreHandle_t fan_lock = NULL;
+
+static uint8_t fan_reversal_state = FAN_REVERSAL_IDLE;
+static uint8_t fan_direction = DIRECTION_NONE;			// Direction applied on the pin
+static uint8_t fan_direction_request = DIRECTION_NONE;	// Last requested direction
+static int fan_speed_request = 0;						// Last requested duty
+static int64_t fan_reversal_start_us = 0;
+
+static struct fan_reversal_timing_s fan_reversal_timing = {
+	.ramp_down_ms = FAN_REVERSAL_RAMP_DOWN_MS,
+	.coast_ms = FAN_REVERSAL_COAST_MS,
+	.ramp_up_ms = FAN_REVERSAL_RAMP_UP_MS,
+};
+
+static void fan_direction_pin_set(uint8_t direction) {
+	if (direction == DIRECTION_IN) {
+		gpio_set_level(FAN_DIRECTION_PIN, 0);
+	} else if (direction == DIRECTION_OUT) {
+		gpio_set_level(FAN_DIRECTION_PIN, 1);
+	}
 }
 
-int fan_init() {
-    BaseType_t task_created = xTaskCreate(fan_task, "FAN task ", FAN_TASK_STACK_SIZE, NULL, FAN_TASK_PRIORITY, NULL);
+static void fan_duty_set(int duty) {
+	fan_speed = duty;
+	ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, fan_speed);
+	ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+}
 
-    return task_created == pdPASS ? 0 : -1;
+static void fan_fade_start(int duty, uint32_t time_ms) {
+	fan_speed = duty;
+	ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, fan_speed, time_ms);
+	ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, LEDC_FADE_NO_WAIT);
 }
 
-int fan_set(uint8_t direction, uint8_t speed) {
-#if 0
-	static uint8_t last_direction = DIRECTION_NONE;
+static IRAM_ATTR bool fan_fade_end_callback(const ledc_cb_param_t *param, void *user_arg) {
+	BaseType_t high_task_wakeup = pdFALSE;
+
+	if (param->event == LEDC_FADE_END_EVT) {
+		vTaskNotifyGiveFromISR(fan_task_handle, &high_task_wakeup);
+	}
+
+	return high_task_wakeup == pdTRUE;
+}
 
-    // Check if the direction has changed
-    if (last_direction != direction) {
-        // Set speed to zero and update
-        ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
-        ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+/// Applies a request: speed changes are immediate, a direction change while running starts a soft reversal.
+static int fan_request(uint8_t direction, int duty) {
+	xSemaphoreTake(fan_lock, portMAX_DELAY);
+
+	fan_direction_request = direction;
+	fan_speed_request = duty;
+
+	if (fan_reversal_state == FAN_REVERSAL_IDLE) {
+		if ((direction != DIRECTION_NONE) && (direction != fan_direction) && (fan_direction != DIRECTION_NONE) && (fan_speed > 0)) {
+			fan_reversal_state = FAN_REVERSAL_RAMP_DOWN;
+			fan_reversal_start_us = esp_timer_get_time();
+			fan_fade_start(0, fan_reversal_timing.ramp_down_ms);
+		} else {
+			if (direction != DIRECTION_NONE) {
+				fan_direction = direction;
+				fan_direction_pin_set(direction);
+			}
+			if (duty != fan_speed) {
+				fan_duty_set(duty);
+			}
+		}
+	}
+	// A reversal in progress picks the latest request up when its ramp ends
 
-        // Wait for 7 seconds
-        vTaskDelay(pdMS_TO_TICKS(7000));
+	xSemaphoreGive(fan_lock);
 
-        // Update last direction
-        last_direction = direction;
-    }
-#endif
-	if ( direction == DIRECTION_IN) {
-    gpio_set_level(FAN_DIRECTION_PIN, 0);
-	} else if( direction == DIRECTION_OUT) {
-	gpio_set_level(FAN_DIRECTION_PIN, 1);
+	return 0;
+}
+
+/// Duty applied on the pin, read back from the LEDC so a fade reports its current step and not its target.
+uint16_t fan_get_duty_permille(void) {
+	uint32_t duty = ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+
+	if (duty > FAN_PWM_MAX) {
+		duty = FAN_PWM_MAX;
 	}
 
+	return (uint16_t) ((duty * 1000UL) / FAN_PWM_MAX);
+}
+
+static void fan_task(void *pvParameters) {
+	int64_t ramp_down_end_us = 0;
+	int64_t ramp_up_start_us = 0;
+
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		xSemaphoreTake(fan_lock, portMAX_DELAY);
+
+		if (fan_reversal_state == FAN_REVERSAL_RAMP_DOWN) {
+			ramp_down_end_us = esp_timer_get_time();
+
+			if (fan_direction_request != DIRECTION_NONE) {
+				fan_direction = fan_direction_request;
+				fan_direction_pin_set(fan_direction);
+			}
+
+			// Coast at zero duty without holding the lock, the callers are never blocked
+			xSemaphoreGive(fan_lock);
+			vTaskDelay(pdMS_TO_TICKS(fan_reversal_timing.coast_ms));
+			xSemaphoreTake(fan_lock, portMAX_DELAY);
+
+			ramp_up_start_us = esp_timer_get_time();
+
+			if ((fan_direction_request == DIRECTION_NONE) || (fan_speed_request == 0)) {
+				fan_reversal_state = FAN_REVERSAL_IDLE;
+				fan_duty_set(0);
+			} else {
+				fan_reversal_state = FAN_REVERSAL_RAMP_UP;
+				fan_fade_start(fan_speed_request, fan_reversal_timing.ramp_up_ms);
+			}
+		} else if (fan_reversal_state == FAN_REVERSAL_RAMP_UP) {
+			int64_t now_us = esp_timer_get_time();
+
+			fan_reversal_state = FAN_REVERSAL_IDLE;
+
+			printf("Fan reversal: down %lu ms - coast %lu ms - up %lu ms - total %lu ms\n",
+					(uint32_t) ((ramp_down_end_us - fan_reversal_start_us) / 1000),
+					(uint32_t) ((ramp_up_start_us - ramp_down_end_us) / 1000),
+					(uint32_t) ((now_us - ramp_up_start_us) / 1000),
+					(uint32_t) ((now_us - fan_reversal_start_us) / 1000));
+
+			// Requests received while ramping up
+			if (fan_direction_request != DIRECTION_NONE && fan_direction_request != fan_direction) {
+				fan_reversal_state = FAN_REVERSAL_RAMP_DOWN;
+				fan_reversal_start_us = now_us;
+				fan_fade_start(0, fan_reversal_timing.ramp_down_ms);
+			} else if (fan_speed_request != fan_speed) {
+				fan_duty_set(fan_speed_request);
+			}
+		}
+
+		xSemaphoreGive(fan_lock);
+	}
+}
+
+int fan_init() {
+	fan_lock = xSemaphoreCreateMutex();
+
+	ledc_fade_func_install(0);
+
+	ledc_cbs_t fan_fade_cbs = {
+		.fade_cb = fan_fade_end_callback,
+	};
+	ledc_cb_register(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, &fan_fade_cbs, NULL);
+
+    BaseType_t task_created = xTaskCreate(fan_task, "FAN task ", FAN_TASK_STACK_SIZE, NULL, FAN_TASK_PRIORITY, &fan_task_handle);
+
+    return task_created == pdPASS ? 0 : -1;
+}
+
+int fan_set(uint8_t direction, uint8_t speed) {
+    int duty = 0;
+
     if (speed > 5) {
         printf("Speed value exceeded. Setting to maximum.\n");
         speed = 5;
     }
 
     if (direction == DIRECTION_IN) {
-        fan_speed = fan_pwm_pulse_in[speed];
+        duty = fan_pwm_pulse_in[speed];
     } else if( direction == DIRECTION_OUT) {
-        fan_speed = fan_pwm_pulse_out[speed];
+        duty = fan_pwm_pulse_out[speed];
     } else if(direction == DIRECTION_NONE) {
-    	fan_speed = 0;
+    	duty = 0;
     }
 
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, fan_speed);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
-
   //  printf("Fan set: direction=%u, speed=%d.\n", direction, speed);
 
-    return 0;
+    return fan_request(direction, duty);
 }
 
 int fan_set_percentage(uint8_t direction, uint8_t speed_percent) {
-#if 0
-	static uint8_t last_direction = DIRECTION_NONE;
-
-    // Check if the direction has changed
-    if (last_direction != direction) {
-        // Set speed to zero and update
-        ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
-        ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
-
-        // Wait for 7 seconds
-        vTaskDelay(pdMS_TO_TICKS(7000));
+    int duty = 0;
 
-        // Update last direction
-        last_direction = direction;
-    }
-#endif
-    if (direction == DIRECTION_IN) {
-        gpio_set_level(FAN_DIRECTION_PIN, 0);
-        fan_speed = (FAN_PWM_MAX * speed_percent) / 100;
-    } else if (direction == DIRECTION_OUT) {
-        gpio_set_level(FAN_DIRECTION_PIN, 1);
-        fan_speed = (FAN_PWM_MAX * speed_percent) / 100;
+    if (direction == DIRECTION_IN || direction == DIRECTION_OUT) {
+        duty = (FAN_PWM_MAX * speed_percent) / 100;
     } else if (direction == DIRECTION_NONE) {
-        fan_speed = 0;
+        duty = 0;
     } else {
         printf("Invalid direction.\n");
         return -1;
     }
 
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, fan_speed);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    return fan_request(direction, duty);
+}
+
+int fan_set_reversal_timing(uint32_t ramp_down_ms, uint32_t coast_ms, uint32_t ramp_up_ms) {
+	if ((ramp_down_ms == 0U) || (ramp_up_ms == 0U)) {
+		return -1;
+	}
 
-    printf("Fan set: direction=%u, speed=%u%%.\n", direction, speed_percent);
+	xSemaphoreTake(fan_lock, portMAX_DELAY);
+	fan_reversal_timing.ramp_down_ms = ramp_down_ms;
+	fan_reversal_timing.coast_ms = coast_ms;
+	fan_reversal_timing.ramp_up_ms = ramp_up_ms;
+	xSemaphoreGive(fan_lock);
 
-    return 0;
+	return 0;
 }
@@ -0,0 +1,225 @@
+/*
+ * i2c_bus.c
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#include "i2c_bus.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "esp_timer.h"
+
+#define	I2C_BUS_TASK_STACK_SIZE			(configMINIMAL_STACK_SIZE * 3)
+#define	I2C_BUS_TASK_PRIORITY			(3)			// Above the sensor and NTC tasks, transfers are short
+#define	I2C_BUS_QUEUE_LENGTH			(16u)
+
+struct i2c_bus_sync_s {
+	StaticSemaphore_t done_buffer;
+	SemaphoreHandle_t done;
+	int result;
+};
+
+struct i2c_bus_item_s {
+	struct i2c_bus_transaction_s transaction;
+	int64_t queued_us;
+};
+
+static struct i2c_dev_s *bus_dev;
+static QueueHandle_t bus_queue;
+static int64_t bus_start_us;
+
+static portMUX_TYPE bus_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct i2c_bus_stats_s bus_stats[I2C_BUS_DEVICE_COUNT];
+static uint32_t bus_dropped;
+
+static const char *const bus_device_name[I2C_BUS_DEVICE_COUNT] = {
+	[I2C_BUS_DEVICE_SHT4X] = "sht4x",
+	[I2C_BUS_DEVICE_SGP40] = "sgp40",
+	[I2C_BUS_DEVICE_LTR303] = "ltr303",
+	[I2C_BUS_DEVICE_KTD2027] = "ktd2027",
+};
+
+static int i2c_bus_execute(struct i2c_bus_transaction_s *transaction) {
+	esp_err_t err;
+
+	if (transaction->tx_size && transaction->rx_size) {
+		err = i2c_master_write_read_device(bus_dev->i2c_num, transaction->address, transaction->tx, transaction->tx_size, transaction->rx, transaction->rx_size, bus_dev->i2c_timeout);
+	}
+	else if (transaction->tx_size) {
+		err = i2c_master_write_to_device(bus_dev->i2c_num, transaction->address, transaction->tx, transaction->tx_size, bus_dev->i2c_timeout);
+	}
+	else {
+		err = i2c_master_read_from_device(bus_dev->i2c_num, transaction->address, transaction->rx, transaction->rx_size, bus_dev->i2c_timeout);
+	}
+
+	return (err == ESP_OK) ? 0 : -1;
+}
+
+static void i2c_bus_task(void *pvParameters) {
+	struct i2c_bus_item_s item;
+
+	for (;;) {
+		xQueueReceive(bus_queue, &item, portMAX_DELAY);
+
+		int64_t start_us = esp_timer_get_time();
+		int result = i2c_bus_execute(&item.transaction);
+		int64_t end_us = esp_timer_get_time();
+
+		uint32_t busy_us = (uint32_t) (end_us - start_us);
+		uint32_t wait_us = (uint32_t) (start_us - item.queued_us);
+		struct i2c_bus_stats_s *stats = &bus_stats[item.transaction.device];
+
+		taskENTER_CRITICAL(&bus_stats_lock);
+		stats->transactions++;
+		if (result) {
+			stats->errors++;
+		}
+		else {
+			stats->bytes += item.transaction.tx_size + item.transaction.rx_size;
+		}
+		stats->busy_us += busy_us;
+		if (busy_us > stats->busy_max_us) {
+			stats->busy_max_us = busy_us;
+		}
+		if (wait_us > stats->wait_max_us) {
+			stats->wait_max_us = wait_us;
+		}
+		taskEXIT_CRITICAL(&bus_stats_lock);
+
+		if (item.transaction.callback) {
+			item.transaction.callback(result, item.transaction.arg);
+		}
+	}
+}
+
+static void i2c_bus_sync_done(int result, void *arg) {
+	struct i2c_bus_sync_s *sync = arg;
+
+	sync->result = result;
+	xSemaphoreGive(sync->done);
+}
+
+int i2c_bus_init(struct i2c_dev_s *i2c_dev) {
+	bus_dev = i2c_dev;
+	bus_start_us = esp_timer_get_time();
+
+	bus_queue = xQueueCreate(I2C_BUS_QUEUE_LENGTH, sizeof(struct i2c_bus_item_s));
+	if (bus_queue == NULL) {
+		printf("Failed to create I2C bus queue\r\n");
+		return -1;
+	}
+
+	if (xTaskCreate(i2c_bus_task, "i2c_bus_task", I2C_BUS_TASK_STACK_SIZE, NULL, I2C_BUS_TASK_PRIORITY, NULL) != pdPASS) {
+		printf("Failed to create I2C bus task\r\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/// Queue a transaction without blocking, -1 when the queue is full.
+int i2c_bus_submit(const struct i2c_bus_transaction_s *transaction) {
+	struct i2c_bus_item_s item;
+
+	if ((transaction->device >= I2C_BUS_DEVICE_COUNT) || (transaction->tx_size > I2C_BUS_TX_SIZE) || (!transaction->tx_size && !transaction->rx_size)) {
+		return -1;
+	}
+
+	item.transaction = *transaction;
+	item.queued_us = esp_timer_get_time();
+
+	if (xQueueSend(bus_queue, &item, 0) != pdTRUE) {
+		taskENTER_CRITICAL(&bus_stats_lock);
+		bus_dropped++;
+		taskEXIT_CRITICAL(&bus_stats_lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+/// Fire and forget write, the data is copied.
+int i2c_bus_write(uint8_t device, uint8_t address, const uint8_t *tx, size_t tx_size) {
+	struct i2c_bus_transaction_s transaction = {
+		.device = device,
+		.address = address,
+		.tx_size = tx_size,
+	};
+
+	if (tx_size > I2C_BUS_TX_SIZE) {
+		return -1;
+	}
+
+	memcpy(transaction.tx, tx, tx_size);
+
+	return i2c_bus_submit(&transaction);
+}
+
+/// Blocking transaction, returns once the bus task has completed it.
+int i2c_bus_transfer(uint8_t device, uint8_t address, const uint8_t *tx, size_t tx_size, uint8_t *rx, size_t rx_size) {
+	struct i2c_bus_sync_s sync;
+	struct i2c_bus_transaction_s transaction = {
+		.device = device,
+		.address = address,
+		.tx_size = tx_size,
+		.rx = rx,
+		.rx_size = rx_size,
+		.callback = i2c_bus_sync_done,
+		.arg = &sync,
+	};
+
+	if (tx_size > I2C_BUS_TX_SIZE) {
+		return -1;
+	}
+
+	if (tx_size) {
+		memcpy(transaction.tx, tx, tx_size);
+	}
+
+	sync.done = xSemaphoreCreateBinaryStatic(&sync.done_buffer);
+	sync.result = -1;
+
+	if (i2c_bus_submit(&transaction)) {
+		return -1;
+	}
+
+	// Always completed: the driver call is bounded by i2c_timeout, and rx and sync live on this stack
+	xSemaphoreTake(sync.done, portMAX_DELAY);
+
+	return sync.result;
+}
+
+void i2c_bus_get_stats(uint8_t device, struct i2c_bus_stats_s *stats) {
+	if (device >= I2C_BUS_DEVICE_COUNT) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	taskENTER_CRITICAL(&bus_stats_lock);
+	*stats = bus_stats[device];
+	taskEXIT_CRITICAL(&bus_stats_lock);
+}
+
+void i2c_bus_report(void) {
+	struct i2c_bus_stats_s stats;
+	uint64_t uptime_us = (uint64_t) (esp_timer_get_time() - bus_start_us);
+	uint64_t total_us = 0;
+
+	printf("device   transactions errors bytes     busy_ms   util  max_us wait_max_us\r\n");
+	for (uint8_t device = 0; device < I2C_BUS_DEVICE_COUNT; device++) {
+		i2c_bus_get_stats(device, &stats);
+		total_us += stats.busy_us;
+
+		uint32_t util_permille = uptime_us ? (uint32_t) ((stats.busy_us * 1000u) / uptime_us) : 0;
+		printf("%-8s %12lu %6lu %9lu %9lu %3lu.%lu%% %7lu %11lu\r\n", bus_device_name[device],
+				(unsigned long) stats.transactions, (unsigned long) stats.errors, (unsigned long) stats.bytes,
+				(unsigned long) (stats.busy_us / 1000u), (unsigned long) (util_permille / 10u), (unsigned long) (util_permille % 10u),
+				(unsigned long) stats.busy_max_us, (unsigned long) stats.wait_max_us);
+	}
+
+	uint32_t total_permille = uptime_us ? (uint32_t) ((total_us * 1000u) / uptime_us) : 0;
+	printf("bus utilisation %lu.%lu%%, dropped %lu\r\n", (unsigned long) (total_permille / 10u), (unsigned long) (total_permille % 10u), (unsigned long) bus_dropped);
+}
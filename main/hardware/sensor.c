@@ -5,12 +5,19 @@
  *      Author: Daniele Schirosi
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h>
 
 #include "driver/i2c.h"
 #include "driver/temperature_sensor.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_system.h"
 
 #include "board.h"
 #include "system.h"
@@ -20,16 +27,183 @@
 #include "ltr303.h"
 #include "rgb_led.h"
 #include "test.h"
+#include "interpolation.h"
+#include "humidity.h"
+#include "filter.h"
+#include "fan.h"
+#include "blufi.h"
+#include "self_heating.h"
 
 ///
 #define	SENSOR_TASK_STACK_SIZE			(configMINIMAL_STACK_SIZE * 4)
 #define	SENSOR_TASK_PRIORITY			(1)
 #define	SENSOR_TASK_PERIOD				(1000ul / portTICK_PERIOD_MS)
+#define	SENSOR_PIPELINE					(1)			// 0: sequential acquisition, kept to compare the active time
 
 #define NTC_ADC_TEMPERATURE_SCALE		(100)
 
+#define NTC_LUT_SHIFT					(3U)		// One node every 8 mV
+#define NTC_LUT_SIZE					((NTC_ADC_VIN >> NTC_LUT_SHIFT) + 2U)
+
+#define	NTC_TASK_STACK_SIZE				(configMINIMAL_STACK_SIZE * 2)
+#define	NTC_TASK_PRIORITY				(2)
+
+#define NTC_TEMPERATURE_INVALID			INT32_MIN
+
+// VOC algorithm checkpoint: 48 writes a day of a 12 bytes blob, NVS spreads them over its pages
+#define VOC_STATE_SAVE_PERIOD			(30u * 60u)							// s
+#define VOC_STATE_LEARNING_TIME			(3u * SECONDS_PER_HOUR)				// s, run time before the first checkpoint
+#define VOC_STATE_MAX_AGE				(VOC_STATE_SAVE_PERIOD + 10u * 60u)	// s, the baseline is lost after 10 min off
+
+// Low power VOC mode: 1 Hz sampling resumes while RH or VOC rise
+#define VOC_POWER_RH_RISE				(1u * RELATIVE_HUMIDITY_SCALE)	// Over one low power sampling interval
+#define VOC_POWER_VOC_RISE				(10u * VOC_SCALE)
+#define VOC_POWER_STABLE_TIME			(5u * 60u)						// s without a rise before going back to low power
+
+#define LUX_REFRESH_PERIOD				(10u)		// Sensor periods between data reads without threshold event
+
+// Settling after a direction change, within the 45 s phases: fan reversal (about 5 s), duct flush and sensor response
+#define SENSOR_SETTLE_TIME_SHT4X		(15u)		// s
+#define SENSOR_SETTLE_TIME_VOC			(20u)		// s, the gas index lags the raw signal
+#define SENSOR_SETTLE_TIME_NTC			(10u)		// s
+
+// Self-heating: the pool average follows the slow warm-up of the board around the SHT4x
+#define SELF_HEATING_DIE_PERIOD			(10u)						// Sensor periods between die samples, 5 min pool
+
+#define SENSOR_BENCHMARK_ITERATIONS		(1000u)
+#define SENSOR_BENCHMARK_STEP			(37u)
+
 struct adc_dev_s adc_dev;
 
+static struct {
+	uint32_t last_us;
+	uint32_t max_us;
+} sensor_active_time;
+
+static TaskHandle_t ntc_task_handle;
+
+/// Learning time of the VOC algorithm states, restored states count as fully learnt.
+static struct {
+	uint32_t run_time;
+	uint32_t save_time;
+} voc_state;
+
+enum {
+	VOC_POWER_NORMAL = 0,
+	VOC_POWER_LOW,
+	//
+	VOC_POWER_COUNT,
+};
+
+static const char *voc_power_name[VOC_POWER_COUNT] = { "normal", "low power" };
+
+static struct {
+	bool selected;				// Low power mode requested
+	uint8_t mode;				// Running mode
+	uint32_t countdown;			// Sensor periods to the next low power sample
+	uint32_t elapsed;			// s since the last rise check
+	uint32_t stable_time;		// s without a rise
+	uint16_t rh_ref;
+	uint16_t voc_ref;
+	int64_t last_us;
+	int64_t heater_on_us;		// 0 with the heater off
+	struct {
+		uint64_t time_us;
+		uint64_t heater_us;
+		uint64_t bus_us;		// SGP40 I2C transfers
+		uint32_t samples;
+	} stats[VOC_POWER_COUNT];
+} voc_power = {
+	.rh_ref = RELATIVE_HUMIDITY_INVALID,
+	.voc_ref = VOC_INVALID,
+};
+
+enum {
+	SENSOR_SIDE_INDOOR = 0,		// DIRECTION_OUT and DIRECTION_NONE, the room air
+	SENSOR_SIDE_OUTDOOR,		// DIRECTION_IN
+	//
+	SENSOR_SIDE_COUNT,
+};
+
+enum {
+	SENSOR_SAMPLE_SHT4X = 0,
+	SENSOR_SAMPLE_VOC,
+	SENSOR_SAMPLE_NTC,
+	//
+	SENSOR_SAMPLE_COUNT,
+};
+
+static const char *sensor_side_name[SENSOR_SIDE_COUNT] = { "indoor", "outdoor" };
+static const char *sensor_sample_name[SENSOR_SAMPLE_COUNT] = { "sht4x", "voc", "ntc" };
+static const uint32_t sensor_settle_time[SENSOR_SAMPLE_COUNT] = { SENSOR_SETTLE_TIME_SHT4X, SENSOR_SETTLE_TIME_VOC, SENSOR_SETTLE_TIME_NTC };
+
+/// Direction and time since the last change, every sample of a period carries it.
+struct sensor_tag_s {
+	uint8_t direction;
+	uint32_t since_inversion;	// s
+};
+
+static struct {
+	struct sensor_tag_s tag;
+	struct {
+		uint32_t samples;
+		uint32_t settled;		// Used by the estimate of the side
+	} stats[SENSOR_SIDE_COUNT][SENSOR_SAMPLE_COUNT];
+} sensor_direction = {
+	.tag.direction = UINT8_MAX,
+};
+
+enum {
+	SENSOR_FILTER_TEMPERATURE = 0,
+	SENSOR_FILTER_RELATIVE_HUMIDITY,
+	SENSOR_FILTER_VOC,
+	SENSOR_FILTER_EXTERNAL_ABSOLUTE_HUMIDITY,
+	SENSOR_FILTER_EXTERNAL_VOC,
+	//
+	SENSOR_FILTER_COUNT,
+};
+
+static const char *sensor_filter_name[SENSOR_FILTER_COUNT] = { "t", "rh", "voc", "ah_out", "voc_out" };
+
+/// Hampel at 3 sigma over 5 samples, the gas index is already averaged by its algorithm.
+static const struct filter_config_s sensor_filter_default[SENSOR_FILTER_COUNT] = {
+	[SENSOR_FILTER_TEMPERATURE]					= { .window = 5U, .hampel_k = 30U, .ema_shift = 2U, .mad_min = 5 },		// 0.05 C
+	[SENSOR_FILTER_RELATIVE_HUMIDITY]			= { .window = 5U, .hampel_k = 30U, .ema_shift = 2U, .mad_min = 20 },	// 0.2 %RH
+	[SENSOR_FILTER_VOC]							= { .window = 5U, .hampel_k = 30U, .ema_shift = 0U, .mad_min = 2 },
+	[SENSOR_FILTER_EXTERNAL_ABSOLUTE_HUMIDITY]	= { .window = 5U, .hampel_k = 30U, .ema_shift = 2U, .mad_min = 5 },		// 0.05 g/m3
+	[SENSOR_FILTER_EXTERNAL_VOC]				= { .window = 5U, .hampel_k = 30U, .ema_shift = 0U, .mad_min = 2 },
+};
+
+/// Filters run in the sensor task only, a new configuration waits for the next period.
+static struct {
+	struct filter_s filter[SENSOR_FILTER_COUNT];
+	struct filter_config_s pending[SENSOR_FILTER_COUNT];
+	volatile bool update[SENSOR_FILTER_COUNT];
+} sensor_filter;
+
+static const uint16_t luminosity_threshold_convert[] = { 0U, LUMINOSITY_THRESHOLD_LOW, LUMINOSITY_THRESHOLD_MEDIUM, LUMINOSITY_THRESHOLD_HIGH };
+
+/// LTR303 threshold window, programmed for the current lux_set and luminosity state.
+static struct {
+	uint8_t lux_set;
+	uint8_t state;
+	bool event;					// Threshold interrupt not handled yet
+	uint32_t countdown;			// Sensor periods to the next data read
+} lux_window = {
+	.lux_set = UINT8_MAX,
+	.state = LUMINOSITY_STATE_UNKNOWN,
+};
+
+/// Median window over the frame means, the latest result is published as a temperature.
+static struct {
+	int32_t window[NTC_ADC_MEDIAN_SIZE];
+	size_t index;
+	size_t count;
+	volatile int32_t temperature;
+} ntc_filter = {
+	.temperature = NTC_TEMPERATURE_INVALID,
+};
+
 static const struct ntc_shape_s ntc_convert[] = {
    {235800, -40 * NTC_ADC_TEMPERATURE_SCALE},
    {173900, -35 * NTC_ADC_TEMPERATURE_SCALE},
@@ -52,6 +226,20 @@ static const struct ntc_shape_s ntc_convert[] = {
    {4160,  50 * NTC_ADC_TEMPERATURE_SCALE}
 };
 
+static int32_t ntc_voltage_to_temperature(int32_t voltage);
+
+static int16_t ntc_lut_y[NTC_LUT_SIZE];
+
+/// NTC temperature (NTC_ADC_TEMPERATURE_SCALE) indexed by the calibrated voltage (mV).
+static struct interp_lut_s ntc_lut = {
+	.name = "ntc",
+	.reference = ntc_voltage_to_temperature,
+	.x_min = 0,
+	.shift = NTC_LUT_SHIFT,
+	.size = NTC_LUT_SIZE,
+	.y = ntc_lut_y,
+};
+
 ///
 struct t_sensor_config_t {
 	temperature_sensor_handle_t handle;
@@ -65,15 +253,24 @@ static struct t_sensor_config_t t_sensor_config = { NULL, TEMPERATURE_SENSOR_CON
 #define T_SENS_POOL_SIZE	30u
 #define T_SENS_INVALID		65535.f
 
-static float t_sens_pool[T_SENS_POOL_SIZE] = { [0 ... T_SENS_POOL_SIZE - 1] = T_SENS_INVALID };
+static int16_t t_sens_pool[T_SENS_POOL_SIZE] = { [0 ... T_SENS_POOL_SIZE - 1] = TEMPERATURE_INVALID };
 static size_t t_sens_idx = 0u;
 
+/// Die temperature average and the load state, refreshed by the sensor task.
+static struct {
+	uint32_t countdown;
+	struct self_heating_load_s load;
+	int32_t rise;				// Last correction
+} self_heating = {
+	.load.t_die = TEMPERATURE_INVALID,
+};
+
 ///
 int temperature_sensor_init(void);
 int temperature_sensor_sample_get(float *t_sens);
 
-static void add_t_sens_to_pool(float t_sens);
-static float calculate_t_sens_avg(void);
+static void add_t_sens_to_pool(int16_t t_sens);
+static int16_t calculate_t_sens_avg(void);
 
 ///
 static int sensor_i2c_binding(struct i2c_dev_s *i2c_dev) {
@@ -93,28 +290,17 @@ static int sensor_adc_binding(struct adc_dev_s *adc_d) {
 	return 0;
 }
 
-int sensor_ntc_sample(float *temp) {
-	int sample_raw;
-	long sum_samples;
-	int voltage_val;
+/// Reference conversion, only used to build the lookup table.
+static int32_t ntc_voltage_to_temperature(int32_t voltage) {
 	uint32_t tmp;
 	size_t i;
 
-	*temp = TEMP_F_INVALID;
-
-	for (i = 0u, sum_samples = 0; i < NTC_ADC_NB_SAMPLE; i++) {
-		adc_oneshot_read(adc_dev.adc_handle, adc_dev.adc_channel, &sample_raw);
-		sum_samples += sample_raw;
+	if (voltage >= (int32_t) NTC_ADC_VIN) {
+		return ntc_convert[0].temperature;
 	}
 
-	adc_cali_raw_to_voltage(adc_dev.adc_cali_handle, sum_samples / NTC_ADC_NB_SAMPLE, &voltage_val);
-//	printf("Voltage: %u\r\n", voltage_val);
-
-	if ( voltage_val == NTC_ADC_VIN){
-		return -1;
-	}
-	tmp = voltage_val * NTC_ADC_LEG_RESISTANCE;
-	tmp /= NTC_ADC_VIN - voltage_val;
+	tmp = voltage * NTC_ADC_LEG_RESISTANCE;
+	tmp /= NTC_ADC_VIN - voltage;
 
 	for (i = 0u; i < ARRAY_SIZE(ntc_convert); i++) {
 		if (ntc_convert[i].resistance <= tmp)
@@ -122,78 +308,924 @@ int sensor_ntc_sample(float *temp) {
 	}
 
 	if (i == 0u) {
-		*temp = ntc_convert[i].temperature;
+		return ntc_convert[i].temperature;
 	} else if (i == ARRAY_SIZE(ntc_convert)) {
-		*temp = ntc_convert[ARRAY_SIZE(ntc_convert) - 1].temperature;
-	} else {
-		*temp = ntc_convert[i - 1].temperature
-				+ (((int32_t)(tmp - ntc_convert[i - 1].resistance) * (ntc_convert[i - 1].temperature - ntc_convert[i].temperature))
-						/ (int32_t)(ntc_convert[i - 1].resistance - ntc_convert[i].resistance));
+		return ntc_convert[ARRAY_SIZE(ntc_convert) - 1].temperature;
+	}
+
+	return ntc_convert[i - 1].temperature
+			+ (((int32_t)(tmp - ntc_convert[i - 1].resistance) * (ntc_convert[i - 1].temperature - ntc_convert[i].temperature))
+					/ (int32_t)(ntc_convert[i - 1].resistance - ntc_convert[i].resistance));
+}
+
+static bool IRAM_ATTR sensor_ntc_conv_done_callback(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data) {
+	BaseType_t higher_priority_task_woken = pdFALSE;
+
+	vTaskNotifyGiveFromISR(ntc_task_handle, &higher_priority_task_woken);
+
+	return higher_priority_task_woken == pdTRUE;
+}
+
+/// Decimation: mean of the samples of one DMA frame, -1 if the frame holds none of our channel.
+static int32_t sensor_ntc_frame_mean(const uint8_t *frame, uint32_t size) {
+	adc_digi_output_data_t *sample;
+	uint32_t sum = 0u;
+	uint32_t count = 0u;
+
+	for (uint32_t i = 0u; i + SOC_ADC_DIGI_RESULT_BYTES <= size; i += SOC_ADC_DIGI_RESULT_BYTES) {
+		sample = (adc_digi_output_data_t *) &frame[i];
+
+		if ((sample->type2.unit != ADC_UNIT_1) || (sample->type2.channel != adc_dev.adc_channel)) {
+			continue;
+		}
+
+		sum += sample->type2.data;
+		count++;
+	}
+
+	return count ? (int32_t) (sum / count) : -1;
+}
+
+static int32_t sensor_ntc_median(void) {
+	int32_t sorted[NTC_ADC_MEDIAN_SIZE];
+	int32_t val;
+	size_t i;
+	size_t j;
+
+	for (i = 0u; i < ntc_filter.count; i++) {
+		val = ntc_filter.window[i];
+
+		for (j = i; (j > 0u) && (sorted[j - 1u] > val); j--) {
+			sorted[j] = sorted[j - 1u];
+		}
+		sorted[j] = val;
+	}
+
+	return sorted[ntc_filter.count / 2u];
+}
+
+static void sensor_ntc_filter_push(int32_t raw) {
+	int voltage_val;
+
+	ntc_filter.window[ntc_filter.index] = raw;
+	ntc_filter.index = (ntc_filter.index + 1u) % NTC_ADC_MEDIAN_SIZE;
+	if (ntc_filter.count < NTC_ADC_MEDIAN_SIZE) {
+		ntc_filter.count++;
+	}
+
+	if (adc_cali_raw_to_voltage(adc_dev.adc_cali_handle, sensor_ntc_median(), &voltage_val) != ESP_OK) {
+		return;
+	}
+//	printf("Voltage: %u\r\n", voltage_val);
+
+	// Single aligned 32 bit store, readers never see a torn value
+	ntc_filter.temperature = (voltage_val >= (int) NTC_ADC_VIN) ? NTC_TEMPERATURE_INVALID : (int32_t) interp_lut_get(&ntc_lut, voltage_val);
+}
+
+static void sensor_ntc_task(void *pvParameters) {
+	static uint8_t frame[NTC_ADC_FRAME_SIZE];
+	uint32_t size;
+	int32_t raw;
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		// Drain every complete frame, each one gives one decimated sample
+		while (adc_continuous_read(adc_dev.adc_handle, frame, sizeof(frame), &size, 0) == ESP_OK) {
+			raw = sensor_ntc_frame_mean(frame, size);
+			if (raw >= 0) {
+				sensor_ntc_filter_push(raw);
+			}
+		}
+	}
+}
+
+static int sensor_ntc_start(void) {
+	adc_continuous_evt_cbs_t cbs = {
+		.on_conv_done = sensor_ntc_conv_done_callback,
+	};
+
+	if (xTaskCreate(sensor_ntc_task, "ntc_task", NTC_TASK_STACK_SIZE, NULL, NTC_TASK_PRIORITY, &ntc_task_handle) != pdPASS) {
+		return -1;
+	}
+
+	if (adc_continuous_register_event_callbacks(adc_dev.adc_handle, &cbs, NULL) != ESP_OK) {
+		printf("adc_continuous_register_event_callbacks - error\r\n");
+
+		return -1;
+	}
+
+	if (adc_continuous_start(adc_dev.adc_handle) != ESP_OK) {
+		printf("adc_continuous_start - error\r\n");
+
+		return -1;
 	}
 
-	*temp /= NTC_ADC_TEMPERATURE_SCALE;
+	return 0;
+}
+
+/// Latest filtered NTC temperature, never blocks.
+int sensor_ntc_sample(int16_t *temp) {
+	int32_t temperature = ntc_filter.temperature;
+
+	*temp = TEMPERATURE_INVALID;
+
+	if (temperature == NTC_TEMPERATURE_INVALID) {
+		return -1;
+	}
+
+	*temp = (int16_t) (temperature * TEMPERATURE_SCALE / NTC_ADC_TEMPERATURE_SCALE);
 
 	return 0;
 }
 
+static void sensor_wait_since(int64_t start_us, uint32_t wait_ms) {
+	int64_t remaining_us = (int64_t) wait_ms * 1000 - (esp_timer_get_time() - start_us);
+
+	if (remaining_us > 0) {
+		// vTaskDelay(n) may return up to one tick early
+		vTaskDelay((TickType_t) ceiling_fraction(remaining_us, (int64_t) portTICK_PERIOD_MS * 1000) + 1);
+	}
+}
+
+static uint8_t sensor_side(uint8_t direction) {
+	return direction == DIRECTION_IN ? SENSOR_SIDE_OUTDOOR : SENSOR_SIDE_INDOOR;
+}
+
+/// Called once per sensor period, before the samples are stored.
+static void sensor_direction_update(void) {
+	uint8_t direction = get_direction_state();
+
+	// Any change restarts the settling, a stopped fan leaves the last air in the duct
+	if (direction != sensor_direction.tag.direction) {
+		sensor_direction.tag.direction = direction;
+		sensor_direction.tag.since_inversion = 0u;
+	} else if (sensor_direction.tag.since_inversion < UINT32_MAX) {
+		sensor_direction.tag.since_inversion++;
+	}
+}
+
+/// Counts the sample for its side, true once the air and the sensor have settled.
+static bool sensor_sample_settled(const struct sensor_tag_s *tag, uint8_t sample) {
+	uint8_t side = sensor_side(tag->direction);
+
+	sensor_direction.stats[side][sample].samples++;
+
+	if (tag->since_inversion < sensor_settle_time[sample]) {
+		return false;
+	}
+
+	sensor_direction.stats[side][sample].settled++;
+
+	return true;
+}
+
+static void sensor_filter_init(void) {
+	for (uint8_t channel = 0u; channel < SENSOR_FILTER_COUNT; channel++) {
+		filter_init(&sensor_filter.filter[channel], &sensor_filter_default[channel]);
+	}
+}
+
+static void sensor_filter_update_config(void) {
+	for (uint8_t channel = 0u; channel < SENSOR_FILTER_COUNT; channel++) {
+		if (sensor_filter.update[channel]) {
+			filter_init(&sensor_filter.filter[channel], &sensor_filter.pending[channel]);
+			sensor_filter.update[channel] = false;
+		}
+	}
+}
+
+/// The last output is held over short read failures, invalid is published after FILTER_INVALID_HOLD of them.
+static int32_t sensor_filter_apply(uint8_t channel, int32_t sample, int32_t invalid) {
+	int32_t output;
+
+	if (filter_update(&sensor_filter.filter[channel], sample, sample != invalid, &output)) {
+		return invalid;
+	}
+
+	return output;
+}
+
+/// Called every sensor period: die temperature pool and load state.
+static void sensor_self_heating_update(void) {
+	float t_sens;
+
+	if (self_heating.countdown > 1u) {
+		self_heating.countdown--;
+	} else {
+		self_heating.countdown = SELF_HEATING_DIE_PERIOD;
+
+		if (!temperature_sensor_sample_get(&t_sens)) {
+			add_t_sens_to_pool((int16_t) (t_sens * TEMPERATURE_SCALE));
+		}
+		self_heating.load.t_die = calculate_t_sens_avg();
+	}
+
+	self_heating.load.duty = fan_get_duty_permille();
+	self_heating.load.wifi = blufi_get_wifi_active() != 0;
+}
+
+/// One row of the logged run, the raw SHT4x temperature against the reference.
+static void sensor_self_heating_log(int16_t t_sht) {
+	const struct sensor_tag_s *tag = &sensor_direction.tag;
+	int16_t reference;
+
+	if (!self_heating_calibration_running() || (self_heating.load.t_die == TEMPERATURE_INVALID)) {
+		return;
+	}
+
+	reference = self_heating_calibration_reference();
+	if (reference == TEMPERATURE_INVALID) {
+		if ((tag->direction != DIRECTION_OUT) || (tag->since_inversion < SENSOR_SETTLE_TIME_NTC)) {
+			return;
+		}
+		reference = get_internal_temperature();
+		if (reference == TEMPERATURE_INVALID) {
+			return;
+		}
+	}
+
+	printf("self_heating,%d,%d,%u,%u,%d\r\n", t_sht, self_heating.load.t_die, self_heating.load.duty, self_heating.load.wifi, reference);
+
+	self_heating_calibration_add(&self_heating.load, t_sht, reference);
+}
+
+/// SHT4x temperature brought back to the ambient air, RH moved to that temperature at constant vapor pressure.
+static void sensor_self_heating_compensate(int16_t *t_amb, uint16_t *r_hum) {
+	struct self_heating_s model;
+	int16_t t_sht = *t_amb;
+
+	get_self_heating(&model);
+
+	self_heating.rise = self_heating_rise(&model, &self_heating.load, t_sht);
+	if (!self_heating.rise) {
+		return;
+	}
+
+	*t_amb = (int16_t) (t_sht - self_heating.rise);
+	*r_hum = humidity_relative_at(t_sht, *r_hum, *t_amb);
+}
+
+static void sensor_store_sht4x(int ret, int16_t *t_amb, uint16_t *r_hum) {
+	const struct sensor_tag_s *tag = &sensor_direction.tag;
+	int32_t rh;
+
+	if (!ret) {
+		sensor_self_heating_log(*t_amb);
+		sensor_self_heating_compensate(t_amb, r_hum);
+
+		*t_amb += TEMPERATURE_OFFSET_FIXED + get_temperature_offset();
+
+		rh = (int32_t) *r_hum + RELATIVE_HUMIDITY_OFFSET_FIXED + get_relative_humidity_offset();
+		if (rh < 0) {
+			rh = 0;
+		} else if (rh > (int32_t) (100u * RELATIVE_HUMIDITY_SCALE)) {
+			rh = 100u * RELATIVE_HUMIDITY_SCALE;
+		}
+		*r_hum = (uint16_t) rh;
+	}
+
+	// Still the air of the previous direction, the estimates hold their value
+	if (!sensor_sample_settled(tag, SENSOR_SAMPLE_SHT4X)) {
+		return;
+	}
+
+	if (sensor_side(tag->direction) == SENSOR_SIDE_INDOOR) {
+		set_temperature((int16_t) sensor_filter_apply(SENSOR_FILTER_TEMPERATURE, *t_amb, TEMPERATURE_INVALID));
+		set_relative_humidity((uint16_t) sensor_filter_apply(SENSOR_FILTER_RELATIVE_HUMIDITY, *r_hum, RELATIVE_HUMIDITY_INVALID));
+	} else {
+		// Incoming air: the regenerator changes its temperature, not its water content
+		set_external_absolute_humidity((uint16_t) sensor_filter_apply(SENSOR_FILTER_EXTERNAL_ABSOLUTE_HUMIDITY, humidity_absolute(*t_amb, *r_hum), ABSOLUTE_HUMIDITY_INVALID));
+	}
+}
+
+static void sensor_store_voc(uint16_t voc_idx) {
+	const struct sensor_tag_s *tag = &sensor_direction.tag;
+
+	if (!sensor_sample_settled(tag, SENSOR_SAMPLE_VOC)) {
+		return;
+	}
+
+	if (sensor_side(tag->direction) == SENSOR_SIDE_INDOOR) {
+		set_voc((uint16_t) sensor_filter_apply(SENSOR_FILTER_VOC, voc_idx, VOC_INVALID));
+	} else {
+		set_external_voc((uint16_t) sensor_filter_apply(SENSOR_FILTER_EXTERNAL_VOC, voc_idx, VOC_INVALID));
+	}
+}
+
+static void sensor_voc_state_save(void) {
+	struct voc_algorithm_state_s state;
+
+	sgp40_get_states(&state.mean, &state.std);
+	state.timestamp = (uint32_t) time(NULL);
+
+	set_voc_algorithm_state(&state);
+
+	voc_state.save_time = voc_state.run_time;
+}
+
+/// Time keeps running across software resets, after a power on it restarts and the checkpoint is too old or in the future.
+static void sensor_voc_state_restore(void) {
+	struct voc_algorithm_state_s state;
+	uint32_t now = (uint32_t) time(NULL);
+
+	get_voc_algorithm_state(&state);
+
+	if (state.std <= 0) {
+		return;
+	}
+
+	if ((state.timestamp > now) || ((now - state.timestamp) > VOC_STATE_MAX_AGE)) {
+		printf("voc state - expired\r\n");
+
+		// Invalidate it, a later software reset could otherwise find it fresh again
+		memset(&state, 0, sizeof(state));
+		set_voc_algorithm_state(&state);
+
+		return;
+	}
+
+	sgp40_set_states(state.mean, state.std);
+
+	voc_state.run_time = VOC_STATE_LEARNING_TIME;
+	voc_state.save_time = VOC_STATE_LEARNING_TIME;
+
+	printf("voc state - restored, age: %lu s\r\n", (unsigned long) (now - state.timestamp));
+}
+
+static void sensor_voc_state_update(uint32_t elapsed) {
+	voc_state.run_time += elapsed;
+
+	if ((voc_state.run_time >= VOC_STATE_LEARNING_TIME) && ((voc_state.run_time - voc_state.save_time) >= VOC_STATE_SAVE_PERIOD)) {
+		sensor_voc_state_save();
+	}
+}
+
+/// Planned restarts (OTA, commands) save the latest states.
+static void sensor_voc_state_shutdown(void) {
+	if (voc_state.run_time >= VOC_STATE_LEARNING_TIME) {
+		sensor_voc_state_save();
+	}
+}
+
+static uint32_t sensor_voc_sampling_interval(void) {
+	return voc_power.mode == VOC_POWER_LOW ? SGP40_SAMPLING_INTERVAL_LOW_POWER : SGP40_SAMPLING_INTERVAL;
+}
+
+/// One sample per period at 1 Hz, one every SGP40_SAMPLING_INTERVAL_LOW_POWER periods in low power.
+static bool sensor_voc_due(void) {
+	if (voc_power.mode == VOC_POWER_NORMAL) {
+		return true;
+	}
+
+	if (voc_power.countdown > 1u) {
+		voc_power.countdown--;
+
+		return false;
+	}
+
+	voc_power.countdown = SGP40_SAMPLING_INTERVAL_LOW_POWER;
+
+	return true;
+}
+
+static int sensor_voc_start(int16_t t_amb, uint16_t r_hum) {
+	int64_t start_us = esp_timer_get_time();
+	int ret;
+
+	if (!voc_power.heater_on_us) {
+		voc_power.heater_on_us = start_us;
+	}
+
+	ret = sgp40_start(t_amb, r_hum);
+	voc_power.stats[voc_power.mode].bus_us += esp_timer_get_time() - start_us;
+
+	return ret;
+}
+
+static void sensor_voc_heater_off(void) {
+	int64_t start_us = esp_timer_get_time();
+
+	sgp40_heater_off();
+	voc_power.stats[voc_power.mode].bus_us += esp_timer_get_time() - start_us;
+
+	if (voc_power.heater_on_us) {
+		voc_power.stats[voc_power.mode].heater_us += esp_timer_get_time() - voc_power.heater_on_us;
+		voc_power.heater_on_us = 0;
+	}
+}
+
+/// Complete a started conversion, in low power the first one only preheats the hotplate.
+static void sensor_voc_finish(int ret, int64_t start_us, int16_t t_amb, uint16_t r_hum) {
+	uint16_t voc_idx = VOC_INVALID;
+	uint16_t voc_raw;
+	int64_t bus_us;
+
+	if (!ret && (voc_power.mode == VOC_POWER_LOW)) {
+		sensor_wait_since(start_us, SGP40_MEASURE_WAIT_MS);
+		bus_us = esp_timer_get_time();
+		sgp40_read_raw(&voc_raw);
+		voc_power.stats[voc_power.mode].bus_us += esp_timer_get_time() - bus_us;
+
+		sensor_wait_since(start_us, SGP40_MEASURE_WAIT_MS + SGP40_PREHEAT_WAIT_MS);
+		start_us = esp_timer_get_time();
+		ret = sensor_voc_start(t_amb, r_hum);
+	}
+
+	if (!ret) {
+		sensor_wait_since(start_us, SGP40_MEASURE_WAIT_MS);
+		bus_us = esp_timer_get_time();
+		ret = sgp40_read(&voc_idx);
+		voc_power.stats[voc_power.mode].bus_us += esp_timer_get_time() - bus_us;
+	}
+
+	if (voc_power.mode == VOC_POWER_LOW) {
+		sensor_voc_heater_off();
+	}
+
+	sensor_store_voc(voc_idx);
+
+	if (!ret) {
+		voc_power.stats[voc_power.mode].samples++;
+		sensor_voc_state_update(sensor_voc_sampling_interval());
+	}
+}
+
+static void sensor_voc_power_set_mode(uint8_t mode) {
+	voc_power.mode = mode;
+	voc_power.countdown = SGP40_SAMPLING_INTERVAL_LOW_POWER;
+	voc_power.stable_time = 0u;
+
+	if (mode == VOC_POWER_LOW) {
+		sensor_voc_heater_off();
+	}
+
+	sgp40_set_sampling_interval(sensor_voc_sampling_interval());
+
+	printf("voc power - %s\r\n", voc_power_name[mode]);
+}
+
+/// Called every sensor period: time accounting and mode switching on RH / VOC rises.
+static void sensor_voc_power_update(void) {
+	int64_t now_us = esp_timer_get_time();
+	uint16_t rh = get_relative_humidity();
+	uint16_t voc = get_voc();
+	bool rising = false;
+
+	if (voc_power.last_us) {
+		voc_power.stats[voc_power.mode].time_us += now_us - voc_power.last_us;
+	}
+	voc_power.last_us = now_us;
+
+	if (voc_power.heater_on_us) {
+		voc_power.stats[voc_power.mode].heater_us += now_us - voc_power.heater_on_us;
+		voc_power.heater_on_us = now_us;
+	}
+
+	if (!voc_power.selected && (voc_power.mode == VOC_POWER_LOW)) {
+		sensor_voc_power_set_mode(VOC_POWER_NORMAL);
+	}
+
+	if (++voc_power.elapsed < SGP40_SAMPLING_INTERVAL_LOW_POWER) {
+		return;
+	}
+	voc_power.elapsed = 0u;
+
+	// Room values only, the incoming air is not stored
+	if ((rh != RELATIVE_HUMIDITY_INVALID) && (voc_power.rh_ref != RELATIVE_HUMIDITY_INVALID) && (rh >= voc_power.rh_ref + VOC_POWER_RH_RISE)) {
+		rising = true;
+	}
+	if ((voc != VOC_INVALID) && (voc_power.voc_ref != VOC_INVALID) && (voc >= voc_power.voc_ref + VOC_POWER_VOC_RISE)) {
+		rising = true;
+	}
+	voc_power.rh_ref = rh;
+	voc_power.voc_ref = voc;
+
+	if (rising) {
+		voc_power.stable_time = 0u;
+
+		if (voc_power.mode == VOC_POWER_LOW) {
+			sensor_voc_power_set_mode(VOC_POWER_NORMAL);
+		}
+	} else if (voc_power.selected && (voc_power.mode == VOC_POWER_NORMAL)) {
+		voc_power.stable_time += SGP40_SAMPLING_INTERVAL_LOW_POWER;
+
+		if (voc_power.stable_time >= VOC_POWER_STABLE_TIME) {
+			sensor_voc_power_set_mode(VOC_POWER_LOW);
+		}
+	}
+}
+
+/// Night at or below the threshold minus LUMINOSITY_DIFFERENTIAL_LOW, day above the threshold plus LUMINOSITY_DIFFERENTIAL_HIGH.
+static uint8_t sensor_lux_state(uint32_t lux, uint8_t state, uint16_t threshold) {
+	if (lux <= (threshold - LUMINOSITY_DIFFERENTIAL_LOW)) {
+		return LUMINOSITY_STATE_NIGHT;
+	}
+
+	if (lux > (threshold + LUMINOSITY_DIFFERENTIAL_HIGH)) {
+		return LUMINOSITY_STATE_DAY;
+	}
+
+	return state == LUMINOSITY_STATE_UNKNOWN ? LUMINOSITY_STATE_DAY : state;
+}
+
+/// Only the crossing out of the current state raises the interrupt.
+static int sensor_lux_set_window(uint8_t state, uint16_t threshold) {
+	switch (state) {
+	case LUMINOSITY_STATE_DAY:
+		return ltr303_set_window(threshold - LUMINOSITY_DIFFERENTIAL_LOW + 1u, LTR303_WINDOW_NONE_HIGH);
+	case LUMINOSITY_STATE_NIGHT:
+		return ltr303_set_window(LTR303_WINDOW_NONE_LOW, threshold + LUMINOSITY_DIFFERENTIAL_HIGH);
+	default:
+		return ltr303_set_window(LTR303_WINDOW_NONE_LOW, LTR303_WINDOW_NONE_HIGH);
+	}
+}
+
+/// One status read per period, the data is read on threshold events and every LUX_REFRESH_PERIOD for the reported value.
+static void sensor_lux_update(void) {
+	uint8_t lux_set = get_lux_set();
+	uint8_t status = 0u;
+	uint8_t state = LUMINOSITY_STATE_UNKNOWN;
+	uint16_t threshold = 0u;
+	uint32_t lux;
+	int ret;
+
+	if (rgb_led_is_on()) {
+		// The LED light reaches the sensor, pending events are handled once it is off
+		return;
+	}
+
+	if (lux_set != lux_window.lux_set) {
+		lux_window.lux_set = lux_set;
+		lux_window.state = LUMINOSITY_STATE_UNKNOWN;
+		sensor_lux_set_window(LUMINOSITY_STATE_UNKNOWN, 0u);
+		set_luminosity_state(LUMINOSITY_STATE_UNKNOWN);
+	} else {
+		if (ltr303_read_status(&status)) {
+			return;
+		}
+
+		if (status & LTR303_STATUS_INT) {
+			lux_window.event = true;
+		} else if (lux_window.countdown > 1u) {
+			lux_window.countdown--;
+
+			return;
+		}
+	}
+
+	ret = ltr303_measure_lux(&lux);
+	if (ret > 0) {
+		// Range change in progress, read again on the next period
+		lux_window.countdown = 1u;
+
+		return;
+	}
+	lux_window.countdown = LUX_REFRESH_PERIOD;
+
+	set_lux(ret ? LUX_INVALID : lux);
+
+	if ((lux_set == LUX_THRESHOLD_SETTING_NOT_CONFIGURED) || (lux_set >= ARRAY_SIZE(luminosity_threshold_convert)) || ret) {
+		return;
+	}
+
+	// The state follows the hardware debounced events, a plain refresh does not change it
+	if (!lux_window.event && (lux_window.state != LUMINOSITY_STATE_UNKNOWN)) {
+		return;
+	}
+	lux_window.event = false;
+
+	threshold = luminosity_threshold_convert[lux_set];
+	state = sensor_lux_state(lux, lux_window.state, threshold);
+
+	if (state != lux_window.state) {
+		if (sensor_lux_set_window(state, threshold)) {
+			return;
+		}
+
+		lux_window.state = state;
+		set_luminosity_state(state);
+	}
+}
+
+static void sensor_store_ntc(int16_t temp) {
+	const struct sensor_tag_s *tag = &sensor_direction.tag;
+
+	if (!sensor_sample_settled(tag, SENSOR_SAMPLE_NTC)) {
+		return;
+	}
+
+	// Without airflow the regenerator temperature is neither side
+	if (tag->direction == DIRECTION_OUT) {
+		set_internal_temperature(temp);
+	} else if (tag->direction == DIRECTION_IN) {
+		set_external_temperature(temp);
+	}
+}
+
 static void sensor_task(void *pvParameters) {
 	TickType_t sensor_task_time;
-	float t_amb;
-	float r_hum;
-	float temp;
-	float lux;
-	uint16_t voc_idx;
-//	float t_sens;
+	int64_t cycle_start_us;
+	int16_t t_amb = TEMPERATURE_INVALID;
+	uint16_t r_hum = RELATIVE_HUMIDITY_INVALID;
+	int16_t temp;
+	uint32_t active_us;
 
 	sensor_task_time = xTaskGetTickCount();
 
 	while(true) {
-		if (!sht4x_sample(&t_amb, &r_hum)) {
-			t_amb += (float)TEMPERATURE_OFFSET_FIXED / (float)TEMPERATURE_SCALE;
-			t_amb += (float)get_temperature_offset() / (float)TEMPERATURE_SCALE;
+		cycle_start_us = esp_timer_get_time();
+
+		sensor_direction_update();
+		sensor_filter_update_config();
+		sensor_self_heating_update();
+
+#if SENSOR_PIPELINE
+		int64_t sht4x_start_us;
+		int64_t sgp40_start_us;
+		int sht4x_ret;
+		int sgp40_ret;
+
+		bool voc_due = sensor_voc_due();
 
-			r_hum += (float)RELATIVE_HUMIDITY_OFFSET_FIXED / (float)RELATIVE_HUMIDITY_SCALE;
-			r_hum += (float)get_relative_humidity_offset() / (float)RELATIVE_HUMIDITY_SCALE;
+		// Start both conversions: the SGP40 is compensated with the previous SHT4x sample, one period old.
+		// Each wait counts from the end of its own command, a slow bus grant must not eat into it
+		sht4x_ret = sht4x_start();
+		sht4x_start_us = esp_timer_get_time();
+		sgp40_ret = voc_due ? sensor_voc_start(t_amb, r_hum) : -1;
+		sgp40_start_us = esp_timer_get_time();
+
+		// LTR303 and NTC do not depend on the pending conversions, run them in the wait window (NTC is already filtered in background)
+		sensor_lux_update();
+
+		sensor_ntc_sample(&temp);
+		sensor_store_ntc(temp);
+
+		if (!sht4x_ret) {
+			sensor_wait_since(sht4x_start_us, SHT4X_MEASURE_WAIT_MS);
+			sht4x_ret = sht4x_read(&t_amb, &r_hum);
+		} else {
+			t_amb = TEMPERATURE_INVALID;
+			r_hum = RELATIVE_HUMIDITY_INVALID;
 		}
-		if (get_direction_state() != DIRECTION_IN) {
-			set_temperature(SET_VALUE_TO_TEMP_RAW(t_amb));
-			set_relative_humidity(SET_VALUE_TO_RH_RAW(r_hum));
+		sensor_store_sht4x(sht4x_ret, &t_amb, &r_hum);
+
+		if (voc_due) {
+			sensor_voc_finish(sgp40_ret, sgp40_start_us, t_amb, r_hum);
 		}
+#else
+		sensor_store_sht4x(sht4x_sample(&t_amb, &r_hum), &t_amb, &r_hum);
 
+		if (sensor_voc_due()) {
+			int sgp40_ret = sensor_voc_start(t_amb, r_hum);
+			int64_t sgp40_start_us = esp_timer_get_time();
 
-		sgp40_sample(t_amb, r_hum, &voc_idx);
-		if (get_direction_state() != DIRECTION_IN) {
-			set_voc(SET_VALUE_TO_VOC_RAW(voc_idx));
+			sensor_voc_finish(sgp40_ret, sgp40_start_us, t_amb, r_hum);
 		}
 
-		ltr303_measure_lux(&lux);
-		if (!rgb_led_is_on()) {
-			set_lux(SET_VALUE_TO_LUX_RAW(lux));
-		}
+		sensor_lux_update();
 
 		sensor_ntc_sample(&temp);
-		if (get_direction_state() == DIRECTION_OUT) {
-			set_internal_temperature(SET_VALUE_TO_TEMP_RAW(temp));
-		} else if (get_direction_state() == DIRECTION_IN) {
-			set_external_temperature(SET_VALUE_TO_TEMP_RAW(temp));
-		}
+		sensor_store_ntc(temp);
+#endif
+
+		sensor_voc_power_update();
 
-//		temperature_sensor_sample_get(&t_sens);
-//		add_t_sens_to_pool(t_sens);
-//		printf("t_sens: %.1f - t_sens_avg: %.1f\r\n", t_sens, calculate_t_sens_avg());
+		active_us = (uint32_t) (esp_timer_get_time() - cycle_start_us);
+		sensor_active_time.last_us = active_us;
+		if (active_us > sensor_active_time.max_us) {
+			sensor_active_time.max_us = active_us;
+		}
 
-//		printf("t_amb: %.1f - r_hum: %.1f - voc_idx: %u - temp: %.1f - lux: %.1f\r\n", t_amb, r_hum, voc_idx, temp, lux);
+//		printf("t_amb: %d - r_hum: %u - voc_idx: %u - temp: %d - lux: %u\r\n", t_amb, r_hum, voc_idx, temp, lux);
 
 		vTaskDelayUntil(&sensor_task_time, SENSOR_TASK_PERIOD);
 	}
 }
 
+/// The mode switches to low power at the next rise check.
+void sensor_set_voc_low_power(bool low_power) {
+	if (low_power && !voc_power.selected) {
+		voc_power.stable_time = VOC_POWER_STABLE_TIME;
+	}
+
+	voc_power.selected = low_power;
+}
+
+bool sensor_get_voc_low_power(void) {
+	return voc_power.selected;
+}
+
+/// Average SGP40 current from the measured heater duty cycle and the datasheet currents.
+void sensor_voc_power_report(void) {
+	for (uint8_t mode = 0u; mode < VOC_POWER_COUNT; mode++) {
+		uint64_t time_us = voc_power.stats[mode].time_us;
+		uint64_t heater_us = voc_power.stats[mode].heater_us;
+
+		if (!time_us) {
+			printf("%s: no data\r\n", voc_power_name[mode]);
+			continue;
+		}
+
+		if (heater_us > time_us) {
+			heater_us = time_us;
+		}
+
+		printf("%s: %lu s - %lu samples - heater %lu.%lu %% - bus %lu us/s - current %lu uA\r\n",
+				voc_power_name[mode],
+				(unsigned long) (time_us / 1000000u),
+				(unsigned long) voc_power.stats[mode].samples,
+				(unsigned long) (heater_us * 1000u / time_us / 10u), (unsigned long) (heater_us * 1000u / time_us % 10u),
+				(unsigned long) (voc_power.stats[mode].bus_us * 1000000u / time_us),
+				(unsigned long) ((heater_us * SGP40_CURRENT_MEASURE_UA + (time_us - heater_us) * SGP40_CURRENT_IDLE_UA) / time_us));
+	}
+}
+
+/// Samples per side and how many of them reached the estimates, with the current estimates.
+void sensor_direction_report(void) {
+	uint16_t ah_out = get_external_absolute_humidity();
+	uint16_t ah_saturation = humidity_absolute_saturation(get_external_temperature());
+
+	printf("direction: %u - since inversion: %lu s\r\n", sensor_direction.tag.direction, (unsigned long) sensor_direction.tag.since_inversion);
+
+	for (uint8_t side = 0u; side < SENSOR_SIDE_COUNT; side++) {
+		for (uint8_t sample = 0u; sample < SENSOR_SAMPLE_COUNT; sample++) {
+			printf("%s %s: %lu samples - %lu settled\r\n", sensor_side_name[side], sensor_sample_name[sample],
+					(unsigned long) sensor_direction.stats[side][sample].samples, (unsigned long) sensor_direction.stats[side][sample].settled);
+		}
+	}
+
+	printf("indoor: t %d - rh %u - voc %u - ntc %d\r\n", get_temperature(), get_relative_humidity(), get_voc(), get_internal_temperature());
+	printf("outdoor: ah %u - voc %u - ntc %d", ah_out, get_external_voc(), get_external_temperature());
+	if ((ah_out != ABSOLUTE_HUMIDITY_INVALID) && (ah_saturation != ABSOLUTE_HUMIDITY_INVALID) && ah_saturation) {
+		// Relative humidity at the outdoor NTC temperature
+		printf(" - rh %lu", (unsigned long) ((uint32_t) ah_out * 100u * RELATIVE_HUMIDITY_SCALE / ah_saturation));
+	}
+	printf("\r\n");
+}
+
+/// Applied by the sensor task at its next period, the channel restarts from an empty window.
+int sensor_set_filter(const char *name, const struct filter_config_s *config) {
+	struct filter_s check;
+
+	if (filter_init(&check, config)) {
+		return -1;
+	}
+
+	for (uint8_t channel = 0u; channel < SENSOR_FILTER_COUNT; channel++) {
+		if (!strcmp(name, sensor_filter_name[channel])) {
+			sensor_filter.pending[channel] = *config;
+			sensor_filter.update[channel] = true;
+
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void sensor_filter_report(void) {
+	for (uint8_t channel = 0u; channel < SENSOR_FILTER_COUNT; channel++) {
+		const struct filter_s *filter = &sensor_filter.filter[channel];
+
+		printf("%s: window %u - k %u.%u - ema 1/%u - mad min %ld - %lu samples - %lu rejected - %lu invalid\r\n",
+				sensor_filter_name[channel], filter->config.window, filter->config.hampel_k / 10u, filter->config.hampel_k % 10u,
+				1u << filter->config.ema_shift, (long) filter->config.mad_min,
+				(unsigned long) filter->samples, (unsigned long) filter->rejected, (unsigned long) filter->invalid);
+	}
+}
+
+void sensor_self_heating_report(void) {
+	struct self_heating_s model;
+
+	get_self_heating(&model);
+
+	printf("model: die %ld permille - fan %ld - wifi %ld - offset %ld (0.01 C)\r\n", (long) model.die, (long) model.fan, (long) model.wifi, (long) model.offset);
+	printf("die avg %d - fan duty %u permille - wifi %s - correction %ld (0.01 C)\r\n", self_heating.load.t_die, self_heating.load.duty, self_heating.load.wifi ? "on" : "off", (long) -self_heating.rise);
+	printf("calibration: %s - %lu samples\r\n", self_heating_calibration_running() ? "running" : "stopped", (unsigned long) self_heating_calibration_samples());
+}
+
+void sensor_get_active_time(uint32_t *last_us, uint32_t *max_us) {
+	*last_us = sensor_active_time.last_us;
+	*max_us = sensor_active_time.max_us;
+}
+
+static int32_t sensor_benchmark_err(int32_t err_max, int32_t reference, int32_t fixed) {
+	int32_t err = abs((int) (reference - fixed));
+
+	return err > err_max ? err : err_max;
+}
+
+static void sensor_benchmark_print(const char *name, uint32_t reference_cycles, uint32_t fixed_cycles, int32_t err_max) {
+	printf("%s: float %lu cycles - fixed %lu cycles - max error %ld\n",
+			name,
+			reference_cycles / SENSOR_BENCHMARK_ITERATIONS,
+			fixed_cycles / SENSOR_BENCHMARK_ITERATIONS,
+			err_max);
+}
+
+/// Float reference against the integer conversions: cycles per call and worst difference in runtime units.
+void sensor_conversion_benchmark(void) {
+	volatile int32_t sink;
+	int16_t t_ref, t_fix;
+	uint16_t u_ref, u_fix, v_ref, v_fix;
+	uint32_t start;
+	uint32_t reference_cycles;
+	uint32_t fixed_cycles;
+	int32_t err_max;
+	uint32_t n;
+
+	// SHT4x: raw words to 0.01 C / 0.01 %RH
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sht4x_convert_reference((uint16_t) (n * SENSOR_BENCHMARK_STEP), (uint16_t) (n * SENSOR_BENCHMARK_STEP), &t_ref, &u_ref);
+		sink = t_ref + u_ref;
+	}
+	reference_cycles = esp_cpu_get_cycle_count() - start;
+
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sht4x_convert((uint16_t) (n * SENSOR_BENCHMARK_STEP), (uint16_t) (n * SENSOR_BENCHMARK_STEP), &t_fix, &u_fix);
+		sink = t_fix + u_fix;
+	}
+	fixed_cycles = esp_cpu_get_cycle_count() - start;
+
+	err_max = 0;
+	for (n = 0u; n <= UINT16_MAX; n++) {
+		sht4x_convert_reference((uint16_t) n, (uint16_t) n, &t_ref, &u_ref);
+		sht4x_convert((uint16_t) n, (uint16_t) n, &t_fix, &u_fix);
+		err_max = sensor_benchmark_err(err_max, t_ref, t_fix);
+		err_max = sensor_benchmark_err(err_max, u_ref, u_fix);
+	}
+	sensor_benchmark_print("sht4x", reference_cycles, fixed_cycles, err_max);
+
+	// SGP40: compensation ticks over -45..130 C and 0..100 %RH
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sgp40_compensation_ticks_reference((int16_t) (n * 17u - 4500u), (uint16_t) (n * 10u), &u_ref, &v_ref);
+		sink = u_ref + v_ref;
+	}
+	reference_cycles = esp_cpu_get_cycle_count() - start;
+
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sgp40_compensation_ticks((int16_t) (n * 17u - 4500u), (uint16_t) (n * 10u), &u_fix, &v_fix);
+		sink = u_fix + v_fix;
+	}
+	fixed_cycles = esp_cpu_get_cycle_count() - start;
+
+	err_max = 0;
+	for (n = 0u; n <= 175u * TEMPERATURE_SCALE; n++) {
+		sgp40_compensation_ticks_reference((int16_t) ((int32_t) n - 45 * TEMPERATURE_SCALE), (uint16_t) (n % (100u * RELATIVE_HUMIDITY_SCALE + 1u)), &u_ref, &v_ref);
+		sgp40_compensation_ticks((int16_t) ((int32_t) n - 45 * TEMPERATURE_SCALE), (uint16_t) (n % (100u * RELATIVE_HUMIDITY_SCALE + 1u)), &u_fix, &v_fix);
+		err_max = sensor_benchmark_err(err_max, u_ref, u_fix);
+		err_max = sensor_benchmark_err(err_max, v_ref, v_fix);
+	}
+	sensor_benchmark_print("sgp40", reference_cycles, fixed_cycles, err_max);
+
+	// LTR303: channel pairs to lux
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sink = ltr303_convert_lux_reference((uint16_t) (n * SENSOR_BENCHMARK_STEP), (uint16_t) (n * 23u), n % LTR303_RANGE_COUNT);
+	}
+	reference_cycles = esp_cpu_get_cycle_count() - start;
+
+	start = esp_cpu_get_cycle_count();
+	for (n = 0u; n < SENSOR_BENCHMARK_ITERATIONS; n++) {
+		sink = ltr303_convert_lux((uint16_t) (n * SENSOR_BENCHMARK_STEP), (uint16_t) (n * 23u), n % LTR303_RANGE_COUNT);
+	}
+	fixed_cycles = esp_cpu_get_cycle_count() - start;
+	(void) sink;
+
+	err_max = 0;
+	for (n = 0u; n <= UINT16_MAX; n++) {
+		uint16_t ch0 = (uint16_t) ((n & 0xffu) * 257u);
+		uint16_t ch1 = (uint16_t) ((n >> 8) * 257u);
+
+		uint8_t range = (uint8_t) (n % LTR303_RANGE_COUNT);
+
+		err_max = sensor_benchmark_err(err_max, (int32_t) ltr303_convert_lux_reference(ch0, ch1, range), (int32_t) ltr303_convert_lux(ch0, ch1, range));
+	}
+	sensor_benchmark_print("ltr303", reference_cycles, fixed_cycles, err_max);
+}
+
 ///
 int sensor_init(struct i2c_dev_s *i2c_dev, struct adc_dev_s *adc_dev) {
 
 	sensor_i2c_binding(i2c_dev);
 	sensor_adc_binding(adc_dev);
 
+	sensor_filter_init();
+
+	sensor_voc_state_restore();
+	esp_register_shutdown_handler(sensor_voc_state_shutdown);
+
+	interp_lut_build(&ntc_lut);
+
+	if (sensor_ntc_start()) {
+		printf("sensor_ntc_start - error\r\n");
+	}
+
 	temperature_sensor_init();
 
 	BaseType_t task_created = xTaskCreate(sensor_task, "sensor_task", SENSOR_TASK_STACK_SIZE, NULL, SENSOR_TASK_PRIORITY, NULL);
@@ -247,23 +1279,23 @@ int temperature_sensor_sample_get(float *t_sens) {
 	return 0;
 }
 
-static void add_t_sens_to_pool(float t_sens) {
+static void add_t_sens_to_pool(int16_t t_sens) {
 	t_sens_pool[t_sens_idx] = t_sens;
 
 	t_sens_idx += 1u;
 	t_sens_idx %= T_SENS_POOL_SIZE;
 }
 
-static float calculate_t_sens_avg(void) {
-	double t_sens_sum = 0.f;
-	size_t t_sens_count = 0u;
+static int16_t calculate_t_sens_avg(void) {
+	int32_t t_sens_sum = 0;
+	int32_t t_sens_count = 0;
 
 	for (size_t i = 0u; i < T_SENS_POOL_SIZE; i++) {
-		if (t_sens_pool[i] != T_SENS_INVALID) {
-			t_sens_sum += (double)t_sens_pool[i];
+		if (t_sens_pool[i] != TEMPERATURE_INVALID) {
+			t_sens_sum += t_sens_pool[i];
 			t_sens_count++;
 		}
 	}
 
-	return (float)(t_sens_sum / (double)t_sens_count);
+	return t_sens_count ? (int16_t) (t_sens_sum / t_sens_count) : TEMPERATURE_INVALID;
 }
@@ -6,66 +6,100 @@
  */
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include "nvs_flash.h"
 #include "esp_efuse.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 
 #include "string.h"
 
 #include "system.h"
 #include "storage_internal.h"
 #include "types.h"
+#include "controller.h"
 
-#define MODE_SET_KEY		  "mode_set"
-#define SPEED_SET_KEY		  "speed_set"
-#define R_HUM_SET_KEY     	  "r_hum_set"
-#define LUX_SET_KEY		      "lux_set"
-#define VOC_SET_KEY		      "voc_set"
-#define TEMP_OFFSET_KEY	      "temp_offset"
-#define R_HUM_OFFSET_KEY      "r_hum_offset"
-#define FILTER_OPERATING_KEY  "filter"
-#define WRN_FLT_DISABLE_KEY   "wrnfltdisable"
-#define WIFI_SSID_KEY         "ssid"
-#define WIFI_PASSWORD_KEY     "password"
-#define WIFI_ACTIVE_KEY       "active"
-#define WIFI_PERIOD_KEY       "wifiperiod"
-#define SERVER_KEY            "server"
-#define PORT_KEY              "port"
-#define OTA_URL_KEY           "ota"
+#define STORAGE_CONFIG_KEY				"config"
+
+#define	STORAGE_TASK_STACK_SIZE			(configMINIMAL_STACK_SIZE * 3)
+#define	STORAGE_TASK_PRIORITY			(1)
+
+// Write-behind: one commit once the settings stop changing, a burst of key presses is a single flash write
+#define STORAGE_WRITE_BEHIND_QUIET		(pdMS_TO_TICKS(2000ul))
+#define STORAGE_WRITE_BEHIND_MAX		(pdMS_TO_TICKS(10000ul))	// Continuous changes are committed anyway
 
 static nvs_handle_t storage_handle;
 
+static TaskHandle_t storage_task_handle = NULL;
+static SemaphoreHandle_t storage_lock = NULL;							// NVS writes and commit
+static portMUX_TYPE storage_dirty_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static struct {
+	uint32_t dirty;					// One bit per storage_entry_id_e
+	TickType_t first_tick;			// First change since the last commit
+	TickType_t last_tick;
+	uint32_t requests;				// Saves asked by the setters
+	uint32_t entries;				// Entries changed in the committed blobs
+	uint32_t commits;
+} storage_write_behind;
+
+enum storage_boot_source_e {
+	STORAGE_BOOT_SOURCE_DEFAULT = 0,
+	STORAGE_BOOT_SOURCE_BLOB,
+	STORAGE_BOOT_SOURCE_LEGACY,
+	STORAGE_BOOT_SOURCE_UNKNOWN,
+	//
+	STORAGE_BOOT_SOURCE_COUNT,
+};
+
+static const char *const storage_boot_source_name[STORAGE_BOOT_SOURCE_COUNT] = {
+	[STORAGE_BOOT_SOURCE_DEFAULT] = "defaults",
+	[STORAGE_BOOT_SOURCE_BLOB] = "config blob",
+	[STORAGE_BOOT_SOURCE_LEGACY] = "legacy keys",
+	[STORAGE_BOOT_SOURCE_UNKNOWN] = "defaults, unknown config blob kept",
+};
+
+static struct {
+	uint8_t source;					// STORAGE_BOOT_SOURCE_*
+	uint32_t load_us;				// NVS reads only, a migration write is not counted
+	uint16_t version;				// Blob version found in flash, 0 when none
+	bool locked;					// Unknown blob version: never overwritten, the settings only live in RAM
+} storage_boot;
+
 static int storage_efuse_obtain(void);
 static int storage_read_entry_with_idx(size_t i);
-static int storage_save_entry_with_key(const char* key);
+static int storage_write_entry_with_idx(size_t i);
+static void storage_config_load(void);
+static int storage_save_entry(enum storage_entry_id_e id);
 static int storage_save_all_entry(void);
+static void storage_task(void *pvParameters);
+static void storage_shutdown(void);
 
 // Data on ram.
 //static __attribute__((section(".noinit"))) struct application_data_s application_data;
 static struct application_data_s application_data;
 
-static struct storage_entry_s storage_entry_poll[] = {
-		{ MODE_SET_KEY,		           &application_data.configuration_settings.mode_set,					  DATA_TYPE_UINT8, 	  1 },
-		{ SPEED_SET_KEY,		       &application_data.configuration_settings.speed_set,					  DATA_TYPE_UINT8, 	  1 },
+#define STORAGE_SCALAR_ENTRY(id, key, section, field, accessor, type, ctype, def, min, max, on_change) \
+	[STORAGE_ENTRY_##id] = { key, &application_data.section.field, DATA_TYPE_##type, sizeof(application_data.section.field) },
+#define STORAGE_STRING_ENTRY(id, key, section, field, accessor) \
+	[STORAGE_ENTRY_##id] = { key, application_data.section.field, DATA_TYPE_STRING, sizeof(application_data.section.field) },
+#define STORAGE_BLOB_ENTRY(id, key, section, field, accessor, ctype) \
+	[STORAGE_ENTRY_##id] = { key, &application_data.section.field, DATA_TYPE_BLOB, sizeof(ctype) },
+
+static const struct storage_entry_s storage_entry_poll[STORAGE_ENTRY_COUNT] = {
+	STORAGE_SCHEMA(STORAGE_SCALAR_ENTRY, STORAGE_STRING_ENTRY, STORAGE_BLOB_ENTRY)
+};
 
-		{ R_HUM_SET_KEY,		       &application_data.configuration_settings.relative_humidity_set,		  DATA_TYPE_UINT8, 	  1 },
-		{ LUX_SET_KEY,		           &application_data.configuration_settings.lux_set,					  DATA_TYPE_UINT8, 	  1 },
-		{ VOC_SET_KEY,		           &application_data.configuration_settings.voc_set,					  DATA_TYPE_UINT8, 	  1 },
+_Static_assert(STORAGE_ENTRY_COUNT <= 32u, "storage_write_behind.dirty holds one bit per entry");
 
-		{ TEMP_OFFSET_KEY,    	       &application_data.configuration_settings.temperature_offset,			  DATA_TYPE_INT16, 	  2 },
-		{ R_HUM_OFFSET_KEY,  	       &application_data.configuration_settings.relative_humidity_offset,	  DATA_TYPE_INT16, 	  2 },
+#define STORAGE_CONFIG_DIRTY			((uint32_t) ((1ull << STORAGE_CONFIG_ENTRY_COUNT) - 1u))
 
- 		{ FILTER_OPERATING_KEY,        &application_data.saved_data.filter_operating,                         DATA_TYPE_UINT32,   4 },
- 		{ WRN_FLT_DISABLE_KEY,         &application_data.configuration_settings.wrn_flt_disable,              DATA_TYPE_UINT8,    1 },
+#define STORAGE_ENTRY_SIZE(id, key, section, field, ...)	+ sizeof(application_data.section.field)
 
-		{ WIFI_SSID_KEY,               &application_data.wifi_configuration_settings.ssid,                    DATA_TYPE_STRING,   SSID_SIZE + 1 },
-		{ WIFI_PASSWORD_KEY,           &application_data.wifi_configuration_settings.password,                DATA_TYPE_STRING,   PASSWORD_SIZE + 1 },
-		{ WIFI_ACTIVE_KEY,             &application_data.wifi_configuration_settings.active,                  DATA_TYPE_UINT8,    1 },
-		{ SERVER_KEY,                  &application_data.wifi_configuration_settings.server,                  DATA_TYPE_STRING,   SERVER_SIZE + 1 },
-		{ PORT_KEY,                    &application_data.wifi_configuration_settings.port,                    DATA_TYPE_STRING,   PORT_SIZE + 1 },
-		{ WIFI_PERIOD_KEY,             &application_data.wifi_configuration_settings.period,                  DATA_TYPE_UINT16,   2 },
-		{ OTA_URL_KEY,                 &application_data.wifi_configuration_settings.ota_url,                 DATA_TYPE_STRING,   OTA_URL_SIZE + 1 }
-};
+// Packed under storage_lock, or at boot before the storage task exists
+static uint8_t storage_config_buffer[sizeof(struct storage_config_header_s) STORAGE_SCHEMA_CONFIG(STORAGE_ENTRY_SIZE, STORAGE_ENTRY_SIZE, STORAGE_ENTRY_SIZE)];
 
 
 static void storage_init_noinit_data(void) {
@@ -85,29 +119,39 @@ static void storage_init_runtime_data(void) {
 	application_data.runtime_data.lux = LUX_INVALID;
 	application_data.runtime_data.internal_temperature = TEMPERATURE_INVALID;
 	application_data.runtime_data.external_temperature = TEMPERATURE_INVALID;
+	application_data.runtime_data.external_absolute_humidity = ABSOLUTE_HUMIDITY_INVALID;
+	application_data.runtime_data.external_voc = VOC_INVALID;
 	application_data.runtime_data.device_state = 0;
 	application_data.runtime_data.wifi_unlocked = 0;
 }
 
-static void storage_init_saved_data(void) {
-	memset(&application_data.saved_data, 0, sizeof(application_data.saved_data));
+static inline bool storage_in_range(int64_t value, int64_t min, int64_t max) {
+	return (value >= min) && (value <= max);
+}
+
+static inline void storage_no_change_hook(void) {
 }
 
-static void storage_init_configuration_settings(void) {
+#define STORAGE_SCALAR_DEFAULT(id, key, section, field, accessor, type, ctype, def, min, max, on_change) \
+	application_data.section.field = def;
+#define STORAGE_SCALAR_VALIDATE(id, key, section, field, accessor, type, ctype, def, min, max, on_change) \
+	if (!storage_in_range(application_data.section.field, min, max)) { \
+		printf("storage - %s out of range, default restored\r\n", key); \
+		application_data.section.field = def; \
+	}
+#define STORAGE_NO_CODE(...)
+
+static void storage_init_persistent_data(void) {
+	memset(&application_data.saved_data, 0, sizeof(application_data.saved_data));
 	memset(&application_data.configuration_settings, 0, sizeof(application_data.configuration_settings));
+	memset(&application_data.wifi_configuration_settings, 0, sizeof(application_data.wifi_configuration_settings));
 
-	application_data.configuration_settings.relative_humidity_set = RH_THRESHOLD_SETTING_NOT_CONFIGURED;
-	application_data.configuration_settings.voc_set = VOC_THRESHOLD_SETTING_NOT_CONFIGURED;
-	application_data.configuration_settings.lux_set = LUX_THRESHOLD_SETTING_NOT_CONFIGURED;
-	application_data.configuration_settings.speed_set = SPEED_NONE;
-	application_data.configuration_settings.mode_set = MODE_OFF;
-	application_data.configuration_settings.temperature_offset = 0;
-	application_data.configuration_settings.relative_humidity_offset = 0;
-	application_data.configuration_settings.wrn_flt_disable = 0;
+	STORAGE_SCHEMA(STORAGE_SCALAR_DEFAULT, STORAGE_NO_CODE, STORAGE_NO_CODE)
 }
 
-static void storage_init_wifi_configuration_settings(void) {
-	memset(&application_data.wifi_configuration_settings, 0, sizeof(application_data.wifi_configuration_settings));
+/// Values read from flash outside the schema range fall back to their default.
+static void storage_validate_persistent_data(void) {
+	STORAGE_SCHEMA(STORAGE_SCALAR_VALIDATE, STORAGE_NO_CODE, STORAGE_NO_CODE)
 }
 
 int storage_init(void) {
@@ -115,9 +159,7 @@ int storage_init(void) {
 
 	storage_init_noinit_data();
     storage_init_runtime_data();
-    storage_init_saved_data();
-    storage_init_configuration_settings();
-    storage_init_wifi_configuration_settings();
+    storage_init_persistent_data();
 
     storage_efuse_obtain();
 
@@ -129,23 +171,35 @@ int storage_init(void) {
 
     ret = nvs_open("storage", NVS_READWRITE, &storage_handle);
     if (ret == ESP_OK) {
-    	for (size_t i = 0u; i < ARRAY_SIZE(storage_entry_poll); i++ ) {
-    		storage_read_entry_with_idx(i);
-    	}
+    	storage_config_load();
+
+    	printf("storage - config loaded from %s in %lu us\r\n", storage_boot_source_name[storage_boot.source], (unsigned long) storage_boot.load_us);
     } else {
     	printf("nvs_open - ERROR\r\n");
     }
 
+    storage_lock = xSemaphoreCreateMutex();
+
+    // Pending entries are committed before a reboot or an OTA restart
+    esp_register_shutdown_handler(storage_shutdown);
+
+    if (xTaskCreate(storage_task, "storage_task", STORAGE_TASK_STACK_SIZE, NULL, STORAGE_TASK_PRIORITY, &storage_task_handle) != pdPASS) {
+    	storage_task_handle = NULL;
+    	printf("storage_task - ERROR\r\n");
+    }
+
     return 0;
 }
 
 int storage_set_default(void) {
 	memset(&application_data, 0, sizeof(application_data));
 
+	// A factory reset is asked for, it replaces a blob of an unknown version too
+	storage_boot.locked = false;
+
 	storage_init_noinit_data();
 	storage_init_runtime_data();
-    storage_init_saved_data();
-	storage_init_configuration_settings();
+	storage_init_persistent_data();
 	storage_save_all_entry();
 
 	return 0;
@@ -246,16 +300,26 @@ int set_voc(uint16_t voc) {
 	return 0;
 }
 
-uint16_t get_lux(void) {
+uint32_t get_lux(void) {
 	return application_data.runtime_data.lux;
 }
 
-int set_lux(uint16_t lux) {
+int set_lux(uint32_t lux) {
 	application_data.runtime_data.lux = lux;
 
 	return 0;
 }
 
+uint8_t get_luminosity_state(void) {
+	return application_data.runtime_data.luminosity_state;
+}
+
+int set_luminosity_state(uint8_t luminosity_state) {
+	application_data.runtime_data.luminosity_state = luminosity_state;
+
+	return 0;
+}
+
 int16_t get_internal_temperature(void) {
 	return application_data.runtime_data.internal_temperature;
 }
@@ -276,101 +340,26 @@ int set_external_temperature(int16_t temperature) {
 	return 0;
 }
 
-/// configuration settings
-uint8_t get_mode_set(void) {
-	return application_data.configuration_settings.mode_set;
+uint16_t get_external_absolute_humidity(void) {
+	return application_data.runtime_data.external_absolute_humidity;
 }
 
-int set_mode_set(uint8_t mode_set) {
-	application_data.configuration_settings.mode_set = mode_set;
-
-	storage_save_entry_with_key(MODE_SET_KEY);
+int set_external_absolute_humidity(uint16_t absolute_humidity) {
+	application_data.runtime_data.external_absolute_humidity = absolute_humidity;
 
 	return 0;
 }
 
-uint8_t get_speed_set(void) {
-	return application_data.configuration_settings.speed_set;
+uint16_t get_external_voc(void) {
+	return application_data.runtime_data.external_voc;
 }
 
-int set_speed_set(uint8_t speed_set) {
-	application_data.configuration_settings.speed_set = speed_set;
-
-	storage_save_entry_with_key(SPEED_SET_KEY);
+int set_external_voc(uint16_t voc) {
+	application_data.runtime_data.external_voc = voc;
 
 	return 0;
 }
 
-
-uint8_t get_relative_humidity_set(void) {
-	return application_data.configuration_settings.relative_humidity_set;
-}
-
-int set_relative_humidity_set(uint8_t relative_humidity_set) {
-	if (relative_humidity_set > RH_THRESHOLD_SETTING_HIGH) {
-		return -1;
-	}
-
-	application_data.configuration_settings.relative_humidity_set = relative_humidity_set;
-	storage_save_entry_with_key(R_HUM_SET_KEY);
-
-    return 0;
-}
-
-uint8_t get_lux_set(void) {
-	return application_data.configuration_settings.lux_set;
-}
-
-int set_lux_set(uint8_t lux_set) {
-	if (lux_set > LUX_THRESHOLD_SETTING_HIGH) {
-		return -1;
-	}
-
-	application_data.configuration_settings.lux_set = lux_set;
-	storage_save_entry_with_key(LUX_SET_KEY);
-
-    return 0;
-}
-
-uint8_t get_voc_set(void) {
-	return application_data.configuration_settings.voc_set;
-}
-
-int set_voc_set(uint8_t voc_set) {
-	if (voc_set > VOC_THRESHOLD_SETTING_HIGH) {
-		return -1;
-	}
-
-	application_data.configuration_settings.voc_set = voc_set;
-	storage_save_entry_with_key(VOC_SET_KEY);
-
-    return 0;
-}
-
-int16_t get_temperature_offset(void) {
-	return application_data.configuration_settings.temperature_offset;
-}
-
-int set_temperature_offset(int16_t temperature_offset) {
-	application_data.configuration_settings.temperature_offset = temperature_offset;
-
-	storage_save_entry_with_key(TEMP_OFFSET_KEY);
-
-    return 0;
-}
-
-int16_t get_relative_humidity_offset(void) {
-	return application_data.configuration_settings.relative_humidity_offset;
-}
-
-int set_relative_humidity_offset(int16_t relative_humidity_offset) {
-	application_data.configuration_settings.relative_humidity_offset = relative_humidity_offset;
-
-	storage_save_entry_with_key(R_HUM_OFFSET_KEY);
-
-    return 0;
-}
-
 uint16_t get_automatic_cycle_duration(void) {
     return application_data.runtime_data.automatic_cycle_duration;
 }
@@ -381,117 +370,47 @@ int set_automatic_cycle_duration(uint16_t automatic_cycle_duration) {
     return 0;
 }
 
-uint32_t get_filter_operating(void) {
-    return application_data.saved_data.filter_operating;
-
-}
-
-int set_filter_operating(uint32_t filter_operating) {
-    application_data.saved_data.filter_operating = filter_operating;
-
-    storage_save_entry_with_key(FILTER_OPERATING_KEY);
-
-    return 0;
-}
-
-uint8_t get_wrn_flt_disable(void) {
-    return application_data.configuration_settings.wrn_flt_disable;
-
-}
-
-int set_wrn_flt_disable(uint8_t wrn_flt_disable) {
-	application_data.configuration_settings.wrn_flt_disable = wrn_flt_disable;
-
-    storage_save_entry_with_key(WRN_FLT_DISABLE_KEY);
-
-    return 0;
-}
-
-
-void get_ssid(uint8_t *ssid){
-	memcpy(ssid, application_data.wifi_configuration_settings.ssid, sizeof(application_data.wifi_configuration_settings.ssid));
-}
-
-int set_ssid(const uint8_t *ssid) {
-	memset(application_data.wifi_configuration_settings.ssid, 0, sizeof(application_data.wifi_configuration_settings.ssid));
-	strcpy((char *)application_data.wifi_configuration_settings.ssid, (char *) ssid);
-
-	storage_save_entry_with_key(WIFI_SSID_KEY);
-
-	return 0;
-}
-
-void get_password(uint8_t *password){
-	memcpy(password, application_data.wifi_configuration_settings.password, sizeof(application_data.wifi_configuration_settings.password));
-}
-
-int set_password(const uint8_t *password) {
-	memset(application_data.wifi_configuration_settings.password, 0, sizeof(application_data.wifi_configuration_settings.password));
-	strcpy((char *)application_data.wifi_configuration_settings.password, (char *) password);
-
-	storage_save_entry_with_key(WIFI_PASSWORD_KEY);
-
-	return 0;
-}
-
-void get_server(uint8_t *server){
-	memcpy(server, application_data.wifi_configuration_settings.server, sizeof(application_data.wifi_configuration_settings.server));
-}
-
-int set_server(const uint8_t *server) {
-	memset(application_data.wifi_configuration_settings.server, 0, sizeof(application_data.wifi_configuration_settings.server));
-	strcpy((char *)application_data.wifi_configuration_settings.server, (char *) server);
-
-	storage_save_entry_with_key(SERVER_KEY);
-	return 0;
-}
-
-void get_port(uint8_t *port){
-	memcpy(port, application_data.wifi_configuration_settings.port, sizeof(application_data.wifi_configuration_settings.port));
-}
-
-int set_port(const uint8_t *port) {
-    memset(application_data.wifi_configuration_settings.port, 0, sizeof(application_data.wifi_configuration_settings.port));
-    strcpy((char *)application_data.wifi_configuration_settings.port , (char *) port);
-
-    storage_save_entry_with_key(PORT_KEY);
-    return 0;
-}
-
-uint16_t get_wifi_period(void) {
-	return application_data.wifi_configuration_settings.period;
-}
-
-int set_wifi_period(uint16_t wifi_period) {
-	application_data.wifi_configuration_settings.period = wifi_period;
-
-	storage_save_entry_with_key(WIFI_PERIOD_KEY);
-
-    return 0;
-}
-void get_ota_url(uint8_t *ota_url) {
-	memcpy(ota_url, application_data.wifi_configuration_settings.ota_url, sizeof(application_data.wifi_configuration_settings.ota_url));
-}
-
-int set_ota_url(const uint8_t *ota_url) {
-    memset(application_data.wifi_configuration_settings.ota_url, 0, sizeof(application_data.wifi_configuration_settings.ota_url));
-    strcpy((char *)application_data.wifi_configuration_settings.ota_url , (char *) ota_url);
-
-    storage_save_entry_with_key(OTA_URL_KEY);
-    return 0;
-}
-
-uint8_t get_wifi_active(void) {
-	return application_data.wifi_configuration_settings.active;
-}
-
-int set_wifi_active(uint8_t active) {
-	application_data.wifi_configuration_settings.active = active;
-
-	storage_save_entry_with_key(WIFI_ACTIVE_KEY);
+/// persisted settings, generated from storage_schema.h
+#define STORAGE_SCALAR_ACCESSORS(id, key, section, field, accessor, type, ctype, def, min, max, on_change) \
+	ctype get_##accessor(void) { \
+		return application_data.section.field; \
+	} \
+	\
+	int set_##accessor(ctype accessor) { \
+		if (!storage_in_range(accessor, min, max)) { \
+			return -1; \
+		} \
+		\
+		application_data.section.field = accessor; \
+		storage_save_entry(STORAGE_ENTRY_##id); \
+		on_change(); \
+		\
+		return 0; \
+	}
+#define STORAGE_STRING_ACCESSORS(id, key, section, field, accessor) \
+	void get_##accessor(uint8_t *accessor) { \
+		memcpy(accessor, application_data.section.field, sizeof(application_data.section.field)); \
+	} \
+	\
+	int set_##accessor(const uint8_t *accessor) { \
+		memset(application_data.section.field, 0, sizeof(application_data.section.field)); \
+		strncpy((char *) application_data.section.field, (const char *) accessor, sizeof(application_data.section.field) - 1u); \
+		storage_save_entry(STORAGE_ENTRY_##id); \
+		\
+		return 0; \
+	}
+#define STORAGE_BLOB_ACCESSORS(id, key, section, field, accessor, ctype) \
+	void get_##accessor(ctype *accessor) { \
+		memcpy(accessor, &application_data.section.field, sizeof(ctype)); \
+	} \
+	\
+	int set_##accessor(const ctype *accessor) { \
+		memcpy(&application_data.section.field, accessor, sizeof(ctype)); \
+		\
+		return storage_save_entry(STORAGE_ENTRY_##id); \
+	}
 
-	return 0;
-}
+STORAGE_SCHEMA(STORAGE_SCALAR_ACCESSORS, STORAGE_STRING_ACCESSORS, STORAGE_BLOB_ACCESSORS)
 
 uint8_t get_wifi_unlocked(void) {
 	return application_data.runtime_data.wifi_unlocked;
@@ -525,139 +444,378 @@ static int storage_efuse_obtain(void) {
     return 0;
 }
 
+/// Legacy layout, one NVS key per entry. -1 when the key is not there.
 static int storage_read_entry_with_idx(size_t i) {
-//	esp_err_t ret;
-
-//	printf("storage_read_entry_with_idx: %u - %s - %02x - %u\r\n", i, storage_entry_poll[i].key, storage_entry_poll[i].type, storage_entry_poll[i].size);
+	const struct storage_entry_s *entry = &storage_entry_poll[i];
+	esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+	size_t size = entry->size;
 
-    switch(storage_entry_poll[i].type) {
+    switch(entry->type) {
         case DATA_TYPE_UINT8:
-        	nvs_get_u8(storage_handle, storage_entry_poll[i].key, (uint8_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_u8(storage_handle, storage_entry_poll[i].key, (uint8_t *)storage_entry_poll[i].data);
-//       	printf("storage_save_entry_with_key - nvs_get_u8 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_u8(storage_handle, entry->key, (uint8_t *) entry->data);
             break;
         case DATA_TYPE_INT8:
-        	nvs_get_i8(storage_handle, storage_entry_poll[i].key, (int8_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_i8(storage_handle, storage_entry_poll[i].key, (int8_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_i8 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_i8(storage_handle, entry->key, (int8_t *) entry->data);
             break;
         case DATA_TYPE_UINT16:
-        	nvs_get_u16(storage_handle, storage_entry_poll[i].key, (uint16_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_u16(storage_handle, storage_entry_poll[i].key, (uint16_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_u16 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_u16(storage_handle, entry->key, (uint16_t *) entry->data);
             break;
         case DATA_TYPE_INT16:
-            nvs_get_i16(storage_handle, storage_entry_poll[i].key, (int16_t *)(storage_entry_poll[i].data));
-//            ret = nvs_get_i16(storage_handle, storage_entry_poll[i].key, (int16_t *)(storage_entry_poll[i].data));
-//        	printf("storage_save_entry_with_key - nvs_get_i16 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_i16(storage_handle, entry->key, (int16_t *) entry->data);
             break;
         case DATA_TYPE_UINT32:
-            nvs_get_u32(storage_handle, storage_entry_poll[i].key, (uint32_t *)(storage_entry_poll[i].data));
-//     	    ret = nvs_get_u32(storage_handle, storage_entry_poll[i].key, (uint32_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_u32 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_u32(storage_handle, entry->key, (uint32_t *) entry->data);
             break;
         case DATA_TYPE_INT32:
-        	nvs_get_i32(storage_handle, storage_entry_poll[i].key, (int32_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_i32(storage_handle, storage_entry_poll[i].key, (int32_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_i32 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_i32(storage_handle, entry->key, (int32_t *) entry->data);
             break;
         case DATA_TYPE_UINT64:
-        	nvs_get_u64(storage_handle, storage_entry_poll[i].key, (uint64_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_u64(storage_handle, storage_entry_poll[i].key, (uint64_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_u64 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_u64(storage_handle, entry->key, (uint64_t *) entry->data);
             break;
         case DATA_TYPE_INT64:
-        	nvs_get_i64(storage_handle, storage_entry_poll[i].key, (int64_t *)storage_entry_poll[i].data);
-//        	ret = nvs_get_i64(storage_handle, storage_entry_poll[i].key, (int64_t *)storage_entry_poll[i].data);
-//        	printf("storage_save_entry_with_key - nvs_get_i64 - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_i64(storage_handle, entry->key, (int64_t *) entry->data);
             break;
         case DATA_TYPE_STRING:
-        	size_t size = storage_entry_poll[i].size;
-        	nvs_get_str(storage_handle, storage_entry_poll[i].key, (char *)storage_entry_poll[i].data, &size);
-//        	ret = nvs_get_str(storage_handle, storage_entry_poll[i].key, (char *)storage_entry_poll[i].data, &size);
-//        	printf("storage_save_entry_with_key - nvs_get_str - index: %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_get_str(storage_handle, entry->key, (char *) entry->data, &size);
+            break;
+        case DATA_TYPE_BLOB:
+        	ret = nvs_get_blob(storage_handle, entry->key, entry->data, &size);
             break;
     }
 
-    return 0;
+    return ret == ESP_OK ? 0 : -1;
 }
 
-static int storage_save_entry_with_key(const char* key) {
-//	esp_err_t ret;
-	size_t i;
-
-	for (i = 0; i < ARRAY_SIZE(storage_entry_poll); i++ ) {
-		if (!strcmp(key, storage_entry_poll[i].key)) {
-			break;
-		}
-	}
-
-	if (i == ARRAY_SIZE(storage_entry_poll)) {
-    	printf("storage_save_entry_with_key - no entry\r\n");
-		return -1;
-	}
-
-//	printf("storage_save_entry_with_key: %u - %s - %02x - %u\r\n", i, storage_entry_poll[i].key, storage_entry_poll[i].type, storage_entry_poll[i].size);
+/// State entries, one NVS key each. Committed by the caller.
+static int storage_write_entry_with_idx(size_t i) {
+	const struct storage_entry_s *entry = &storage_entry_poll[i];
+	esp_err_t ret = ESP_ERR_INVALID_ARG;
 
-	switch(storage_entry_poll[i].type) {
+	switch(entry->type) {
         case DATA_TYPE_UINT8:
-        	nvs_set_u8(storage_handle, storage_entry_poll[i].key, (uint8_t)*((uint8_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_u8(storage_handle, storage_entry_poll[i].key, (uint8_t)*((uint8_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_u8 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_u8(storage_handle, entry->key, *(const uint8_t *) entry->data);
             break;
         case DATA_TYPE_INT8:
-        	nvs_set_i8(storage_handle, storage_entry_poll[i].key, (int8_t)*((int8_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_i8(storage_handle, storage_entry_poll[i].key, (int8_t)*((int8_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_i8 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_i8(storage_handle, entry->key, *(const int8_t *) entry->data);
             break;
         case DATA_TYPE_UINT16:
-        	nvs_set_u16(storage_handle, storage_entry_poll[i].key, (uint16_t)*((uint16_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_u16(storage_handle, storage_entry_poll[i].key, (uint16_t)*((uint16_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_u16 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_u16(storage_handle, entry->key, *(const uint16_t *) entry->data);
             break;
         case DATA_TYPE_INT16:
-        	nvs_set_i16(storage_handle, storage_entry_poll[i].key, *(int16_t *)(storage_entry_poll[i].data));
-//        	ret = nvs_set_i16(storage_handle, storage_entry_poll[i].key, *(int16_t *)(storage_entry_poll[i].data));
-//        	printf("storage_save_entry_with_key - nvs_set_i16 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_i16(storage_handle, entry->key, *(const int16_t *) entry->data);
             break;
         case DATA_TYPE_UINT32:
-        	nvs_set_u32(storage_handle, storage_entry_poll[i].key, (uint32_t)*((uint32_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_u32(storage_handle, storage_entry_poll[i].key, (uint32_t)*((uint32_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_u32 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_u32(storage_handle, entry->key, *(const uint32_t *) entry->data);
             break;
         case DATA_TYPE_INT32:
-        	nvs_set_i32(storage_handle, storage_entry_poll[i].key, (int32_t)*((int32_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_i32(storage_handle, storage_entry_poll[i].key, (int32_t)*((int32_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_i32 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_i32(storage_handle, entry->key, *(const int32_t *) entry->data);
             break;
         case DATA_TYPE_UINT64:
-        	nvs_set_u64(storage_handle, storage_entry_poll[i].key, (uint64_t)*((uint64_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_u64(storage_handle, storage_entry_poll[i].key, (uint64_t)*((uint64_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_u64 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_u64(storage_handle, entry->key, *(const uint64_t *) entry->data);
             break;
         case DATA_TYPE_INT64:
-        	nvs_set_i64(storage_handle, storage_entry_poll[i].key, (int64_t)*((int64_t *)(storage_entry_poll[i].data)));
-//        	ret = nvs_set_i64(storage_handle, storage_entry_poll[i].key, (int64_t)*((int64_t *)(storage_entry_poll[i].data)));
-//        	printf("storage_save_entry_with_key - nvs_set_i64 - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_i64(storage_handle, entry->key, *(const int64_t *) entry->data);
             break;
         case DATA_TYPE_STRING:
-        	nvs_set_str(storage_handle, storage_entry_poll[i].key, (const char *)(storage_entry_poll[i].data));
-//        	ret = nvs_set_str(storage_handle, storage_entry_poll[i].key, (const char *)(storage_entry_poll[i].data));
-//       	printf("storage_save_entry_with_key - nvs_set_str - index:  %u - ret: %04x\r\n", i, ret);
+        	ret = nvs_set_str(storage_handle, entry->key, (const char *) entry->data);
+            break;
+        case DATA_TYPE_BLOB:
+        	ret = nvs_set_blob(storage_handle, entry->key, entry->data, entry->size);
             break;
     }
 
-	nvs_commit(storage_handle);
+    return ret == ESP_OK ? 0 : -1;
+}
+
+/// Packs the settings behind the header, returns the blob length.
+static size_t storage_config_pack(void) {
+	struct storage_config_header_s header;
+	size_t offset = sizeof(header);
+
+	for (size_t i = 0u; i < STORAGE_CONFIG_ENTRY_COUNT; i++) {
+		memcpy(&storage_config_buffer[offset], storage_entry_poll[i].data, storage_entry_poll[i].size);
+		offset += storage_entry_poll[i].size;
+	}
+
+	header.version = STORAGE_CONFIG_VERSION;
+	header.count = STORAGE_CONFIG_ENTRY_COUNT;
+	header.size = offset - sizeof(header);
+	header.crc = 0u;
+	memcpy(storage_config_buffer, &header, sizeof(header));
+
+	header.crc = crc(&storage_config_buffer[sizeof(header.crc)], offset - sizeof(header.crc));
+	memcpy(storage_config_buffer, &header.crc, sizeof(header.crc));
+
+	return offset;
+}
+
+/// Dispatch on the blob version. 1 when the blob is older than this layout and must be written again.
+static int storage_config_migrate(const struct storage_config_header_s *header) {
+	size_t offset = sizeof(*header);
+	size_t count;
+	size_t size = 0u;
+
+	switch (header->version) {
+		case STORAGE_CONFIG_VERSION:
+			break;
+
+		default:
+			// Written by a newer firmware: kept for it, a downgrade must not wipe the settings
+			printf("storage - config blob version %u not supported, kept and not overwritten\r\n", header->version);
+			storage_boot.locked = true;
+			return -1;
+	}
+
+	// Entries appended to the schema since the blob was written keep their default
+	count = header->count < STORAGE_CONFIG_ENTRY_COUNT ? header->count : STORAGE_CONFIG_ENTRY_COUNT;
+	for (size_t i = 0u; i < count; i++) {
+		size += storage_entry_poll[i].size;
+	}
+	if (size > header->size) {
+		return -1;
+	}
+
+	for (size_t i = 0u; i < count; i++) {
+		memcpy(storage_entry_poll[i].data, &storage_config_buffer[offset], storage_entry_poll[i].size);
+		offset += storage_entry_poll[i].size;
+	}
+
+	return header->count < STORAGE_CONFIG_ENTRY_COUNT ? 1 : 0;
+}
+
+/// Single NVS read. 1 when the blob is valid but older than this layout and must be written again.
+static int storage_config_read(void) {
+	struct storage_config_header_s header;
+	size_t length = sizeof(storage_config_buffer);
+
+	if (nvs_get_blob(storage_handle, STORAGE_CONFIG_KEY, storage_config_buffer, &length) != ESP_OK) {
+		return -1;
+	}
+
+	if (length < sizeof(header)) {
+		return -1;
+	}
+
+	memcpy(&header, storage_config_buffer, sizeof(header));
+	storage_boot.version = header.version;
+	if ((header.size != length - sizeof(header)) || (header.crc != crc(&storage_config_buffer[sizeof(header.crc)], length - sizeof(header.crc)))) {
+		printf("storage - config blob corrupted\r\n");
+		return -1;
+	}
+
+	return storage_config_migrate(&header);
+}
+
+/// State keys, then the settings blob, else the legacy per key layout which is migrated to a blob and erased.
+static void storage_config_load(void) {
+	int64_t start_us = esp_timer_get_time();
+	size_t found = 0u;
+	int ret;
+
+	for (size_t i = STORAGE_CONFIG_ENTRY_COUNT; i < STORAGE_ENTRY_COUNT; i++) {
+		storage_read_entry_with_idx(i);
+	}
+
+	ret = storage_config_read();
+	if (ret >= 0) {
+		storage_boot.load_us = (uint32_t) (esp_timer_get_time() - start_us);
+		storage_boot.source = STORAGE_BOOT_SOURCE_BLOB;
+		storage_validate_persistent_data();
+
+		if (ret > 0) {
+			storage_save_all_entry();
+		}
+		return;
+	}
+
+	if (storage_boot.locked) {
+		storage_boot.load_us = (uint32_t) (esp_timer_get_time() - start_us);
+		storage_boot.source = STORAGE_BOOT_SOURCE_UNKNOWN;
+		return;
+	}
+
+	for (size_t i = 0u; i < STORAGE_CONFIG_ENTRY_COUNT; i++) {
+		if (!storage_read_entry_with_idx(i)) {
+			found++;
+		}
+	}
+	storage_boot.load_us = (uint32_t) (esp_timer_get_time() - start_us);
+	storage_boot.source = found ? STORAGE_BOOT_SOURCE_LEGACY : STORAGE_BOOT_SOURCE_DEFAULT;
+	storage_validate_persistent_data();
+
+	if (found) {
+		// The state keys stay, they are the current layout
+		for (size_t i = 0u; i < STORAGE_CONFIG_ENTRY_COUNT; i++) {
+			nvs_erase_key(storage_handle, storage_entry_poll[i].key);
+		}
+		printf("storage - %u legacy entries migrated to the config blob\r\n", (unsigned) found);
+	}
+
+	storage_save_all_entry();
+}
+
+/// Marks the entry dirty, the storage task writes it after STORAGE_WRITE_BEHIND_QUIET without changes.
+static int storage_save_entry(enum storage_entry_id_e id) {
+	TickType_t now = xTaskGetTickCount();
+
+	if (id >= STORAGE_ENTRY_COUNT) {
+		return -1;
+	}
+
+	taskENTER_CRITICAL(&storage_dirty_lock);
+	if (!storage_write_behind.dirty) {
+		storage_write_behind.first_tick = now;
+	}
+	storage_write_behind.dirty |= 1ul << id;
+	storage_write_behind.last_tick = now;
+	storage_write_behind.requests++;
+	taskEXIT_CRITICAL(&storage_dirty_lock);
+
+	if (storage_task_handle == NULL) {
+		return storage_flush();
+	}
+
+	xTaskNotifyGive(storage_task_handle);
 
     return 0;
 }
 
 static int storage_save_all_entry(void) {
-	size_t i;
+	TickType_t now = xTaskGetTickCount();
 
-	for (i = 0; i < ARRAY_SIZE(storage_entry_poll); i++ ) {
-		storage_save_entry_with_key(storage_entry_poll[i].key);
+	taskENTER_CRITICAL(&storage_dirty_lock);
+	if (!storage_write_behind.dirty) {
+		storage_write_behind.first_tick = now;
 	}
+	storage_write_behind.dirty = (uint32_t) ((1ull << STORAGE_ENTRY_COUNT) - 1u);
+	storage_write_behind.last_tick = now;
+	storage_write_behind.requests++;
+	taskEXIT_CRITICAL(&storage_dirty_lock);
 
-    return 0;
+	// Factory settings are usually followed by a restart, do not wait
+    return storage_flush();
+}
+
+/// Writes the dirty entries with a single commit.
+int storage_flush(void) {
+	uint32_t dirty;
+	esp_err_t ret = ESP_OK;
+
+	if (storage_lock != NULL) {
+		xSemaphoreTake(storage_lock, portMAX_DELAY);
+	}
+
+	taskENTER_CRITICAL(&storage_dirty_lock);
+	dirty = storage_write_behind.dirty;
+	storage_write_behind.dirty = 0u;
+	taskEXIT_CRITICAL(&storage_dirty_lock);
+
+	if (dirty) {
+		// The settings are one blob, their dirty bits only say a write is due
+		if ((dirty & STORAGE_CONFIG_DIRTY) && !storage_boot.locked) {
+			ret = nvs_set_blob(storage_handle, STORAGE_CONFIG_KEY, storage_config_buffer, storage_config_pack());
+		}
+
+		for (uint32_t pending = dirty; pending; pending &= pending - 1u) {
+			size_t i = (size_t) __builtin_ctz(pending);
+
+			if ((i >= STORAGE_CONFIG_ENTRY_COUNT) && storage_write_entry_with_idx(i)) {
+				ret = ESP_FAIL;
+			}
+			storage_write_behind.entries++;
+		}
+
+		if (ret == ESP_OK) {
+			ret = nvs_commit(storage_handle);
+		}
+		storage_write_behind.commits++;
+
+		if (ret != ESP_OK) {
+			// Keep the entries dirty, the storage task retries after a quiet period instead of spinning
+			TickType_t now = xTaskGetTickCount();
+
+			taskENTER_CRITICAL(&storage_dirty_lock);
+			if (!storage_write_behind.dirty) {
+				storage_write_behind.first_tick = now;
+			}
+			storage_write_behind.dirty |= dirty;
+			storage_write_behind.last_tick = now;
+			taskEXIT_CRITICAL(&storage_dirty_lock);
+
+			printf("storage - flush failed (%s), retried later\r\n", esp_err_to_name(ret));
+		}
+	}
+
+	if (storage_lock != NULL) {
+		xSemaphoreGive(storage_lock);
+	}
+
+	return ret == ESP_OK ? 0 : -1;
+}
+
+/// Ticks until the next commit is due, portMAX_DELAY when nothing is pending.
+static TickType_t storage_write_behind_wait(void) {
+	TickType_t now = xTaskGetTickCount();
+	TickType_t quiet_elapsed;
+	TickType_t max_elapsed;
+	TickType_t wait;
+
+	taskENTER_CRITICAL(&storage_dirty_lock);
+	if (!storage_write_behind.dirty) {
+		taskEXIT_CRITICAL(&storage_dirty_lock);
+		return portMAX_DELAY;
+	}
+	quiet_elapsed = now - storage_write_behind.last_tick;
+	max_elapsed = now - storage_write_behind.first_tick;
+	taskEXIT_CRITICAL(&storage_dirty_lock);
+
+	wait = quiet_elapsed < STORAGE_WRITE_BEHIND_QUIET ? STORAGE_WRITE_BEHIND_QUIET - quiet_elapsed : 0;
+	if (max_elapsed >= STORAGE_WRITE_BEHIND_MAX) {
+		wait = 0;
+	} else if (wait > STORAGE_WRITE_BEHIND_MAX - max_elapsed) {
+		wait = STORAGE_WRITE_BEHIND_MAX - max_elapsed;
+	}
+
+	return wait;
+}
+
+static void storage_shutdown(void) {
+	storage_flush();
+}
+
+static void storage_task(void *pvParameters) {
+	TickType_t wait = portMAX_DELAY;
+
+	for (;;) {
+		// A notification is a new change: the quiet period restarts
+		if (ulTaskNotifyTake(pdTRUE, wait) == 0u) {
+			storage_flush();
+		}
+
+		wait = storage_write_behind_wait();
+	}
+}
+
+void storage_write_behind_report(void) {
+	uint32_t requests = storage_write_behind.requests;
+	uint32_t commits = storage_write_behind.commits;
+	uint32_t pending = 0u;
+
+	for (uint32_t dirty = storage_write_behind.dirty; dirty; dirty &= dirty - 1u) {
+		pending++;
+	}
+
+	printf("save requests: %lu - entries changed: %lu - commits: %lu - commits saved: %lu - pending: %lu\r\n",
+			(unsigned long) requests, (unsigned long) storage_write_behind.entries, (unsigned long) commits,
+			(unsigned long) (requests > commits ? requests - commits : 0u), (unsigned long) pending);
+}
+
+void storage_config_report(void) {
+	if (storage_boot.locked) {
+		printf("config blob version %u in flash is unknown - settings are not saved until a factory reset\r\n", storage_boot.version);
+	}
+
+	printf("config blob: version %u - entries %u - %u bytes - state keys %u - boot load from %s in %lu us\r\n",
+			STORAGE_CONFIG_VERSION, STORAGE_CONFIG_ENTRY_COUNT, (unsigned) sizeof(storage_config_buffer), STORAGE_ENTRY_COUNT - STORAGE_CONFIG_ENTRY_COUNT,
+			storage_boot_source_name[storage_boot.source], (unsigned long) storage_boot.load_us);
 }
@@ -10,7 +10,7 @@
 #include <freertos/semphr.h>
 
 #include "driver/i2c.h"
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
 #include "driver/gpio.h"
@@ -28,6 +28,7 @@
 #include "blufi.h"
 #include "user_experience.h"
 #include "controller.h"
+#include "i2c_bus.h"
 
 ///
 static struct i2c_dev_s i2c_dev;
@@ -49,24 +50,33 @@ static int i2c_init(void) {
     i2c_param_config(I2C_MASTER_NUM, &i2c_dev.i2c_conf);
     i2c_driver_install(I2C_MASTER_NUM, i2c_dev.i2c_conf.mode, 0, 0, 0);
 
-    i2c_dev.lock = xSemaphoreCreateMutex();
-
-    return 0;
+    // Single owner of the bus, the drivers queue their transactions
+    return i2c_bus_init(&i2c_dev);
 }
 
 static int adc_init(void) {
     //-------------ADC Init---------------//
-    adc_oneshot_unit_init_cfg_t init_config = {
-        .unit_id = ADC_UNIT_1,
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = NTC_ADC_STORE_BUF_SIZE,
+        .conv_frame_size = NTC_ADC_FRAME_SIZE,
     };
-    adc_oneshot_new_unit(&init_config, &adc_dev.adc_handle);
+    adc_continuous_new_handle(&handle_config, &adc_dev.adc_handle);
 
     //-------------ADC Config---------------//
-    adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    adc_digi_pattern_config_t pattern = {
         .atten = ADC_ATTEN_DB_11,
+        .channel = ADC_CHANNEL_3,
+        .unit = ADC_UNIT_1,
+        .bit_width = ADC_BITWIDTH_12,
+    };
+    adc_continuous_config_t config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = NTC_ADC_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
     };
-    adc_oneshot_config_channel(adc_dev.adc_handle, ADC_CHANNEL_3, &config);
+    adc_continuous_config(adc_dev.adc_handle, &config);
 
     //-------------ADC Calibration Init---------------//
     adc_cali_curve_fitting_config_t cali_config = {
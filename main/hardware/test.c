@@ -17,6 +17,7 @@
 #include "esp_wifi.h"
 #include "esp_idf_version.h"
 #include "esp_efuse.h"
+#include "esp_heap_caps.h"
 
 #include "board.h"
 #include "system.h"
@@ -29,6 +30,10 @@
 #include "sht4x.h"
 #include "sgp40.h"
 #include "ltr303.h"
+#include "controller.h"
+#include "interpolation.h"
+#include "i2c_bus.h"
+#include "self_heating.h"
 
 typedef struct {
     uint32_t cycle_time_s;
@@ -107,8 +112,10 @@ static int cmd_set_mode_speed_func(int argc, char **argv) {
 		return -1;
 	}
 
-	set_mode_set(mode_set);
-	set_speed_set(speed_set);
+	if (set_mode_set(mode_set) || set_speed_set(speed_set)) {
+		printf("Setting rejected, out of the storage range\n");
+		return -1;
+	}
 
 	return 0;
 }
@@ -173,8 +180,8 @@ static int cmd_test_led_func(int argc, char** argv) {
 }
 
 static int cmd_test_all_func(int argc, char **argv) {
-	float lux;
-	float ntc_temp;
+	uint32_t lux;
+	int16_t ntc_temp;
 
 	if (test_in_progress() == false) {
 		printf("Make sure to run test_start \n");
@@ -213,24 +220,22 @@ static int cmd_test_all_func(int argc, char **argv) {
 	        printf("VOC Index: %u4 \n", voc);
 	    }
 
-		ltr303_measure_lux(&lux);
-		uint16_t u16_lux = SET_VALUE_TO_TEMP_RAW(lux);
+		lux = get_lux();
 
-		if (u16_lux == LUX_INVALID) {
+		if (lux == LUX_INVALID) {
 			printf("LUX reading error\n");
 		}
 		else {
-			printf("LUX: %u.%01u %\n", TEMP_RAW_TO_INT(u16_lux), TEMP_RAW_TO_DEC(u16_lux));
+			printf("LUX: %lu.%01u\n", (unsigned long) LUX_RAW_TO_INT(lux), LUX_RAW_TO_DEC(lux));
 		}
 
 		sensor_ntc_sample(&ntc_temp);
-		int16_t i16_ntc_temp = SET_VALUE_TO_TEMP_RAW(ntc_temp);
 
-		if (i16_ntc_temp == TEMPERATURE_INVALID) {
+		if (ntc_temp == TEMPERATURE_INVALID) {
 			printf("NTC Temperature reading error\n");
 		}
 		else {
-			printf("NTC Temperature: %d.%01d C\n", TEMP_RAW_TO_INT(i16_ntc_temp), TEMP_RAW_TO_DEC(i16_ntc_temp));
+			printf("NTC Temperature: %d.%01d C\n", TEMP_RAW_TO_INT(ntc_temp), TEMP_RAW_TO_DEC(ntc_temp));
 		}
 	}
 
@@ -384,6 +389,24 @@ static int cmd_fan_cycle_func(int argc, char **argv) {
     return 0;
 }
 
+static int cmd_fan_ramp_func(int argc, char **argv) {
+    if (argc < 4) {
+        printf("Invalid arguments. Usage: fan_ramp <ramp down (ms)> <coast (ms)> <ramp up (ms)>\n");
+        return -1;
+    }
+
+    uint32_t ramp_down_ms = (uint32_t) strtoul(argv[1], NULL, 10);
+    uint32_t coast_ms = (uint32_t) strtoul(argv[2], NULL, 10);
+    uint32_t ramp_up_ms = (uint32_t) strtoul(argv[3], NULL, 10);
+
+    if (fan_set_reversal_timing(ramp_down_ms, coast_ms, ramp_up_ms)) {
+        printf("Invalid arguments. Ramp times must be > 0\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int cmd_test_start_func(int argc, char **argv) {
     if (test_in_progress() == true) {
         printf("Run test_stop and start again! \n");
@@ -432,12 +455,12 @@ static int cmd_test_stop_func(int argc, char **argv) {
 static int cmd_info_func(int argc, char **argv) {
     uint8_t bt_addr[BT_ADDRESS_LEN];
     uint8_t wifi_addr[WIFI_ADDRESS_LEN];
-	float lux;
-	float ntc_temp;
+	uint32_t lux;
+	int16_t ntc_temp;
 
     static const char* threshold_str[] = { "Not configured", "Low", "Medium", "High" };
     static const char* mode_str[] = { "Off", "Immission", "Emission", "Fixed cycle", "Automatic cycle" };
-    static const char* speed_str[] = { "None", "Night", "Vel1", "Vel2", "Vel3", "Boost" };
+    static const char* speed_str[] = { "None", "Night", "Vel1", "Vel2", "Vel3", "Boost", "Prop" };
     static const char* direction_str[] = { "None", "Out", "In" };
     static const char* bt_connection_state_str[] = { "Disconnected", "Connected"  };
     static const char* wifi_connection_state_str[] = { "Disconnected", "Connected" };
@@ -491,26 +514,38 @@ static int cmd_info_func(int argc, char **argv) {
 		printf("VOC Index: %u \n", voc);
 	}
 
-	ltr303_measure_lux(&lux);
-	uint16_t u16_lux = SET_VALUE_TO_TEMP_RAW(lux);
+	lux = get_lux();
 
-	if (u16_lux == LUX_INVALID) {
+	if (lux == LUX_INVALID) {
 		printf("LUX reading error\n");
 	} else {
-		printf("LUX: %u.%01u %\n", TEMP_RAW_TO_INT(u16_lux), TEMP_RAW_TO_DEC(u16_lux));
+		printf("LUX: %lu.%01u - range: %u\n", (unsigned long) LUX_RAW_TO_INT(lux), LUX_RAW_TO_DEC(lux), ltr303_get_range());
 	}
 
 	sensor_ntc_sample(&ntc_temp);
-	int16_t i16_ntc_temp = SET_VALUE_TO_TEMP_RAW(ntc_temp);
 
-	if (i16_ntc_temp == TEMPERATURE_INVALID) {
+	if (ntc_temp == TEMPERATURE_INVALID) {
 		printf("NTC Temperature reading error\n");
 	} else {
-		printf("NTC Temperature: %d.%01d C\n", TEMP_RAW_TO_INT(i16_ntc_temp), TEMP_RAW_TO_DEC(i16_ntc_temp));
+		printf("NTC Temperature: %d.%01d C\n", TEMP_RAW_TO_INT(ntc_temp), TEMP_RAW_TO_DEC(ntc_temp));
 	}
 
+	uint32_t active_last_us;
+	uint32_t active_max_us;
+
+	sensor_get_active_time(&active_last_us, &active_max_us);
+	printf("Sensor cycle active time: %lu us (max %lu us)\n", active_last_us, active_max_us);
+
 	printf("Filter Operating Saved: %ld - State: Warning %s\n", get_filter_operating(), get_device_state() ? "ON" : "OFF");
 
+	uint32_t latency_last_us;
+	uint32_t latency_max_us;
+	uint32_t latency_count;
+
+	controller_get_latency(&latency_last_us, &latency_max_us, &latency_count);
+	printf("Command to PWM latency: last %lu us - max %lu us - count %lu\n", latency_last_us, latency_max_us, latency_count);
+	printf("Worker queue full: %lu events retried\n", (unsigned long) controller_get_work_dropped());
+
 	return 0;
 }
 
@@ -528,6 +563,177 @@ static int cmd_period_func(int argc, char **argv) {
 	return 0;
 }
 
+static int cmd_trace_func(int argc, char **argv) {
+	struct controller_trace_entry_s entry;
+	uint16_t count = controller_trace_count();
+
+	if (argc > 1) {
+		uint16_t requested = (uint16_t) strtoul(argv[1], NULL, 10);
+
+		if (requested < count) {
+			count = requested;
+		}
+	}
+
+	printf("idx;time_ms;temp;rh;voc;lux;cond;lux_state;cnt_rh;cnt_voc;mode;speed;dir;reason\n");
+	for (uint16_t i = 0U; i < count; i++) {
+		if (controller_trace_get(i, &entry)) {
+			break;
+		}
+		printf("%u;%lu;%d;%u;%u;%lu;%02x;%u;%u;%u;%02x;%02x;%u;%u\n",
+				i, entry.time_ms, entry.temperature, entry.relative_humidity, entry.voc, (unsigned long) entry.lux,
+				entry.cond_flags, entry.luminosity_state, entry.count_rh_extra_cycle, entry.count_voc_extra_cycle,
+				entry.mode_state, entry.speed_state, entry.direction_state, entry.reason);
+	}
+
+	return 0;
+}
+
+/// Posts inversions to the controller worker: a persistent worker task must not change the heap.
+static int cmd_worker_heap_func(int argc, char **argv) {
+	uint32_t count = 100u;
+	uint32_t dropped = controller_get_work_dropped();
+	size_t free_before;
+	size_t min_before;
+	size_t free_after;
+	size_t min_after;
+
+	if (argc > 1) {
+		count = (uint32_t) strtoul(argv[1], NULL, 10);
+	}
+
+	free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+	min_before = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+
+	for (uint32_t i = 0u; i < count; i++) {
+		if (controller_post_inversion()) {
+			printf("worker heap - controller not started\r\n");
+			return 1;
+		}
+		// Let the worker drain the queue, a full queue is retried by the controller task
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+	vTaskDelay(pdMS_TO_TICKS(100));
+
+	free_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+	min_after = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+
+	printf("worker heap - %lu inversions (%lu retried)\r\n", (unsigned long) count, (unsigned long) (controller_get_work_dropped() - dropped));
+	printf("free: %u -> %u (%d) - minimum free: %u -> %u (%d)\r\n",
+			(unsigned) free_before, (unsigned) free_after, (int) free_after - (int) free_before,
+			(unsigned) min_before, (unsigned) min_after, (int) min_after - (int) min_before);
+
+	return (free_after < free_before) || (min_after < min_before) ? 1 : 0;
+}
+
+static int cmd_bench_interp_func(int argc, char **argv) {
+	interp_lut_benchmark();
+
+	return 0;
+}
+
+static int cmd_bench_sensor_func(int argc, char **argv) {
+	sensor_conversion_benchmark();
+
+	return 0;
+}
+
+static int cmd_bench_voc_func(int argc, char **argv) {
+	uint32_t hours = 24u;
+
+	if (argc > 1) {
+		hours = (uint32_t) strtoul(argv[1], NULL, 10);
+	}
+
+	sgp40_gas_index_benchmark(hours);
+
+	return 0;
+}
+
+static int cmd_voc_power_func(int argc, char **argv) {
+	if (argc > 1) {
+		sensor_set_voc_low_power(strtoul(argv[1], NULL, 10) != 0u);
+	}
+
+	printf("voc low power: %s\r\n", sensor_get_voc_low_power() ? "selected" : "off");
+	sensor_voc_power_report();
+
+	return 0;
+}
+
+static int cmd_sensor_direction_func(int argc, char **argv) {
+	sensor_direction_report();
+
+	return 0;
+}
+
+static int cmd_filter_func(int argc, char **argv) {
+	struct filter_config_s config = { 0 };
+
+	if (argc > 4) {
+		config.window = (uint8_t) strtoul(argv[2], NULL, 10);
+		config.hampel_k = (uint8_t) strtoul(argv[3], NULL, 10);
+		config.ema_shift = (uint8_t) strtoul(argv[4], NULL, 10);
+		config.mad_min = (argc > 5) ? (int32_t) strtol(argv[5], NULL, 10) : 0;
+
+		if (sensor_set_filter(argv[1], &config)) {
+			printf("invalid filter setting\r\n");
+			return 1;
+		}
+
+		// Applied at the next sensor period
+		return 0;
+	}
+
+	sensor_filter_report();
+
+	return 0;
+}
+
+static int cmd_self_heating_func(int argc, char **argv) {
+	struct self_heating_s model = { 0 };
+
+	if (argc > 1) {
+		if (!strcmp(argv[1], "start")) {
+			// Without reference the internal NTC temperature of the settled out phases is used
+			self_heating_calibration_start((argc > 2) ? (int16_t) strtol(argv[2], NULL, 10) : TEMPERATURE_INVALID);
+			printf("self heating calibration - started, vary the fan speed and the wifi during the run\r\n");
+		} else if (!strcmp(argv[1], "stop")) {
+			if (!self_heating_calibration_running() || self_heating_calibration_stop(&model)) {
+				printf("self heating calibration - no fit\r\n");
+				return 1;
+			}
+			set_self_heating(&model);
+		} else if (!strcmp(argv[1], "clear")) {
+			set_self_heating(&model);
+		} else {
+			printf("invalid argument\r\n");
+			return 1;
+		}
+	}
+
+	sensor_self_heating_report();
+
+	return 0;
+}
+
+static int cmd_storage_stats_func(int argc, char **argv) {
+	if ((argc > 1) && !strcmp(argv[1], "flush")) {
+		storage_flush();
+	}
+
+	storage_write_behind_report();
+	storage_config_report();
+
+	return 0;
+}
+
+static int cmd_i2c_stats_func(int argc, char **argv) {
+	i2c_bus_report();
+
+	return 0;
+}
+
 static int cmd_encrypt_func(int argc, char **argv) {
     // Read key from eFUSE block 5
     uint8_t key[16];
@@ -647,6 +853,15 @@ int test_init(void) {
 
 	esp_console_cmd_register(&cmd_fan_cycle);
 
+	const esp_console_cmd_t cmd_fan_ramp = {
+		   .command = "fan_ramp",
+		   .help = "Fan reversal timing {ramp down (ms)} {coast (ms)} {ramp up (ms)}",
+		   .hint = NULL,
+		   .func = cmd_fan_ramp_func,
+		 };
+
+	esp_console_cmd_register(&cmd_fan_ramp);
+
 	 const esp_console_cmd_t cmd_test_start = {
 	       .command = "test_start",
 	       .help = "Test start",
@@ -701,5 +916,104 @@ int test_init(void) {
 
 	 esp_console_cmd_register(&cmd_encrypt);
 
+	 const esp_console_cmd_t cmd_bench_interp = {
+	       .command = "bench_interp",
+	       .help = "Benchmark interpolation tables",
+	       .hint = NULL,
+	       .func = cmd_bench_interp_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_bench_interp);
+
+	 const esp_console_cmd_t cmd_bench_sensor = {
+	       .command = "bench_sensor",
+	       .help = "Benchmark fixed-point sensor conversions against float",
+	       .hint = NULL,
+	       .func = cmd_bench_sensor_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_bench_sensor);
+
+	 const esp_console_cmd_t cmd_bench_voc = {
+	       .command = "bench_voc",
+	       .help = "Benchmark fixed-point gas index against float on a synthetic trace {hours}",
+	       .hint = NULL,
+	       .func = cmd_bench_voc_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_bench_voc);
+
+	 const esp_console_cmd_t cmd_trace = {
+	       .command = "trace",
+	       .help = "Controller decision trace, most recent first {count}",
+	       .hint = NULL,
+	       .func = cmd_trace_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_trace);
+
+	 const esp_console_cmd_t cmd_voc_power = {
+	       .command = "voc_power",
+	       .help = "VOC low power mode and SGP40 heater, bus and current statistics {0|1}",
+	       .hint = NULL,
+	       .func = cmd_voc_power_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_voc_power);
+
+	 const esp_console_cmd_t cmd_i2c_stats = {
+	       .command = "i2c_stats",
+	       .help = "I2C bus transactions, errors and utilisation per device",
+	       .hint = NULL,
+	       .func = cmd_i2c_stats_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_i2c_stats);
+
+	 const esp_console_cmd_t cmd_sensor_direction = {
+	       .command = "sensor_direction",
+	       .help = "Samples per airflow direction, settled samples and indoor / outdoor estimates",
+	       .hint = NULL,
+	       .func = cmd_sensor_direction_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_sensor_direction);
+
+	 const esp_console_cmd_t cmd_filter = {
+	       .command = "filter",
+	       .help = "Sensor filter statistics, or set a channel {t|rh|voc|ah_out|voc_out window k_tenths ema_shift [mad_min]}",
+	       .hint = NULL,
+	       .func = cmd_filter_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_filter);
+
+	 const esp_console_cmd_t cmd_self_heating = {
+	       .command = "self_heating",
+	       .help = "SHT4x self-heating model, calibration run {start [reference 0.01 C]|stop|clear}",
+	       .hint = NULL,
+	       .func = cmd_self_heating_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_self_heating);
+
+	 const esp_console_cmd_t cmd_storage_stats = {
+	       .command = "storage_stats",
+	       .help = "NVS write-behind counters and config blob boot load time {flush}",
+	       .hint = NULL,
+	       .func = cmd_storage_stats_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_storage_stats);
+
+	 const esp_console_cmd_t cmd_worker_heap = {
+	       .command = "worker_heap",
+	       .help = "Post inversions to the controller worker and compare the free and minimum free heap {count}",
+	       .hint = NULL,
+	       .func = cmd_worker_heap_func,
+	     };
+
+	 esp_console_cmd_register(&cmd_worker_heap);
+
 	 return 0;
 }
@@ -34,6 +34,7 @@
 #define BLUFI_CMD_TH_VOC	       "TH_VOC"
 #define BLUFI_CMD_OFFSET_RH	       "OFFSET_RH"
 #define BLUFI_CMD_OFFSET_T   	   "OFFSET_T"
+#define BLUFI_CMD_SLOPE_RH   	   "SLOPE_RH"
 
 
 #define WIFI_ADDRESS_LEN                6
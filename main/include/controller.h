@@ -10,6 +10,50 @@
 
 #include "system.h"
 
+#define CONTROLLER_TRACE_DEPTH			(64U)
+
+/// Why the controller recorded a decision.
+enum controller_reason_e {
+	CONTROLLER_REASON_NONE				= 0x00,		///< Output changed without a specific cause
+	CONTROLLER_REASON_MODE_CHANGE		= 0x01,
+	CONTROLLER_REASON_SETTING			= 0x02,
+	CONTROLLER_REASON_INVERSION			= 0x03,
+	CONTROLLER_REASON_DURATION_DONE		= 0x04,
+	CONTROLLER_REASON_LUX_NIGHT			= 0x05,
+	CONTROLLER_REASON_LUX_DAY			= 0x06,
+	CONTROLLER_REASON_RH_EXTRA_CYCLE	= 0x07,
+	CONTROLLER_REASON_RH_SLOPE			= 0x08,
+	CONTROLLER_REASON_VOC_EXTRA_CYCLE	= 0x09,
+	CONTROLLER_REASON_EXTRA_CYCLE_LIMIT	= 0x0a,		///< Extra cycle wanted, hourly budget exhausted
+	CONTROLLER_REASON_EXTRA_CYCLE_DONE	= 0x0b,
+	CONTROLLER_REASON_RH_SUPPRESSED		= 0x0c,		///< Outdoor air not drier than indoor air
+	CONTROLLER_REASON_PROPORTIONAL		= 0x0d,
+};
+
+/// One controller decision, inputs and outputs.
+struct controller_trace_entry_s {
+	uint32_t	time_ms;
+	int16_t		temperature;
+	uint16_t	relative_humidity;
+	uint16_t	voc;
+	uint32_t	lux;
+	uint8_t		cond_flags;
+	uint8_t		luminosity_state;		///< LUMINOSITY_STATE_*
+	uint8_t		count_rh_extra_cycle;
+	uint8_t		count_voc_extra_cycle;
+	uint8_t		mode_state;
+	uint8_t		speed_state;
+	uint8_t		direction_state;
+	uint8_t		reason;
+};
+
 int controller_init();
+void controller_notify_setting_changed(void);
+void controller_get_latency(uint32_t *last_us, uint32_t *max_us, uint32_t *count);
+uint32_t controller_get_work_dropped(void);
+int controller_post_inversion(void);
+uint8_t controller_get_proportional_percentage(void);
+uint16_t controller_trace_count(void);
+int controller_trace_get(uint16_t index, struct controller_trace_entry_s *entry);
 
 #endif /* MAIN_INCLUDE_CONTROLLER_H_ */
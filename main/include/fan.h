@@ -64,8 +64,27 @@ static inline uint8_t ADJUST_SPEED(uint8_t speed) {
 	return speed;
 }
 
+/// Discrete speed closest to a percentage, for the accounting of the proportional mode.
+static inline uint8_t fan_percentage_to_speed(uint8_t speed_percent) {
+	if (speed_percent == 0U) {
+		return SPEED_NONE;
+	} else if (speed_percent < 30U) {
+		return SPEED_NIGHT;
+	} else if (speed_percent < 53U) {
+		return SPEED_LOW;
+	} else if (speed_percent < 78U) {
+		return SPEED_MEDIUM;
+	} else if (speed_percent < 95U) {
+		return SPEED_HIGH;
+	}
+
+	return SPEED_BOOST;
+}
+
 int fan_init();
 int fan_set(uint8_t direction, uint8_t speed);
 int fan_set_percentage(uint8_t direction, uint8_t speed_percent);
+int fan_set_reversal_timing(uint32_t ramp_down_ms, uint32_t coast_ms, uint32_t ramp_up_ms);
+uint16_t fan_get_duty_permille(void);
 
 #endif /* MAIN_INCLUDE_FAN_H_ */
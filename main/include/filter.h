@@ -0,0 +1,45 @@
+/*
+ * filter.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_FILTER_H_
+#define MAIN_INCLUDE_FILTER_H_
+
+#include <stdbool.h>
+
+#include "system.h"
+
+#define FILTER_WINDOW_MAX				(9U)
+#define FILTER_EMA_FRACTION_BITS		(8U)
+#define FILTER_INVALID_HOLD				(10U)		// Consecutive invalid samples hidden behind the last output
+#define FILTER_MAD_SCALE_PERMILLE		(1483)		// 1.4826: MAD to standard deviation for gaussian noise
+
+/// Median window, Hampel outlier rejection on it, then an exponential moving average.
+struct filter_config_s {
+	uint8_t		window;				///< Median window, odd, 1 passes the sample through
+	uint8_t		hampel_k;			///< Threshold in tenths of scaled MAD, 0 always outputs the window median
+	uint8_t		ema_shift;			///< EMA weight 2^-shift, 0 disables the average
+	int32_t		mad_min;			///< MAD floor in channel units, a flat window does not reject small steps
+};
+
+struct filter_s {
+	struct filter_config_s config;
+	int32_t		window[FILTER_WINDOW_MAX];
+	uint8_t		index;
+	uint8_t		count;
+	uint8_t		invalid_count;		///< Consecutive invalid samples
+	bool		ema_valid;
+	int32_t		ema;				///< Average << FILTER_EMA_FRACTION_BITS
+	uint32_t	samples;
+	uint32_t	rejected;			///< Replaced by the window median
+	uint32_t	invalid;
+};
+
+int filter_init(struct filter_s *filter, const struct filter_config_s *config);
+void filter_reset(struct filter_s *filter);
+int filter_update(struct filter_s *filter, int32_t sample, bool valid, int32_t *output);
+int32_t filter_median(const int32_t *values, size_t count);
+
+#endif /* MAIN_INCLUDE_FILTER_H_ */
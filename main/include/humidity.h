@@ -0,0 +1,18 @@
+/*
+ * humidity.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_HUMIDITY_H_
+#define MAIN_INCLUDE_HUMIDITY_H_
+
+#include "system.h"
+#include "types.h"
+
+uint16_t humidity_absolute(int16_t temperature, uint16_t relative_humidity);
+uint16_t humidity_absolute_saturation(int16_t temperature);
+int16_t humidity_dew_point(int16_t temperature, uint16_t relative_humidity);
+uint16_t humidity_relative_at(int16_t temperature, uint16_t relative_humidity, int16_t new_temperature);
+
+#endif /* MAIN_INCLUDE_HUMIDITY_H_ */
@@ -0,0 +1,54 @@
+/*
+ * i2c_bus.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_I2C_BUS_H_
+#define MAIN_INCLUDE_I2C_BUS_H_
+
+#include "system.h"
+
+#define I2C_BUS_TX_SIZE				(16u)		// Write data is copied in the request
+
+enum i2c_bus_device_e {
+	I2C_BUS_DEVICE_SHT4X = 0,
+	I2C_BUS_DEVICE_SGP40,
+	I2C_BUS_DEVICE_LTR303,
+	I2C_BUS_DEVICE_KTD2027,
+	//
+	I2C_BUS_DEVICE_COUNT,
+};
+
+/// Called from the bus task, result 0 or -1.
+typedef void (*i2c_bus_callback_t)(int result, void *arg);
+
+/// Write then read with a repeated start, either part may be empty.
+struct i2c_bus_transaction_s {
+	uint8_t device;						// I2C_BUS_DEVICE_*
+	uint8_t address;
+	uint8_t tx[I2C_BUS_TX_SIZE];
+	size_t tx_size;
+	uint8_t *rx;						// Valid until the callback
+	size_t rx_size;
+	i2c_bus_callback_t callback;		// Optional
+	void *arg;
+};
+
+struct i2c_bus_stats_s {
+	uint32_t transactions;
+	uint32_t errors;
+	uint32_t bytes;
+	uint64_t busy_us;					// Time on the bus
+	uint32_t busy_max_us;
+	uint32_t wait_max_us;				// Queued before the transfer
+};
+
+int i2c_bus_init(struct i2c_dev_s *i2c_dev);
+int i2c_bus_submit(const struct i2c_bus_transaction_s *transaction);
+int i2c_bus_write(uint8_t device, uint8_t address, const uint8_t *tx, size_t tx_size);
+int i2c_bus_transfer(uint8_t device, uint8_t address, const uint8_t *tx, size_t tx_size, uint8_t *rx, size_t rx_size);
+void i2c_bus_get_stats(uint8_t device, struct i2c_bus_stats_s *stats);
+void i2c_bus_report(void);
+
+#endif /* MAIN_INCLUDE_I2C_BUS_H_ */
@@ -0,0 +1,52 @@
+/*
+ * interpolation.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_INTERPOLATION_H_
+#define MAIN_INCLUDE_INTERPOLATION_H_
+
+#include "system.h"
+
+#define INTERP_LUT_MAX_REGISTERED		(4U)
+
+/// Function sampled at every node of a lookup table (reference implementation).
+typedef int32_t (*interp_function_t)(int32_t x);
+
+/// Piecewise-linear lookup table with equally spaced nodes (step = 2^shift).
+struct interp_lut_s {
+	const char			*name;			///< Name printed by the benchmark
+	interp_function_t	reference;		///< Function the table was built from
+	int32_t				x_min;			///< Input of the first node
+	uint8_t				shift;			///< log2 of the node step
+	uint16_t			size;			///< Number of nodes
+	int16_t				*y;				///< Node values (size entries)
+};
+
+int interp_lut_build(struct interp_lut_s *lut);
+void interp_lut_benchmark(void);
+
+/// Lookup without search nor division, the input is clamped to the table range.
+static inline int32_t interp_lut_get(const struct interp_lut_s *lut, int32_t x) {
+	uint32_t offset;
+	uint32_t idx;
+	int32_t frac;
+
+	if (x <= lut->x_min) {
+		return lut->y[0];
+	}
+
+	offset = (uint32_t) (x - lut->x_min);
+	idx = offset >> lut->shift;
+
+	if (idx >= (uint32_t) (lut->size - 1U)) {
+		return lut->y[lut->size - 1U];
+	}
+
+	frac = (int32_t) (offset & ((1UL << lut->shift) - 1UL));
+
+	return lut->y[idx] + (((lut->y[idx + 1U] - lut->y[idx]) * frac) >> lut->shift);
+}
+
+#endif /* MAIN_INCLUDE_INTERPOLATION_H_ */
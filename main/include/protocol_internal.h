@@ -62,6 +62,7 @@ enum {
 	PROTOCOL_OBJID_STATS				= 0x0060,
 	PROTOCOL_OBJID_MASTER_STATE			= 0x0070,
 	PROTOCOL_OBJID_STATE				= 0x0080,
+	PROTOCOL_OBJID_TRACE				= 0x0090,
 };
 
 enum {
@@ -195,6 +196,24 @@ struct protocol_state_s {
 	uint16_t voc;
 } __attribute__((packed));
 
+/// Controller decision trace, the query index selects the entry (0 = most recent).
+struct protocol_trace_s {
+	uint16_t count;
+	uint32_t time_ms;
+	int16_t temperature;
+	uint16_t relative_humidity;
+	uint16_t voc;
+	uint32_t lux;
+	uint8_t cond_flags;
+	uint8_t luminosity_state;
+	uint8_t count_rh_extra_cycle;
+	uint8_t count_voc_extra_cycle;
+	uint8_t mode_state;
+	uint8_t speed_state;
+	uint8_t direction_state;
+	uint8_t reason;
+} __attribute__((packed));
+
 union protocol_data_u {
     struct protocol_info_s info;
     struct protocol_conf_s conf;
@@ -206,6 +225,7 @@ union protocol_data_u {
     struct protocol_stats_data_s stats;
     struct protocol_master_state_s master_state;
     struct protocol_state_s state;
+    struct protocol_trace_s trace;
 } __attribute__((packed));
 
 struct protocol_content_s {
@@ -0,0 +1,35 @@
+/*
+ * self_heating.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_SELF_HEATING_H_
+#define MAIN_INCLUDE_SELF_HEATING_H_
+
+#include <stdbool.h>
+
+#include "system.h"
+#include "structs.h"
+
+#define SELF_HEATING_RISE_MAX			(8 * TEMPERATURE_SCALE)		// Bound of the correction
+#define SELF_HEATING_FEATURES			(4u)						// die difference, fan duty, wifi, offset
+#define SELF_HEATING_MIN_SAMPLES		(600u)						// Calibration run of at least 10 min
+
+/// Heat sources seen by the SHT4x.
+struct self_heating_load_s {
+	int16_t		t_die;				///< Die temperature average, TEMPERATURE_INVALID until known
+	uint16_t	duty;				///< Fan duty applied, per mille
+	bool		wifi;				///< Radio on
+};
+
+int32_t self_heating_rise(const struct self_heating_s *model, const struct self_heating_load_s *load, int16_t t_sht);
+
+void self_heating_calibration_start(int16_t reference);
+int self_heating_calibration_stop(struct self_heating_s *model);
+bool self_heating_calibration_running(void);
+int16_t self_heating_calibration_reference(void);
+uint32_t self_heating_calibration_samples(void);
+void self_heating_calibration_add(const struct self_heating_load_s *load, int16_t t_sht, int16_t reference);
+
+#endif /* MAIN_INCLUDE_SELF_HEATING_H_ */
@@ -9,8 +9,19 @@
 #define MAIN_INCLUDE_SENSOR_H_
 
 #include "system.h"
+#include "filter.h"
+#include "structs.h"
 
-int sensor_ntc_sample(float *temp);
+int sensor_ntc_sample(int16_t *temp);
+void sensor_get_active_time(uint32_t *last_us, uint32_t *max_us);
+void sensor_set_voc_low_power(bool low_power);
+bool sensor_get_voc_low_power(void);
+void sensor_voc_power_report(void);
+void sensor_direction_report(void);
+int sensor_set_filter(const char *name, const struct filter_config_s *config);
+void sensor_filter_report(void);
+void sensor_self_heating_report(void);
+void sensor_conversion_benchmark(void);
 int sensor_init(struct i2c_dev_s *i2c_dev, struct adc_dev_s *adc_dev);
 
 #endif /* MAIN_INCLUDE_SENSOR_H_ */
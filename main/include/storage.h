@@ -9,9 +9,13 @@
 #define MAIN_INCLUDE_STORAGE_H_
 
 #include "structs.h"
+#include "storage_schema.h"
 
 int storage_init(void);
 int storage_set_default(void);
+int storage_flush(void);
+void storage_write_behind_report(void);
+void storage_config_report(void);
 
 /// runtime data
 uint32_t get_serial_number(void);
@@ -39,8 +43,11 @@ int set_relative_humidity(uint16_t relative_humidity);
 uint16_t get_voc(void);
 int set_voc(uint16_t voc);
 
-uint16_t get_lux(void);
-int set_lux(uint16_t lux);
+uint32_t get_lux(void);
+int set_lux(uint32_t lux);
+
+uint8_t get_luminosity_state(void);
+int set_luminosity_state(uint8_t luminosity_state);
 
 int16_t get_internal_temperature(void);
 int set_internal_temperature(int16_t temperature);
@@ -48,57 +55,17 @@ int set_internal_temperature(int16_t temperature);
 int16_t get_external_temperature(void);
 int set_external_temperature(int16_t temperature);
 
-/// configuration settings
-uint8_t get_mode_set(void);
-int set_mode_set(uint8_t mode_set);
-
-uint8_t get_speed_set(void);
-int set_speed_set(uint8_t speed_set);
-
-uint8_t get_relative_humidity_set(void);
-int set_relative_humidity_set(uint8_t relative_humidity_set);
-
-uint8_t get_lux_set(void);
-int set_lux_set(uint8_t lux_set);
+uint16_t get_external_absolute_humidity(void);
+int set_external_absolute_humidity(uint16_t absolute_humidity);
 
-uint8_t get_voc_set(void);
-int set_voc_set(uint8_t voc_set);
-
-int16_t get_temperature_offset(void);
-int set_temperature_offset(int16_t temperature_offset);
-
-int16_t get_relative_humidity_offset(void);
-int set_relative_humidity_offset(int16_t relative_humidity_offset);
+uint16_t get_external_voc(void);
+int set_external_voc(uint16_t voc);
 
 uint16_t get_automatic_cycle_duration(void);
 int set_automatic_cycle_duration(uint16_t automatic_cycle_duration);
 
-uint32_t get_filter_operating(void);
-int set_filter_operating(uint32_t filter_operating);
-
-uint8_t get_wrn_flt_disable(void);
-int set_wrn_flt_disable(uint8_t wrn_flt_disable);
-
-void get_ssid(uint8_t *ssid);
-int set_ssid(const uint8_t *ssid);
-
-void get_password(uint8_t *password);
-int set_password(const uint8_t *password);
-
-void get_server(uint8_t *server);
-int set_server(const uint8_t *server);
-
-void get_port(uint8_t *port);
-int set_port(const uint8_t *port);
-
-uint16_t get_wifi_period(void);
-int set_wifi_period(uint16_t wifi_period);
-
-void get_ota_url(uint8_t *ota_url);
-int set_ota_url(const uint8_t *ota_url);
-
-uint8_t get_wifi_active(void);
-int set_wifi_active(uint8_t active);
+/// persisted settings, see storage_schema.h
+STORAGE_SCHEMA(STORAGE_SCHEMA_SCALAR_PROTOTYPES, STORAGE_SCHEMA_STRING_PROTOTYPES, STORAGE_SCHEMA_BLOB_PROTOTYPES)
 
 uint8_t get_wifi_unlocked(void);
 int set_wifi_unlocked(uint8_t unlocked);
@@ -8,8 +8,12 @@
 #ifndef MAIN_INCLUDE_STORAGE_INTERNAL_H_
 #define MAIN_INCLUDE_STORAGE_INTERNAL_H_
 
+#include "esp_rom_crc.h"
+
 #include "storage.h"
 
+#define STORAGE_CONFIG_VERSION		(1u)		// Bump when an entry changes size or meaning, appended entries do not need it
+
 enum data_type_e {
     DATA_TYPE_UINT8 = 0,
     DATA_TYPE_INT8,
@@ -20,6 +24,7 @@ enum data_type_e {
     DATA_TYPE_UINT64,
     DATA_TYPE_INT64,
     DATA_TYPE_STRING,
+    DATA_TYPE_BLOB,
 	//
 	DATA_TYPE_COUNT,
 };
@@ -31,11 +36,16 @@ struct storage_entry_s {
 	size_t		size;
 };
 
-static inline uint32_t crc(const void *data, size_t size) {
-	/* TODO */
-	// caluclate crc
+/// Configuration blob: this header then the settings entries in storage_entry_id_e order.
+struct storage_config_header_s {
+	uint32_t	crc;			// Everything after this field
+	uint16_t	version;
+	uint16_t	count;			// Entries in the payload
+	uint32_t	size;			// Payload bytes
+};
 
-	return 0;
+static inline uint32_t crc(const void *data, size_t size) {
+	return esp_rom_crc32_le(0u, (const uint8_t *) data, size);
 }
 
 #endif /* MAIN_INCLUDE_STORAGE_INTERNAL_H_ */
@@ -0,0 +1,69 @@
+/*
+ * storage_schema.h
+ *
+ *  Created on: 16 oct. 2026
+ */
+
+#ifndef MAIN_INCLUDE_STORAGE_SCHEMA_H_
+#define MAIN_INCLUDE_STORAGE_SCHEMA_H_
+
+/// Persisted data, one line per field: it generates the NVS table, the entry ids, the defaults and the accessors.
+/// The NVS keys must never change, they address what is already written on the devices.
+///
+/// SCALAR(id, key, section, field, accessor, type, ctype, default, min, max, on_change)
+/// STRING(id, key, section, field, accessor)
+/// BLOB(id, key, section, field, accessor, ctype)
+#define STORAGE_SCHEMA(SCALAR, STRING, BLOB) \
+	STORAGE_SCHEMA_CONFIG(SCALAR, STRING, BLOB) \
+	STORAGE_SCHEMA_STATE(SCALAR, STRING, BLOB)
+
+/// Settings, packed in the versioned config blob. Append new entries at the end.
+#define STORAGE_SCHEMA_CONFIG(SCALAR, STRING, BLOB) \
+	SCALAR(MODE_SET,          "mode_set",       configuration_settings,       mode_set,                           mode_set,                           UINT8,   uint8_t,   MODE_OFF,                               MODE_OFF,          MODE_AUTOMATIC_CYCLE,        controller_notify_setting_changed) \
+	SCALAR(SPEED_SET,         "speed_set",      configuration_settings,       speed_set,                          speed_set,                          UINT8,   uint8_t,   SPEED_NONE,                             SPEED_NONE,        SPEED_PROPORTIONAL,          controller_notify_setting_changed) \
+	SCALAR(R_HUM_SET,         "r_hum_set",      configuration_settings,       relative_humidity_set,              relative_humidity_set,              UINT8,   uint8_t,   RH_THRESHOLD_SETTING_NOT_CONFIGURED,    0,                 RH_THRESHOLD_SETTING_HIGH,   storage_no_change_hook) \
+	SCALAR(LUX_SET,           "lux_set",        configuration_settings,       lux_set,                            lux_set,                            UINT8,   uint8_t,   LUX_THRESHOLD_SETTING_NOT_CONFIGURED,   0,                 LUX_THRESHOLD_SETTING_HIGH,  storage_no_change_hook) \
+	SCALAR(VOC_SET,           "voc_set",        configuration_settings,       voc_set,                            voc_set,                            UINT8,   uint8_t,   VOC_THRESHOLD_SETTING_NOT_CONFIGURED,   0,                 VOC_THRESHOLD_SETTING_HIGH,  storage_no_change_hook) \
+	SCALAR(TEMP_OFFSET,       "temp_offset",    configuration_settings,       temperature_offset,                 temperature_offset,                 INT16,   int16_t,   0,                                      OFFSET_BOUND_MIN,  OFFSET_BOUND_MAX,            storage_no_change_hook) \
+	SCALAR(R_HUM_OFFSET,      "r_hum_offset",   configuration_settings,       relative_humidity_offset,           relative_humidity_offset,           INT16,   int16_t,   0,                                      OFFSET_BOUND_MIN,  OFFSET_BOUND_MAX,            storage_no_change_hook) \
+	SCALAR(WRN_FLT_DISABLE,   "wrnfltdisable",  configuration_settings,       wrn_flt_disable,                    wrn_flt_disable,                    UINT8,   uint8_t,   0,                                      0,                 UINT8_MAX,                   storage_no_change_hook) \
+	SCALAR(R_HUM_SLOPE,       "r_hum_slope",    configuration_settings,       relative_humidity_slope_threshold,  relative_humidity_slope_threshold,  UINT16,  uint16_t,  RH_SLOPE_THRESHOLD_DEFAULT,             0,                 RH_SLOPE_THRESHOLD_MAX,      storage_no_change_hook) \
+	STRING(WIFI_SSID,         "ssid",           wifi_configuration_settings,  ssid,                               ssid) \
+	STRING(WIFI_PASSWORD,     "password",       wifi_configuration_settings,  password,                           password) \
+	SCALAR(WIFI_ACTIVE,       "active",         wifi_configuration_settings,  active,                             wifi_active,                        UINT8,   uint8_t,   0,                                      0,                 1,                           storage_no_change_hook) \
+	STRING(SERVER,            "server",         wifi_configuration_settings,  server,                             server) \
+	STRING(PORT,              "port",           wifi_configuration_settings,  port,                               port) \
+	SCALAR(WIFI_PERIOD,       "wifiperiod",     wifi_configuration_settings,  period,                             wifi_period,                        UINT16,  uint16_t,  0,                                      0,                 UINT16_MAX,                  storage_no_change_hook) \
+	STRING(OTA_URL,           "ota",            wifi_configuration_settings,  ota_url,                            ota_url)
+
+/// Data the device updates by itself, one NVS key each so a checkpoint never rewrites the settings.
+#define STORAGE_SCHEMA_STATE(SCALAR, STRING, BLOB) \
+	SCALAR(FILTER_OPERATING,  "filter",         saved_data,                   filter_operating,                   filter_operating,                   UINT32,  uint32_t,  0,                                      0,                 UINT32_MAX,                  storage_no_change_hook) \
+	BLOB(  VOC_STATE,         "voc_state",      saved_data,                   voc_algorithm_state,                voc_algorithm_state,                struct voc_algorithm_state_s) \
+	BLOB(  SELF_HEATING,      "self_heat",      saved_data,                   self_heating,                       self_heating,                       struct self_heating_s)
+
+#define STORAGE_SCHEMA_SCALAR_ID(id, key, section, field, accessor, type, ctype, def, min, max, on_change)	STORAGE_ENTRY_##id,
+#define STORAGE_SCHEMA_STRING_ID(id, key, section, field, accessor)											STORAGE_ENTRY_##id,
+#define STORAGE_SCHEMA_BLOB_ID(id, key, section, field, accessor, ctype)									STORAGE_ENTRY_##id,
+
+enum storage_entry_id_e {
+	STORAGE_SCHEMA(STORAGE_SCHEMA_SCALAR_ID, STORAGE_SCHEMA_STRING_ID, STORAGE_SCHEMA_BLOB_ID)
+	//
+	STORAGE_ENTRY_COUNT,
+};
+
+#define STORAGE_SCHEMA_ONE(...)		+ 1u
+
+#define STORAGE_CONFIG_ENTRY_COUNT	(0u STORAGE_SCHEMA_CONFIG(STORAGE_SCHEMA_ONE, STORAGE_SCHEMA_ONE, STORAGE_SCHEMA_ONE))	// Entries before this id are in the blob
+
+#define STORAGE_SCHEMA_SCALAR_PROTOTYPES(id, key, section, field, accessor, type, ctype, def, min, max, on_change) \
+	ctype get_##accessor(void); \
+	int set_##accessor(ctype accessor);
+#define STORAGE_SCHEMA_STRING_PROTOTYPES(id, key, section, field, accessor) \
+	void get_##accessor(uint8_t *accessor); \
+	int set_##accessor(const uint8_t *accessor);
+#define STORAGE_SCHEMA_BLOB_PROTOTYPES(id, key, section, field, accessor, ctype) \
+	void get_##accessor(ctype *accessor); \
+	int set_##accessor(const ctype *accessor);
+
+#endif /* MAIN_INCLUDE_STORAGE_SCHEMA_H_ */
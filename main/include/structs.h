@@ -26,16 +26,37 @@ struct runtime_data_s {
 	int16_t		temperature;
 	uint16_t    relative_humidity;
 	uint16_t    voc;
-	uint16_t    lux;
+	uint32_t    lux;
+	uint8_t     luminosity_state;
 	int16_t     internal_temperature;
 	int16_t     external_temperature;
+	uint16_t    external_absolute_humidity;
+	uint16_t    external_voc;
 	uint16_t    automatic_cycle_duration;
 	uint8_t     wifi_unlocked;
 };
 
 ////
+/// VOC gas index algorithm checkpoint (fix16_t states)
+struct voc_algorithm_state_s {
+	int32_t     mean;
+	int32_t     std;
+	uint32_t    timestamp;		// time(NULL) when saved, seconds
+};
+
+/// SHT4x self-heating model: rise above the ambient air, TEMPERATURE_SCALE
+/// rise = die * (t_die - t_sht) / 1000 + fan * duty_permille / 1000 + wifi (radio on) + offset
+struct self_heating_s {
+	int32_t     die;			// per mille of the die to SHT4x difference
+	int32_t     fan;			// rise at full fan duty
+	int32_t     wifi;
+	int32_t     offset;
+};
+
 struct saved_data_s {
 	uint32_t    filter_operating;
+	struct voc_algorithm_state_s voc_algorithm_state;
+	struct self_heating_s self_heating;
 };
 
 ///
@@ -48,7 +69,7 @@ struct configuration_settings_s {
 	int16_t		temperature_offset;
 	int16_t    	relative_humidity_offset;
 	uint8_t     wrn_flt_disable;
-
+	uint16_t    relative_humidity_slope_threshold;
 };
 
 ////
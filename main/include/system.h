@@ -12,7 +12,7 @@
 #include <freertos/semphr.h>
 
 #include "driver/i2c.h"
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include <string.h>
 #include <stdio.h>
@@ -48,7 +48,11 @@
 
 #define ARRAY_SIZE(array) 				(sizeof(array) / sizeof((array)[0]))
 
-#define NTC_ADC_NB_SAMPLE				(32u)
+#define NTC_ADC_SAMPLE_FREQ_HZ			(1000u)		// Continuous conversion rate, SOC_ADC_SAMPLE_FREQ_THRES_LOW minimum
+#define NTC_ADC_FRAME_SAMPLES			(64u)		// Decimation factor: one mean per DMA frame
+#define NTC_ADC_FRAME_SIZE				(NTC_ADC_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define NTC_ADC_STORE_BUF_SIZE			(4u * NTC_ADC_FRAME_SIZE)
+#define NTC_ADC_MEDIAN_SIZE				(5u)		// Median window over the decimated samples
 
 #define TEMP_F_INVALID					65535.f
 #define HUM_F_INVALID					65535.f
@@ -93,12 +97,11 @@ struct i2c_dev_s {
 	i2c_port_t i2c_num;
 	i2c_config_t i2c_conf;
 	TickType_t i2c_timeout;
-	SemaphoreHandle_t lock;
 };
 
 struct adc_dev_s {
 	adc_channel_t adc_channel;
-	adc_oneshot_unit_handle_t adc_handle;
+	adc_continuous_handle_t adc_handle;
 	adc_cali_handle_t adc_cali_handle;
 	SemaphoreHandle_t lock;
 };
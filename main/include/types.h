@@ -13,13 +13,15 @@
 #define TEMPERATURE_INVALID						INT16_MAX
 #define RELATIVE_HUMIDITY_INVALID				UINT16_MAX
 #define VOC_INVALID								UINT16_MAX
-#define LUX_INVALID								UINT16_MAX
+#define LUX_INVALID								UINT32_MAX
+#define ABSOLUTE_HUMIDITY_INVALID				UINT16_MAX
 
 #warning //Check scale
 #define TEMPERATURE_SCALE						(100)
 #define RELATIVE_HUMIDITY_SCALE					(100u)
 #define VOC_SCALE								(1u)
-#define LUX_SCALE						        (1u)
+#define LUX_SCALE						        (10u)		// 0.1 lux, 32 bits hold the LTR303 full range
+#define ABSOLUTE_HUMIDITY_SCALE					(100u)		// g/m3
 
 // Offset
 #define TEMPERATURE_OFFSET_FIXED				(0)
@@ -31,7 +33,7 @@
 #define SET_VALUE_TO_TEMP_RAW(val)				(val == TEMP_F_INVALID ? TEMPERATURE_INVALID : (int16_t) (val * TEMPERATURE_SCALE))
 #define SET_VALUE_TO_RH_RAW(val)				(val == HUM_F_INVALID ? RELATIVE_HUMIDITY_INVALID : (uint16_t) (val * RELATIVE_HUMIDITY_SCALE))
 #define SET_VALUE_TO_VOC_RAW(val)				(val == GAS_U_INVALID ? VOC_INVALID : (uint16_t) (val * VOC_SCALE))
-#define SET_VALUE_TO_LUX_RAW(val)				(val == LUX_F_INVALID ? LUX_INVALID : (uint16_t) (val * LUX_SCALE))
+#define SET_VALUE_TO_LUX_RAW(val)				(val == LUX_F_INVALID ? LUX_INVALID : (uint32_t) (val * LUX_SCALE))
 
 #define TEMP_RAW_TO_INT(t)						(int16_t) (t / TEMPERATURE_SCALE)
 #define TEMP_RAW_TO_DEC(t)						(uint16_t) (abs((int) t) % TEMPERATURE_SCALE)
@@ -39,8 +41,8 @@
 #define RH_RAW_TO_INT(rh)						(uint16_t) (rh / RELATIVE_HUMIDITY_SCALE)
 #define RH_RAW_TO_DEC(rh)						(uint16_t) (rh % RELATIVE_HUMIDITY_SCALE)
 
-#define LUX_RAW_TO_INT(lux)						(uint16_t) (lux / LUX_SCALE)
-#define LUX_RAW_TO_DEC(lux)						(uint16_t) (abs((int) lux ) % LUX_SCALE)
+#define LUX_RAW_TO_INT(lux)						(uint32_t) ((lux) / LUX_SCALE)
+#define LUX_RAW_TO_DEC(lux)						(uint16_t) ((lux) % LUX_SCALE)
 
 #define OFFSET_TEMP_RAW_TO_INT(t)			    (int16_t) (t / TEMPERATURE_SCALE)
 #define OFFSET_TEMP_RAW_TO_DEC(t)			    (uint16_t) (abs((int) t) % TEMPERATURE_SCALE)
@@ -58,7 +60,6 @@
 #define DURATION_FIXED_CYCLE					(45U)
 #define DURATION_AUTOMATIC_CYCLE_OUT			(45U)
 #define DURATION_AUTOMATIC_CYCLE_IN				(150U)
-#define DURATION_RESTART_AUTOMATIC_CYCLE		(10U * SECONDS_PER_HOUR)
 #define DURATION_EXTRA_CYCLE_BOOST				(200U)
 #define DURATION_RESTART_EXTRA_CYCLE			(1U * SECONDS_PER_HOUR)
 
@@ -82,6 +83,12 @@
 
 #define RH_THRESHOLD_ADV_CTRL_PERCENTAGE		(90U)
 
+#define AH_EXTRA_CYCLE_MARGIN					(50U)		// ABSOLUTE_HUMIDITY_SCALE: outdoor air must be at least 0.5 g/m3 drier
+
+#define RH_SLOPE_WINDOW							(30U)							// Samples of the regression window (1 Hz)
+#define RH_SLOPE_THRESHOLD_DEFAULT				(3U * RELATIVE_HUMIDITY_SCALE)	// Per minute, 0 disables the slope trigger
+#define RH_SLOPE_THRESHOLD_MAX					(50U * RELATIVE_HUMIDITY_SCALE)
+
 #define VOC_THRESHOLD_LOW						(150U * VOC_SCALE)
 #define VOC_THRESHOLD_MEDIUM					(200U * VOC_SCALE)
 #define VOC_THRESHOLD_HIGH						(250U * VOC_SCALE)
@@ -89,6 +96,12 @@
 #define VOC_DIFFERENTIAL_LOW					(10U * VOC_SCALE)
 #define VOC_DIFFERENTIAL_HIGH					(0U * VOC_SCALE)
 
+#define PROPORTIONAL_PERCENTAGE_MIN				(40U)							// Airflow with RH and VOC under threshold
+#define PROPORTIONAL_PERCENTAGE_MAX				(100U)							// Airflow at full span excess
+#define PROPORTIONAL_PERCENTAGE_STEP			(2U)							// Maximum change per controller period
+#define PROPORTIONAL_RH_SPAN					(10U * RELATIVE_HUMIDITY_SCALE)	// RH excess giving the maximum airflow
+#define PROPORTIONAL_VOC_SPAN					(100U * VOC_SCALE)				// VOC excess giving the maximum airflow
+
 // Flags
 #define COND_LUMINOSITY							BIT(0)
 #define COND_RH_EXTRA_CYCLE						BIT(1)
@@ -138,6 +151,13 @@ enum {
 	LUX_THRESHOLD_SETTING_HIGH					= 0x03,
 };
 
+// Luminosity state, from the LTR303 threshold events
+enum {
+	LUMINOSITY_STATE_UNKNOWN					= 0x00,
+	LUMINOSITY_STATE_DAY						= 0x01,
+	LUMINOSITY_STATE_NIGHT						= 0x02,
+};
+
 // VOC threshold setting
 enum {
 	VOC_THRESHOLD_SETTING_NOT_CONFIGURED		= 0x00,
@@ -165,6 +185,7 @@ enum {
     SPEED_MEDIUM								= 0x03,
     SPEED_HIGH									= 0x04,
     SPEED_BOOST									= 0x05,
+    SPEED_PROPORTIONAL							= 0x06,		// Automatic cycle only: airflow follows RH/VOC excess
 	SPEED_AUTOMATIC_CYCLE_FORCE_BOOST			= BIT(6),
 	SPEED_AUTOMATIC_CYCLE_FORCE_NIGHT			= BIT(7),
 };